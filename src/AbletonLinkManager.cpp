@@ -1,24 +1,58 @@
 #include "AbletonLinkManager.h"
+#include <iostream>
 
-int PHRASE_LENGTH = 0;
-int BPM = 0;
-
-std::shared_ptr<ableton::Link> loadAbletonLink(const AppConfig& config) {
+AbletonLinkManager::AbletonLinkManager(const AppConfig& config, bool requirePeers) :
+    link(config.default_bpm),
+    quantum(config.phraseLength),
+    latency(std::chrono::microseconds(static_cast<long long>(config.linkLatencyMs * 1000.0))),
+    requirePeers(requirePeers),
+    startStopSync(config.linkStartStopSync) {
     std::cout << "Initializing Ableton Link..." << std::endl;
 
-    PHRASE_LENGTH = config.phraseLength;
-    BPM = config.default_bpm;
-    std::shared_ptr<ableton::Link> link = std::make_shared<ableton::Link>(PHRASE_LENGTH);
+    // Called on Link's own thread, keep it to an atomic store
+    link.setNumPeersCallback([this](std::size_t numPeers) {
+        peers.store(numPeers, std::memory_order_relaxed);
+    });
+    link.enableStartStopSync(startStopSync);
 
-    std::cout << "Connecting to Ableton Link session..." << std::endl;
+    // Join the session on the local network
+    link.enable(true);
+}
 
-    // Enable the Link session to join the local network.
-    link->enable(true);
-    link->setTempoCallback([](double newTempo) {
-        // This code will be executed whenever the tempo changes
-        std::cout << "Tempo changed to: " << newTempo << " BPM\n";
-        BPM = newTempo;
-    });
+AbletonLinkManager::~AbletonLinkManager() {
+    link.enable(false);
+}
+
+void AbletonLinkManager::capture(std::chrono::steady_clock::time_point now) {
+    sessionState = link.captureAppSessionState();
+
+    // Link's clock and steady_clock are both monotonic but need not share an epoch
+    auto steadyMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch());
+    hostTimeOffset = link.clock().micros() - steadyMicros;
+}
+
+bool AbletonLinkManager::isActive() const {
+    if (!sessionState) {
+        return false;
+    }
+    if (requirePeers && getPeerCount() == 0) {
+        return false;
+    }
+    return !startStopSync || sessionState->isPlaying();
+}
+
+double AbletonLinkManager::getBpm() const {
+    return sessionState ? sessionState->tempo() : 0.0;
+}
+
+double AbletonLinkManager::getBeat(std::chrono::steady_clock::time_point now) const {
+    return sessionState ? sessionState->beatAtTime(toHostTime(now), quantum) : 0.0;
+}
+
+double AbletonLinkManager::getPhase(std::chrono::steady_clock::time_point now) const {
+    return sessionState ? sessionState->phaseAtTime(toHostTime(now), quantum) : 0.0;
+}
 
-    return link;
+std::chrono::microseconds AbletonLinkManager::toHostTime(std::chrono::steady_clock::time_point now) const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()) + hostTimeOffset + latency;
 }
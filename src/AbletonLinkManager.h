@@ -1,9 +1,47 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include "BeatSource.h"
 #include "ConfigManager.h"
 #include <ableton/Link.hpp>
 
-extern int PHRASE_LENGTH;
-extern int BPM;
+// Tempo and beat phase shared with the other Link peers on the network:
+// Ableton Live, DJ software, other VisualHive machines. The phrase length is
+// the Link quantum, so phrases line up on every peer. The session state is
+// captured once per frame and every query of that frame reads the snapshot.
+class AbletonLinkManager : public BeatSource {
+public:
+    // With `requirePeers` the source only counts as active while another peer is connected
+    AbletonLinkManager(const AppConfig& config, bool requirePeers);
+    ~AbletonLinkManager();
 
-std::shared_ptr<ableton::Link> loadAbletonLink(const AppConfig& config);
+    std::string getName() const override { return "ableton link"; }
+    void capture(std::chrono::steady_clock::time_point now) override;
+    bool isActive() const override;
+    double getBpm() const override;
+    double getBeat(std::chrono::steady_clock::time_point now) const override;
+
+    // Position within the current phrase, from 0 to the quantum
+    double getPhase(std::chrono::steady_clock::time_point now) const;
+
+    size_t getPeerCount() const { return peers.load(std::memory_order_relaxed); }
+
+    // Added to every query so the picture is in phase when it reaches the screen
+    std::chrono::microseconds getLatency() const { return latency; }
+
+private:
+    std::chrono::microseconds toHostTime(std::chrono::steady_clock::time_point now) const;
+
+    ableton::Link link;
+    double quantum;
+    std::chrono::microseconds latency;
+    bool requirePeers;
+    bool startStopSync;
+    std::atomic<size_t> peers{0};
+
+    // Frame loop only
+    std::optional<ableton::Link::SessionState> sessionState;
+    std::chrono::microseconds hostTimeOffset{0};
+};
@@ -0,0 +1,184 @@
+#include "AssetIndex.h"
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <opencv2/imgproc.hpp>
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+
+// Bumped whenever the probe fields change, so an older index is rebuilt
+static const int ASSET_INDEX_VERSION = 1;
+
+std::optional<AssetFileStamp> AssetFileStamp::of(const fs::path& path) {
+    std::error_code error;
+    AssetFileStamp stamp;
+    stamp.size = fs::file_size(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    auto modified = fs::last_write_time(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    stamp.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+    return stamp;
+}
+
+AssetIndex::AssetIndex(const fs::path& directory)
+    : indexFile(directory / "asset_index.json"), thumbnailDirectory(directory / "thumbnails") {}
+
+void AssetIndex::load() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    isChanged = false;
+
+    std::ifstream file(indexFile);
+    if (!file.is_open()) {
+        return;
+    }
+    try {
+        nlohmann::json data;
+        file >> data;
+        if (data.value("version", 0) != ASSET_INDEX_VERSION) {
+            std::cout << "Asset index " << indexFile.string() << " is from another version, rebuilding it" << std::endl;
+            isChanged = true;
+            return;
+        }
+        for (const auto& [path, item] : data.at("assets").items()) {
+            Entry entry;
+            entry.stamp.size = item.at("size").get<uintmax_t>();
+            entry.stamp.modified = item.at("modified").get<int64_t>();
+            entry.probe.isValid = true;
+            entry.probe.codec = item.value("codec", "");
+            entry.probe.fps = item.value("fps", 0.0);
+            entry.probe.frameCount = item.value("frame_count", 0);
+            entry.probe.width = item.value("width", 0);
+            entry.probe.height = item.value("height", 0);
+            entry.probe.hasAlpha = item.value("alpha", false);
+            entry.probe.thumbnail = item.value("thumbnail", "");
+            entries[path] = entry;
+        }
+    } catch (const nlohmann::json::exception& e) {
+        std::cerr << "Ignoring asset index " << indexFile.string() << ": " << e.what() << std::endl;
+        entries.clear();
+        isChanged = true;
+    }
+}
+
+void AssetIndex::save() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.isUsed) {
+            ++it;
+            continue;
+        }
+        if (!it->second.probe.thumbnail.empty()) {
+            std::error_code error;
+            fs::remove(it->second.probe.thumbnail, error);
+        }
+        it = entries.erase(it);
+        isChanged = true;
+    }
+    if (isChanged) {
+        write();
+    }
+
+    // The next save() keeps what is looked up from here on
+    for (auto& [path, entry] : entries) {
+        entry.isUsed = false;
+    }
+}
+
+void AssetIndex::write() {
+    nlohmann::json assets = nlohmann::json::object();
+    for (const auto& [path, entry] : entries) {
+        assets[path] = {
+            {"size", entry.stamp.size},
+            {"modified", entry.stamp.modified},
+            {"codec", entry.probe.codec},
+            {"fps", entry.probe.fps},
+            {"frame_count", entry.probe.frameCount},
+            {"width", entry.probe.width},
+            {"height", entry.probe.height},
+            {"alpha", entry.probe.hasAlpha},
+            {"thumbnail", entry.probe.thumbnail}
+        };
+    }
+    nlohmann::json data = {{"version", ASSET_INDEX_VERSION}, {"assets", assets}};
+
+    std::error_code error;
+    fs::create_directories(indexFile.parent_path(), error);
+    const fs::path temporaryFile = indexFile.string() + ".tmp";
+    std::ofstream file(temporaryFile);
+    if (!file.is_open()) {
+        std::cerr << "Could not write the asset index to " << indexFile.string() << std::endl;
+        return;
+    }
+    file << data.dump();
+    file.close();
+    fs::rename(temporaryFile, indexFile, error);
+    if (error) {
+        std::cerr << "Could not replace " << indexFile.string() << ": " << error.message() << std::endl;
+        return;
+    }
+    isChanged = false;
+}
+
+std::optional<AssetProbe> AssetIndex::find(const std::string& path, const AssetFileStamp& stamp) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(path);
+    if (it == entries.end() || !(it->second.stamp == stamp)) {
+        return std::nullopt;
+    }
+    const std::string& thumbnail = it->second.probe.thumbnail;
+    if (!thumbnail.empty() && !fs::exists(thumbnail)) {
+        return std::nullopt;
+    }
+    it->second.isUsed = true;
+    return it->second.probe;
+}
+
+void AssetIndex::store(const std::string& path, const AssetFileStamp& stamp, const AssetProbe& probe) {
+    // Invalid files are probed again every time, so fixing one needs no cleanup
+    if (!probe.isValid) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[path];
+    if (!entry.probe.thumbnail.empty() && entry.probe.thumbnail != probe.thumbnail) {
+        std::error_code error;
+        fs::remove(entry.probe.thumbnail, error);
+    }
+    entry.stamp = stamp;
+    entry.probe = probe;
+    entry.isUsed = true;
+    isChanged = true;
+}
+
+std::string AssetIndex::getThumbnailFile(const std::string& path, const AssetFileStamp& stamp) const {
+    std::ostringstream name;
+    name << std::hex << std::hash<std::string>{}(path) << "-" << stamp.size << "-" << stamp.modified << ".png";
+    return (thumbnailDirectory / name.str()).string();
+}
+
+bool writeThumbnail(const cv::Mat& frame, const std::string& file) {
+    if (frame.empty()) {
+        return false;
+    }
+    cv::Mat thumbnail = frame;
+    if (frame.cols > THUMBNAIL_WIDTH) {
+        int height = std::max(1, frame.rows * THUMBNAIL_WIDTH / frame.cols);
+        cv::resize(frame, thumbnail, cv::Size(THUMBNAIL_WIDTH, height), 0, 0, cv::INTER_AREA);
+    }
+    std::error_code error;
+    fs::create_directories(fs::path(file).parent_path(), error);
+    try {
+        return cv::imwrite(file, thumbnail);
+    } catch (const cv::Exception& e) {
+        std::cerr << "Could not write thumbnail " << file << ": " << e.what() << std::endl;
+        return false;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+// Width of the thumbnails kept in the asset index, shown while assigning keys
+const int THUMBNAIL_WIDTH = 320;
+
+// What probing an asset's file found
+struct AssetProbe {
+    bool isValid = false;
+    std::string error; // Why the asset cannot be used
+    std::string codec; // FourCC of video loops, the file extension of images
+    double fps = 0.0; // Video loops only
+    int frameCount = 0;
+    int width = 0;
+    int height = 0;
+    bool hasAlpha = false;
+    std::string thumbnail; // PNG in the index's thumbnail directory, empty if there is none
+};
+
+// Identifies one version of a file: a changed size or modification time makes it a new one
+struct AssetFileStamp {
+    uintmax_t size = 0;
+    int64_t modified = 0; // Ticks of the filesystem clock
+
+    bool operator==(const AssetFileStamp& other) const { return size == other.size && modified == other.modified; }
+
+    // nullopt if the file does not exist
+    static std::optional<AssetFileStamp> of(const std::filesystem::path& path);
+};
+
+// Probe results of every asset file seen before, keyed by path and checked
+// against the file's stamp, so only new or changed files are probed again.
+// Kept as JSON in `directory`, with a thumbnail per video or image next to it.
+// Lookups and updates may come from any thread.
+class AssetIndex {
+public:
+    explicit AssetIndex(const std::filesystem::path& directory);
+
+    // Reads the index; a missing, unreadable or older index starts empty
+    void load();
+    // Writes the index back if anything changed, leaving out the files that
+    // were not looked up since the last load() or save()
+    void save();
+
+    // The stored probe, if `path` was probed at this stamp and the thumbnail is still there
+    std::optional<AssetProbe> find(const std::string& path, const AssetFileStamp& stamp);
+    void store(const std::string& path, const AssetFileStamp& stamp, const AssetProbe& probe);
+
+    // Where the thumbnail for this version of `path` goes
+    std::string getThumbnailFile(const std::string& path, const AssetFileStamp& stamp) const;
+
+private:
+    // Called with the mutex held
+    void write();
+
+    struct Entry {
+        AssetFileStamp stamp;
+        AssetProbe probe;
+        bool isUsed = false;
+    };
+
+    std::filesystem::path indexFile;
+    std::filesystem::path thumbnailDirectory;
+    std::map<std::string, Entry> entries;
+    bool isChanged = false;
+    std::mutex mutex;
+};
+
+// Scales `frame` down to THUMBNAIL_WIDTH and writes it as a PNG. False if it could not be written.
+bool writeThumbnail(const cv::Mat& frame, const std::string& file);
@@ -5,12 +5,18 @@
 #include <filesystem>
 #include <string>
 #include <random>
+#include <deque>
+#include <future>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/videoio.hpp>
+#include "TaskScheduler.h"
 
 namespace fs = std::filesystem;
 
+// Assets whose first frame is extracted ahead of the one waiting for a key
+static const size_t KEY_ASSIGNMENT_PREFETCH = 4;
+
 cv::Scalar toScalar(const std::string& hexColor);
 
 fs::path Background::backgroundsPath;
@@ -110,6 +116,50 @@ const cv::Mat Background::get_first_frame() const {
     }
 }
 
+AssetProbe Background::probe_source(const std::string& thumbnailFile) const {
+    AssetProbe result;
+    if (this->type == SOLID_COLOR) {
+        try {
+            toScalar(this->asset_source);
+            result.isValid = true;
+        } catch (const std::invalid_argument& e) {
+            result.error = e.what();
+        }
+        return result;
+    }
+
+    if (!fs::exists(this->get_background_path().value())) {
+        result.error = "neither a color nor an existing file";
+        return result;
+    }
+    cv::VideoCapture cap(this->get_background_path().value());
+    if (!cap.isOpened()) {
+        result.error = "could not open the video";
+        return result;
+    }
+    const int fourcc = static_cast<int>(cap.get(cv::CAP_PROP_FOURCC));
+    for (int shift = 0; shift < 32 && fourcc != 0; shift += 8) {
+        result.codec += static_cast<char>((fourcc >> shift) & 0xFF);
+    }
+    result.fps = cap.get(cv::CAP_PROP_FPS);
+    result.frameCount = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+    result.width = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
+    result.height = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+
+    result.isValid = result.width > 0 && result.height > 0;
+    if (!result.isValid) {
+        result.error = "the video has no picture";
+    } else if (!thumbnailFile.empty()) {
+        cv::Mat frame;
+        cap >> frame;
+        if (writeThumbnail(frame, thumbnailFile)) {
+            result.thumbnail = thumbnailFile;
+        }
+    }
+    cap.release();
+    return result;
+}
+
 bool Background::open() {
     if (this->type == VIDEO_LOOP) {
         this->video_loop_cap.open(this->get_background_path().value());
@@ -149,6 +199,17 @@ cv::Mat Background::get_next_frame() {
     }
 }
 
+// Advance a video loop by one frame without converting it, used when the
+// quality governor only wants every other frame
+void Background::skip_frame() {
+    if (this->type == VIDEO_LOOP) {
+        if (!this->video_loop_cap.grab()) { // loop the video when the end is reached
+            this->video_loop_cap.set(cv::CAP_PROP_POS_FRAMES, 0);
+            this->video_loop_cap.grab();
+        }
+    }
+}
+
 const cv::Mat Background::get_solid_color_frame(int width, int height, const cv::Scalar& color) const {
     cv::Mat solidColorFrame(height, width, CV_8UC3, color);
     return solidColorFrame;
@@ -167,6 +228,29 @@ const std::string Foreground::get_foreground_path() const {
     return foregroundsPath / this->asset_source;
 }
 
+AssetProbe Foreground::probe_source(const std::string& thumbnailFile) const {
+    AssetProbe result;
+    const fs::path path = this->get_foreground_path();
+    if (!fs::exists(path)) {
+        result.error = "file not found";
+        return result;
+    }
+    cv::Mat image = cv::imread(path.string(), cv::IMREAD_UNCHANGED);
+    if (image.empty()) {
+        result.error = "not an image OpenCV can read";
+        return result;
+    }
+    result.isValid = true;
+    result.codec = path.extension().string();
+    result.width = image.cols;
+    result.height = image.rows;
+    result.hasAlpha = image.channels() == 4;
+    if (!thumbnailFile.empty() && writeThumbnail(image, thumbnailFile)) {
+        result.thumbnail = thumbnailFile;
+    }
+    return result;
+}
+
 const cv::Mat Foreground::get_first_frame() const {
     return cv::imread(this->get_foreground_path(), cv::IMREAD_UNCHANGED);
 }
@@ -187,17 +271,21 @@ cv::Mat Foreground::get_next_frame() {
 }   
 
 // Constructor now takes the AppConfig object
-AssetManager::AssetManager(const AppConfig& config) : appConfig(config) {
-   std::ifstream jsonFile(config.assetsConfigFile);
+AssetManager::AssetManager(const AppConfig& config) : appConfig(config), assetIndex(config.assetCacheDirectory) {
+    assets = std::make_shared<const AssetsConfig>(readAssetsConfig());
+}
+
+AssetsConfig AssetManager::readAssetsConfig() const {
+    std::ifstream jsonFile(appConfig.assetsConfigFile);
 
     if (!jsonFile.is_open()) {
-        throw std::runtime_error("Failed to open AssetConfig file: " + config.assetsConfigFile);
+        throw std::runtime_error("Failed to open AssetConfig file: " + appConfig.assetsConfigFile);
     }
 
     try {
         nlohmann::json data;
         jsonFile >> data; 
-        assets = data.get<AssetsConfig>();
+        return data.get<AssetsConfig>();
     } catch (const nlohmann::json::parse_error& e) {
         std::cerr << "JSON parse error: " << e.what() << std::endl;
         throw;
@@ -205,8 +293,56 @@ AssetManager::AssetManager(const AppConfig& config) : appConfig(config) {
 }
 
 // Main initialization function
-void AssetManager::initializeAssets() {
-    loadAssetsIntoMemory();
+void AssetManager::initializeAssets(TaskScheduler& scheduler) {
+    assetIndex.load();
+    loadAssetsIntoMemory(scheduler);
+}
+
+bool AssetManager::reloadAssets(TaskScheduler& scheduler) {
+    AssetsConfig table;
+    try {
+        table = readAssetsConfig();
+    } catch (const std::exception& e) {
+        std::cerr << "Keeping the current assets, " << appConfig.assetsConfigFile << " cannot be used: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Assets that cannot be used are left out instead of stopping the show
+    probeAssets(table, scheduler);
+    assetIndex.save();
+    auto dropInvalid = [](auto& assetMap) {
+        for (auto it = assetMap.begin(); it != assetMap.end();) {
+            it = it->second.get_probe().isValid ? std::next(it) : assetMap.erase(it);
+        }
+    };
+    dropInvalid(table.get_mutable_backgrounds());
+    dropInvalid(table.get_mutable_foregrounds());
+
+    // The cue picks a random asset of each kind, so neither may run out mid-show
+    if (table.get_backgrounds().empty() || table.get_foregrounds().empty()) {
+        std::cerr << "Keeping the current assets, the reload left " << table.get_backgrounds().size() << " backgrounds and "
+                  << table.get_foregrounds().size() << " foregrounds" << std::endl;
+        return false;
+    }
+
+    // Keys are only asked for at startup; until then an asset is only played at random
+    auto reportUnkeyed = [](const auto& assetMap) {
+        for (const auto& [key, value] : assetMap) {
+            if (value.get_key() == "") {
+                std::cout << key << " has no key yet, restart to assign one" << std::endl;
+            }
+        }
+    };
+    reportUnkeyed(table.get_backgrounds());
+    reportUnkeyed(table.get_foregrounds());
+
+    std::cout << "Assets reloaded: " << table.get_backgrounds().size() << " backgrounds, "
+              << table.get_foregrounds().size() << " foregrounds" << std::endl;
+
+    // Readers copy their asset out of whichever table they loaded, so the frame
+    // thread never waits for the swap; the old table goes with the last of them
+    std::atomic_store(&assets, std::make_shared<const AssetsConfig>(std::move(table)));
+    return true;
 }
 
 cv::Scalar toScalar(const std::string& hexColor) {
@@ -233,62 +369,183 @@ cv::Scalar toScalar(const std::string& hexColor) {
     }
 }
 
-void AssetManager::loadAssetsIntoMemory() {
+void AssetManager::loadAssetsIntoMemory(TaskScheduler& scheduler) {
     Background::backgroundsPath = fs::path(appConfig.assetsDir) / "backgrounds";
     Foreground::foregroundsPath = fs::path(appConfig.assetsDir) / "foregrounds";
-    
-    for (auto& [key, value] : this->assets.get_mutable_backgrounds()) {
-        if (fs::exists(Background::backgroundsPath / key)) {
+
+    // Filled in a copy, published once every asset has its key
+    AssetsConfig table = *getAssets();
+
+    // The config as read, to tell whether anything needs writing back
+    nlohmann::json loaded;
+    to_json(loaded, table);
+
+    const size_t total = table.get_backgrounds().size() + table.get_foregrounds().size();
+    const size_t invalid = probeAssets(table, scheduler);
+    assetIndex.save();
+    if (invalid > 0) {
+        std::cerr << invalid << " of " << total << " assets cannot be used, fix or remove them in " << appConfig.assetsConfigFile << std::endl;
+        exit(1);
+    }
+
+    auto& backgrounds = table.get_mutable_backgrounds();
+    auto& foregrounds = table.get_mutable_foregrounds();
+
+    // Pictures are only needed to assign a missing key. The index's thumbnail
+    // is used where there is one, otherwise the first frame is extracted a few
+    // assets ahead of the one on screen while its key is being chosen
+    auto assignMissingKeys = [&](auto& assetMap) {
+        using Asset = typename std::decay_t<decltype(assetMap)>::mapped_type;
+        std::vector<std::pair<std::string, Asset*>> unkeyed;
+        for (auto& [key, value] : assetMap) {
+            if (value.get_key() == "") {
+                unkeyed.emplace_back(key, &value);
+            }
+        }
+        std::deque<std::future<cv::Mat>> frames;
+        size_t nextFrame = 0;
+        for (size_t i = 0; i < unkeyed.size(); ++i) {
+            for (; nextFrame < unkeyed.size() && nextFrame < i + KEY_ASSIGNMENT_PREFETCH; ++nextFrame) {
+                const Asset* asset = unkeyed[nextFrame].second;
+                frames.push_back(scheduler.async(TaskPriority::Prefetch, [asset]() {
+                    const std::string& thumbnail = asset->get_probe().thumbnail;
+                    cv::Mat frame = thumbnail.empty() ? cv::Mat() : cv::imread(thumbnail, cv::IMREAD_UNCHANGED);
+                    return frame.empty() ? asset->get_first_frame() : frame;
+                }));
+            }
+            cv::Mat firstFrame = frames.front().get();
+            frames.pop_front();
+
+            std::string windowName = "Key Assignment " + unkeyed[i].first;
+            std::string pressed_key(1, displayAndGetKey(windowName, firstFrame));
+            unkeyed[i].second->set_key(pressed_key);
+            cv::destroyWindow(windowName);
+        }
+    };
+    assignMissingKeys(backgrounds);
+    assignMissingKeys(foregrounds);
+
+    for (auto bg : table.get_backgrounds()) {
+        std::cout << bg.first << ": " << bg.second.get_background_path().value_or("solid color") << " - " << bg.second.get_type() << "\n";
+    }
+
+    nlohmann::json j;
+    to_json(j, table);
+    std::atomic_store(&assets, std::make_shared<const AssetsConfig>(std::move(table)));
+    if (j == loaded) {
+        return;
+    }
+    saveAssetsConfig(j);
+    std::cout << "Saved the assigned keys to " << this->appConfig.assetsConfigFile << std::endl;
+}
+
+size_t AssetManager::probeAssets(AssetsConfig& table, TaskScheduler& scheduler) {
+    // One stat per file tells whether it exists and whether the index still
+    // describes it; only the files it does not are opened
+    auto& backgrounds = table.get_mutable_backgrounds();
+    auto& foregrounds = table.get_mutable_foregrounds();
+    // Each asset's full path, and its stamp if the file exists
+    using AssetFile = std::pair<std::string, std::optional<AssetFileStamp>>;
+    std::vector<AssetFile> backgroundFiles;
+    std::vector<AssetFile> foregroundFiles;
+    for (auto& [key, value] : backgrounds) {
+        const std::string path = (Background::backgroundsPath / key).string();
+        backgroundFiles.emplace_back(path, AssetFileStamp::of(path));
+        if (backgroundFiles.back().second) {
             value.set_source(VIDEO_LOOP, key);
         }
         else if (key.rfind("#", 0) == 0) {
             value.set_source(SOLID_COLOR, key);
         }
         else {
-            std::cout << "ERROR: Current asset is neither a color or an existing file: " << key << "\n";
-            exit(1);
-        }
-
-        if (value.get_key() == "") {
-            std::string pressed_key(1, displayAndGetKey("Key Assignment " + key, value.get_first_frame()));
-            value.set_key(pressed_key);
-            cv::destroyWindow("Key Assignment " + key);
+            // Probed as a video, which reports the missing file
+            value.set_source(VIDEO_LOOP, key);
         }
     }
-
-    for (auto& [key, value] : this->assets.get_mutable_foregrounds()) {
+    for (auto& [key, value] : foregrounds) {
         value.set_source(key);
-
-        if (value.get_key() == "") {
-            std::string pressed_key(1, displayAndGetKey("Key Assignment " + key, value.get_first_frame()));
-            value.set_key(pressed_key);
-            cv::destroyWindow("Key Assignment " + pressed_key);
+        const std::string path = value.get_foreground_path();
+        foregroundFiles.emplace_back(path, AssetFileStamp::of(path));
+    }
+
+    // Opening a container reads its header from disk, which for a few hundred
+    // clips one after the other is most of the startup time
+    size_t unchanged = 0;
+    auto submitProbes = [&](auto& assetMap, const std::vector<AssetFile>& files) {
+        using Asset = typename std::decay_t<decltype(assetMap)>::mapped_type;
+        std::vector<std::future<AssetProbe>> probes;
+        size_t index = 0;
+        for (auto& [key, value] : assetMap) {
+            const auto& [path, stamp] = files[index++];
+            std::optional<AssetProbe> indexed;
+            if (stamp) {
+                indexed = assetIndex.find(path, *stamp);
+            }
+            if (indexed) {
+                ++unchanged;
+                std::promise<AssetProbe> ready;
+                ready.set_value(*indexed);
+                probes.push_back(ready.get_future());
+                continue;
+            }
+            const Asset* asset = &value;
+            probes.push_back(scheduler.async(TaskPriority::Background, [this, asset, path = path, stamp = stamp]() {
+                if (!stamp) {
+                    return asset->probe_source("");
+                }
+                AssetProbe result = asset->probe_source(assetIndex.getThumbnailFile(path, *stamp));
+                assetIndex.store(path, *stamp, result);
+                return result;
+            }));
         }
-    }
-
-    for (auto bg : this->assets.get_backgrounds()) {
-        std::cout << bg.first << ": " << bg.second.get_background_path().value_or("solid color") << " - " << bg.second.get_type() << "\n";
-    }
+        return probes;
+    };
+    std::vector<std::future<AssetProbe>> backgroundProbes = submitProbes(backgrounds, backgroundFiles);
+    std::vector<std::future<AssetProbe>> foregroundProbes = submitProbes(foregrounds, foregroundFiles);
+
+    const size_t total = backgroundProbes.size() + foregroundProbes.size();
+    size_t probed = 0;
+    size_t invalid = 0;
+    auto collect = [&](auto& assetMap, std::vector<std::future<AssetProbe>>& probes) {
+        size_t index = 0;
+        for (auto& [key, value] : assetMap) {
+            AssetProbe result = probes[index++].get();
+            if (!result.isValid) {
+                std::cerr << "\nERROR: " << key << ": " << result.error << std::endl;
+                ++invalid;
+            }
+            value.set_probe(result);
+            std::cout << "\rProbing assets " << ++probed << "/" << total << std::flush;
+        }
+    };
+    collect(backgrounds, backgroundProbes);
+    collect(foregrounds, foregroundProbes);
+    std::cout << " (" << unchanged << " unchanged since the last run)" << std::endl;
+    return invalid;
+}
 
-    nlohmann::json j;
-    to_json(j, this->assets);
-    std::ofstream o(this->appConfig.assetsConfigFile);
+void AssetManager::saveAssetsConfig(const nlohmann::json& data) const {
+    const std::string temporaryFile = this->appConfig.assetsConfigFile + ".tmp";
+    std::ofstream o(temporaryFile);
 
     if (!o.is_open()) {
         std::cerr << "Error: Could not open the file for writing." << std::endl;
         exit(1);
     }
 
-    o << j.dump(4);
-
+    o << data.dump(4);
     o.close();
 
-    std::cout << "Successfully saved the updated configuration to updated_config.json" << std::endl;
-
+    std::error_code error;
+    fs::rename(temporaryFile, this->appConfig.assetsConfigFile, error);
+    if (error) {
+        std::cerr << "Error: Could not replace " << this->appConfig.assetsConfigFile << ": " << error.message() << std::endl;
+        exit(1);
+    }
 }
 
 // Public method to blend foreground with alpha channel onto a background
-cv::Mat AssetManager::blend(const cv::Mat& background, const cv::Mat& foregroundAsset, int screenWidth, int screenHeight, double foregroundScalePercent, cv::Scalar foregroundColor) {
+cv::Mat AssetManager::blend(const cv::Mat& background, const cv::Mat& foregroundAsset, int screenWidth, int screenHeight, double foregroundScalePercent, cv::Scalar foregroundColor, int interpolation) {
     if (background.empty() || foregroundAsset.empty()) {
         return background;
     }
@@ -318,7 +575,7 @@ cv::Mat AssetManager::blend(const cv::Mat& background, const cv::Mat& foreground
     }
     
     // Resize the foreground image
-    cv::resize(foregroundAsset, resizedForeground, cv::Size(targetWidth, newHeight));
+    cv::resize(foregroundAsset, resizedForeground, cv::Size(targetWidth, newHeight), 0, 0, interpolation);
 
     // Calculate position to center the foreground at the bottom of the screen
     int xOffset = (blended.cols - targetWidth) / 2;
@@ -394,8 +651,9 @@ cv::Mat AssetManager::blend(const cv::Mat& background, const cv::Mat& foreground
 }
 
 std::shared_ptr<Background> AssetManager::getDefaultBackground() {
-    for (auto b : this->assets.get_backgrounds()) {
-        if (b.first == this->assets.get_default_config().get_background()) {
+    std::shared_ptr<const AssetsConfig> table = getAssets();
+    for (auto b : table->get_backgrounds()) {
+        if (b.first == table->get_default_config().get_background()) {
             return std::make_shared<Background>(b.second);
         }
     }
@@ -403,8 +661,9 @@ std::shared_ptr<Background> AssetManager::getDefaultBackground() {
 }
 
 std::shared_ptr<Foreground> AssetManager::getDefaultForeground() {
-    for (auto b : this->assets.get_foregrounds()) {
-        if (b.first == this->assets.get_default_config().get_foreground()) {
+    std::shared_ptr<const AssetsConfig> table = getAssets();
+    for (auto b : table->get_foregrounds()) {
+        if (b.first == table->get_default_config().get_foreground()) {
             return std::make_shared<Foreground>(b.second);
         }
     }
@@ -413,17 +672,19 @@ std::shared_ptr<Foreground> AssetManager::getDefaultForeground() {
 }
 
 std::shared_ptr<Background> AssetManager::getBackroundByPressedKey(char pressed_key) {
-    for (auto b : this->assets.get_backgrounds()) {
+    std::shared_ptr<const AssetsConfig> table = getAssets();
+    for (auto b : table->get_backgrounds()) {
         std::string key(1, pressed_key);
         if (b.second.get_key() == key) {
-            return std::make_shared<Background>(assets.get_backgrounds().at(b.first));
+            return std::make_shared<Background>(table->get_backgrounds().at(b.first));
         }
     }
     return nullptr;
 }
 
 std::shared_ptr<Foreground> AssetManager::getForegroundByPressedKey(char pressed_key) {
-    for (auto b : this->assets.get_foregrounds()) {
+    std::shared_ptr<const AssetsConfig> table = getAssets();
+    for (auto b : table->get_foregrounds()) {
         std::string key(1, pressed_key);
         if (b.second.get_key() == key) {
             return std::make_shared<Foreground>(b.second);
@@ -433,7 +694,8 @@ std::shared_ptr<Foreground> AssetManager::getForegroundByPressedKey(char pressed
 }
 
 std::shared_ptr<Background> AssetManager::getRandomBackground() {
-    const auto& backgrounds = this->assets.get_backgrounds();
+    std::shared_ptr<const AssetsConfig> table = getAssets();
+    const auto& backgrounds = table->get_backgrounds();
     if (backgrounds.empty()) {
         return nullptr;
     }
@@ -458,7 +720,8 @@ std::shared_ptr<Background> AssetManager::getRandomBackground() {
  * @return A shared pointer to a random Foreground object, or nullptr if no foregrounds are available.
  */
 std::shared_ptr<Foreground> AssetManager::getRandomForeground() {
-    const auto& foregrounds = this->assets.get_foregrounds();
+    std::shared_ptr<const AssetsConfig> table = getAssets();
+    const auto& foregrounds = table->get_foregrounds();
     if (foregrounds.empty()) {
         return nullptr;
     }
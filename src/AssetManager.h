@@ -4,11 +4,15 @@
 #include <string>
 #include <optional>
 #include <map>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include "ConfigManager.h"
+#include "AssetIndex.h"
 
 namespace fs = std::filesystem;
 
+class TaskScheduler;
+
 // Enum to differentiate between background and foreground assets
 enum BackgroundType {
     VIDEO_LOOP,
@@ -29,6 +33,7 @@ class Background {
     std::vector<int64_t> foregroundColor;
     
     BackgroundType type;
+    AssetProbe probe;
     cv::VideoCapture video_loop_cap;
     cv::Mat solid_color_img;
 
@@ -49,6 +54,12 @@ class Background {
     }
     std::string get_source() { return asset_source; }
 
+    const AssetProbe & get_probe() const { return probe; }
+    void set_probe(const AssetProbe & value) { this->probe = value; }
+    // Opens the video and reads its first frame into `thumbnailFile`, unless
+    // that is empty, or parses the color; safe on any thread
+    AssetProbe probe_source(const std::string& thumbnailFile) const;
+
     const cv::Scalar get_foreground_color() const { 
         int64_t r = foregroundColor[0];
         int64_t g = foregroundColor[1];
@@ -82,6 +93,7 @@ class Background {
     bool open();
     void close();
     cv::Mat get_next_frame();
+    void skip_frame();
 
     double get_fps();
 
@@ -101,6 +113,7 @@ class Foreground {
     double scale;
     std::string asset_source;
     std::string key;
+    AssetProbe probe;
 
 
     cv::Mat data;
@@ -118,6 +131,11 @@ class Foreground {
         this->asset_source = asset_source; 
     }
     const std::string get_foreground_path() const;
+
+    const AssetProbe & get_probe() const { return probe; }
+    void set_probe(const AssetProbe & value) { this->probe = value; }
+    // Reads the image and writes its thumbnail to `thumbnailFile`, unless that is empty; safe on any thread
+    AssetProbe probe_source(const std::string& thumbnailFile) const;
     
     const cv::Mat get_first_frame() const;
 
@@ -182,7 +200,8 @@ class AssetsConfig {
 class AssetManager {
 private:
     const AppConfig& appConfig;
-    AssetsConfig assets;
+    std::shared_ptr<const AssetsConfig> assets; // Replaced whole on reload, always through std::atomic_load/atomic_store
+    AssetIndex assetIndex;
     cv::Scalar activeForegroundColor;
     std::string lastForegroundPath; // Changed from cv::Mat to std::string
     cv::Mat lastBlendedForeground;
@@ -190,9 +209,15 @@ private:
     
 public:
     AssetManager(const AppConfig& config);
-    void initializeAssets();
+    // Probes every asset not in the asset index on `scheduler`, asks for the
+    // keys that are missing and writes the assets config back if that changed it
+    void initializeAssets(TaskScheduler& scheduler);
+    // Reads the assets config again and probes what changed on `scheduler`,
+    // then swaps the new table in. Assets that cannot be used are left out.
+    // False, keeping the current table, if the config cannot be read.
+    bool reloadAssets(TaskScheduler& scheduler);
     
-    cv::Mat blend(const cv::Mat& background, const cv::Mat& foregroundAsset, int screenWidth, int screenHeight, double foregroundScalePercent, cv::Scalar foregroundColor);
+    cv::Mat blend(const cv::Mat& background, const cv::Mat& foregroundAsset, int screenWidth, int screenHeight, double foregroundScalePercent, cv::Scalar foregroundColor, int interpolation = cv::INTER_LINEAR);
     
     
 
@@ -207,7 +232,14 @@ public:
     
 private:
     char displayAndGetKey(const std::string& windowName, const cv::Mat asset);
-    void loadAssetsIntoMemory();
+    std::shared_ptr<const AssetsConfig> getAssets() const { return std::atomic_load(&assets); }
+    AssetsConfig readAssetsConfig() const;
+    void loadAssetsIntoMemory(TaskScheduler& scheduler);
+    // Sets every asset's source and probe, from the index where the file is
+    // unchanged; returns how many cannot be used, each printed with the reason
+    size_t probeAssets(AssetsConfig& table, TaskScheduler& scheduler);
+    // Through a temporary file, so an interrupted write never leaves the config half written
+    void saveAssetsConfig(const nlohmann::json& data) const;
 };
 
 // Conversion function declarations for all classes
@@ -0,0 +1,192 @@
+#include "AssetWatcher.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// How often files are compared when inotify is not available
+static const int ASSET_WATCH_POLL_INTERVAL_MS = 1000;
+
+// Quiet time after the last change before it is reported, long enough to
+// cover the gaps while a file is copied or an editor saves
+static const int ASSET_WATCH_SETTLE_MS = 500;
+
+// Longest the watcher sleeps before checking whether it was stopped
+static const int ASSET_WATCH_STOP_CHECK_MS = 100;
+
+AssetWatcher::AssetWatcher(const std::vector<std::string>& directories, const std::vector<std::string>& files,
+                           std::function<void()> onChange, std::function<void()> threadSetup) :
+    directories(directories),
+    files(files),
+    onChange(std::move(onChange)),
+    threadSetup(std::move(threadSetup)) {
+    if (!openInotify()) {
+        snapshot = takeSnapshot();
+    }
+    watchThread = std::thread(&AssetWatcher::watchLoop, this);
+}
+
+AssetWatcher::~AssetWatcher() {
+    stop();
+}
+
+void AssetWatcher::stop() {
+    running.store(false);
+    if (watchThread.joinable()) {
+        watchThread.join();
+    }
+    closeInotify();
+}
+
+void AssetWatcher::watchLoop() {
+    if (threadSetup) {
+        threadSetup();
+    }
+
+    while (running.load()) {
+        int interval = inotifyFd >= 0 ? ASSET_WATCH_STOP_CHECK_MS : ASSET_WATCH_POLL_INTERVAL_MS;
+        if (!waitForChange(interval)) {
+            continue;
+        }
+        while (running.load() && waitForChange(ASSET_WATCH_SETTLE_MS)) {
+        }
+        if (running.load()) {
+            onChange();
+        }
+    }
+}
+
+bool AssetWatcher::waitForChange(int milliseconds) {
+    if (inotifyFd >= 0) {
+        return readInotify(milliseconds);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    while (running.load() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ASSET_WATCH_STOP_CHECK_MS));
+    }
+    Snapshot current = takeSnapshot();
+    if (current == snapshot) {
+        return false;
+    }
+    snapshot = std::move(current);
+    return true;
+}
+
+AssetWatcher::Snapshot AssetWatcher::takeSnapshot() const {
+    Snapshot result;
+    for (const std::string& directory : directories) {
+        std::error_code error;
+        for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+            if (auto stamp = AssetFileStamp::of(it->path())) {
+                result[it->path().string()] = *stamp;
+            }
+        }
+    }
+    for (const std::string& file : files) {
+        if (auto stamp = AssetFileStamp::of(file)) {
+            result[file] = *stamp;
+        }
+    }
+    return result;
+}
+
+#ifdef __linux__
+
+// Entries created, written, moved or deleted; editors often save by renaming over the old file
+static const uint32_t ASSET_WATCH_EVENTS = IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+
+bool AssetWatcher::openInotify() {
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        std::cerr << "inotify is not available, polling for changes" << std::endl;
+        return false;
+    }
+    for (const std::string& directory : directories) {
+        int watch = inotify_add_watch(inotifyFd, directory.c_str(), ASSET_WATCH_EVENTS);
+        if (watch < 0) {
+            std::cerr << "Cannot watch " << directory << ", polling for changes" << std::endl;
+            closeInotify();
+            return false;
+        }
+        directoryWatches.insert(watch);
+    }
+    // Files are watched through their directory, so replacing one is seen too
+    for (const std::string& file : files) {
+        fs::path path(file);
+        std::string parent = path.has_parent_path() ? path.parent_path().string() : ".";
+        int watch = inotify_add_watch(inotifyFd, parent.c_str(), ASSET_WATCH_EVENTS);
+        if (watch < 0) {
+            std::cerr << "Cannot watch " << file << ", polling for changes" << std::endl;
+            closeInotify();
+            return false;
+        }
+        fileWatches[watch].insert(path.filename().string());
+    }
+    return true;
+}
+
+void AssetWatcher::closeInotify() {
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+    directoryWatches.clear();
+    fileWatches.clear();
+}
+
+bool AssetWatcher::readInotify(int milliseconds) {
+    alignas(inotify_event) char buffer[4096];
+    bool isChanged = false;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+    while (running.load() && !isChanged) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            break;
+        }
+        pollfd descriptor{inotifyFd, POLLIN, 0};
+        if (poll(&descriptor, 1, static_cast<int>(std::min<long long>(remaining, ASSET_WATCH_STOP_CHECK_MS))) <= 0) {
+            continue;
+        }
+
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+            for (char* at = buffer; at < buffer + length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(at);
+                at += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    isChanged = true;
+                } else if (directoryWatches.count(event->wd)) {
+                    isChanged = true;
+                } else if (event->len > 0) {
+                    auto it = fileWatches.find(event->wd);
+                    isChanged |= it != fileWatches.end() && it->second.count(event->name) > 0;
+                }
+            }
+        }
+    }
+    return isChanged;
+}
+
+#else
+
+bool AssetWatcher::openInotify() {
+    return false;
+}
+
+void AssetWatcher::closeInotify() {
+}
+
+bool AssetWatcher::readInotify(int) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AssetIndex.h"
+
+// Watches directories and single files for changes from a thread of its own,
+// and calls `onChange` on that thread once they have settled, so a clip still
+// being copied is only reported when the copy is done. Uses inotify on Linux
+// and compares file sizes and modification times every second elsewhere, or
+// when inotify cannot watch everything. Only files directly in the
+// directories are watched. The config file is watched the same way.
+class AssetWatcher {
+public:
+    // `threadSetup` runs first on the watcher thread, e.g. to apply its thread role
+    AssetWatcher(const std::vector<std::string>& directories, const std::vector<std::string>& files,
+                 std::function<void()> onChange, std::function<void()> threadSetup = nullptr);
+    ~AssetWatcher();
+
+    // Waits for a running `onChange` to return
+    void stop();
+
+    // Whether files are compared every second instead of watched through inotify
+    bool isPolling() const { return inotifyFd < 0; }
+
+private:
+    // Path of every watched file with its stamp
+    using Snapshot = std::map<std::string, AssetFileStamp>;
+
+    void watchLoop();
+    // Sleeps up to `milliseconds`; true if there was a change in that time.
+    // Returns early on a change or stop().
+    bool waitForChange(int milliseconds);
+    Snapshot takeSnapshot() const;
+
+    bool openInotify();
+    void closeInotify();
+    bool readInotify(int milliseconds);
+
+    std::vector<std::string> directories;
+    std::vector<std::string> files;
+    std::function<void()> onChange;
+    std::function<void()> threadSetup;
+
+    Snapshot snapshot; // Polling only: the files as last seen
+
+    int inotifyFd = -1;
+    std::set<int> directoryWatches; // Any entry in these directories counts
+    std::map<int, std::set<std::string>> fileWatches; // Only these names count
+
+    std::atomic<bool> running{true};
+    std::thread watchThread;
+};
@@ -0,0 +1,438 @@
+#include "AudioSource.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <numeric>
+#ifdef VISUALHIVE_HAS_SNDFILE
+#include <sndfile.h>
+#endif
+
+// Generator clicks: a burst of noise decaying over a few milliseconds
+static const double GENERATOR_CLICK_SECONDS = 0.02;
+static const double GENERATOR_CLICK_DECAY_SECONDS = 0.003;
+static const float GENERATOR_CLICK_LEVEL = 0.8f;
+
+// Resampler cutoff as a fraction of the lower Nyquist rate, leaving the filter room to roll off
+static const double RESAMPLER_CUTOFF = 0.9;
+
+// Independent partial sums for the resampler's dot products, so they vectorise
+static const size_t RESAMPLER_LANES = 8;
+
+static int64_t toNanoseconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+static std::string toLower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+size_t AudioSource::getBlockFrames(double blockDuration) const {
+    return std::clamp<size_t>(static_cast<size_t>(std::lround(blockDuration * sampleRate)), 1, MAX_AUDIO_BLOCK_FRAMES);
+}
+
+template <size_t Channels>
+static void downmixFixed(const float* interleaved, size_t frames, const float* gains, float* mono) {
+    for (size_t i = 0; i < frames; ++i) {
+        float sum = 0.0f;
+        for (size_t channel = 0; channel < Channels; ++channel) {
+            sum += interleaved[i * Channels + channel] * gains[channel];
+        }
+        mono[i] = sum;
+    }
+}
+
+void downmixChannels(const float* interleaved, size_t frames, size_t channels, const std::vector<int>& picked, float* mono) {
+    if (channels == 1) {
+        std::copy(interleaved, interleaved + frames, mono);
+        return;
+    }
+
+    // Channels left out weigh 0, the rest share the mix equally
+    float gains[8] = {};
+    std::vector<float> wideGains;
+    float* channelGains = gains;
+    if (channels > 8) {
+        wideGains.assign(channels, 0.0f);
+        channelGains = wideGains.data();
+    }
+    size_t count = 0;
+    for (size_t channel = 0; channel < channels; ++channel) {
+        if (picked.empty() || std::find(picked.begin(), picked.end(), static_cast<int>(channel)) != picked.end()) {
+            channelGains[channel] = 1.0f;
+            ++count;
+        }
+    }
+    for (size_t channel = 0; channel < channels; ++channel) {
+        channelGains[channel] /= std::max<size_t>(count, 1);
+    }
+
+    switch (channels) {
+    case 2: downmixFixed<2>(interleaved, frames, gains, mono); return;
+    case 4: downmixFixed<4>(interleaved, frames, gains, mono); return;
+    case 6: downmixFixed<6>(interleaved, frames, gains, mono); return;
+    case 8: downmixFixed<8>(interleaved, frames, gains, mono); return;
+    default: break;
+    }
+    for (size_t i = 0; i < frames; ++i) {
+        float sum = 0.0f;
+        for (size_t channel = 0; channel < channels; ++channel) {
+            sum += interleaved[i * channels + channel] * channelGains[channel];
+        }
+        mono[i] = sum;
+    }
+}
+
+AudioResampler::AudioResampler(uint32_t inputRate, uint32_t outputRate) {
+    uint32_t divisor = std::gcd(inputRate, outputRate);
+    up = outputRate / divisor;
+    down = inputRate / divisor;
+    history.assign(RESAMPLER_TAPS - 1, 0.0f);
+    historyStart = -static_cast<int64_t>(RESAMPLER_TAPS - 1);
+    if (isPassthrough()) {
+        return;
+    }
+
+    // The prototype runs at the upsampled rate, `up` times as long as one phase
+    const size_t length = static_cast<size_t>(up) * RESAMPLER_TAPS;
+    const double cutoff = 0.5 * RESAMPLER_CUTOFF / std::max(up, down); // Cycles per upsampled sample
+    const double centre = (length - 1) / 2.0;
+    phases.resize(length);
+    for (size_t j = 0; j < length; ++j) {
+        double x = j - centre;
+        double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+        double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * j / (length - 1)) + 0.08 * std::cos(4.0 * M_PI * j / (length - 1));
+        // Gain `up` makes up for the zeros upsampling puts between input samples
+        float tap = static_cast<float>(up * 2.0 * cutoff * sinc * window);
+        size_t phase = j % up;
+        size_t k = j / up; // Multiplies the input k samples before the newest
+        phases[phase * RESAMPLER_TAPS + (RESAMPLER_TAPS - 1 - k)] = tap;
+    }
+}
+
+void AudioResampler::process(const float* input, size_t frames, std::vector<float>& output) {
+    if (isPassthrough()) {
+        output.insert(output.end(), input, input + frames);
+        return;
+    }
+    history.insert(history.end(), input, input + frames);
+    const int64_t historyEnd = historyStart + static_cast<int64_t>(history.size());
+
+    while (true) {
+        uint64_t position = nextOutput * down;
+        int64_t newest = static_cast<int64_t>(position / up);
+        if (newest >= historyEnd) {
+            break;
+        }
+        const float* taps = phases.data() + (position % up) * RESAMPLER_TAPS;
+        const float* samples = history.data() + (newest - static_cast<int64_t>(RESAMPLER_TAPS - 1) - historyStart);
+        float lanes[RESAMPLER_LANES] = {};
+        for (size_t k = 0; k < RESAMPLER_TAPS; k += RESAMPLER_LANES) {
+            for (size_t lane = 0; lane < RESAMPLER_LANES; ++lane) {
+                lanes[lane] += taps[k + lane] * samples[k + lane];
+            }
+        }
+        output.push_back(std::accumulate(lanes, lanes + RESAMPLER_LANES, 0.0f));
+        ++nextOutput;
+    }
+
+    // Keep what the next output still needs
+    int64_t keepFrom = static_cast<int64_t>(nextOutput * down / up) - static_cast<int64_t>(RESAMPLER_TAPS - 1);
+    if (keepFrom > historyStart) {
+        history.erase(history.begin(), history.begin() + (keepFrom - historyStart));
+        historyStart = keepFrom;
+    }
+}
+
+double AudioResampler::getInputPosition(uint64_t index) const {
+    if (isPassthrough()) {
+        return static_cast<double>(index);
+    }
+    // Less the filter's delay, half its length
+    return (static_cast<double>(index) * down - (up * RESAMPLER_TAPS - 1) / 2.0) / up;
+}
+
+PortAudioSource::PortAudioSource(const std::string& device, double sampleRate, const std::vector<int>& channels) :
+    device(device),
+    requestedRate(sampleRate),
+    picked(channels) {}
+
+PortAudioSource::~PortAudioSource() {
+    stop();
+}
+
+bool PortAudioSource::start(double sampleRate, double blockDuration, AudioRing& ring) {
+    PaError err = Pa_Initialize();
+    if (err != paNoError) {
+        std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
+        return false;
+    }
+    isInitialized = true;
+
+    std::vector<PaDeviceIndex> inputDevices;
+    for (PaDeviceIndex i = 0; i < Pa_GetDeviceCount(); ++i) {
+        if (Pa_GetDeviceInfo(i)->maxInputChannels > 0) {
+            inputDevices.push_back(i);
+        }
+    }
+
+    PaDeviceIndex selected = paNoDevice;
+    if (device.empty()) {
+        selected = Pa_GetDefaultInputDevice();
+    } else if (std::all_of(device.begin(), device.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; })) {
+        size_t number = std::stoul(device);
+        if (number < inputDevices.size()) {
+            selected = inputDevices[number];
+        }
+    } else {
+        for (PaDeviceIndex index : inputDevices) {
+            if (toLower(Pa_GetDeviceInfo(index)->name).find(toLower(device)) != std::string::npos) {
+                selected = index;
+                break;
+            }
+        }
+    }
+
+    if (selected == paNoDevice) {
+        std::cerr << "No audio input device matches \"" << device << "\". Set \"audio\": { \"device\": ... } to a number or part of a name:" << std::endl;
+        for (size_t number = 0; number < inputDevices.size(); ++number) {
+            std::cerr << "  [" << number << "] " << Pa_GetDeviceInfo(inputDevices[number])->name
+                      << (inputDevices[number] == Pa_GetDefaultInputDevice() ? " (Default)" : "") << std::endl;
+        }
+        return false;
+    }
+    const PaDeviceInfo* info = Pa_GetDeviceInfo(selected);
+    deviceName = info->name;
+
+    // All of the device's channels when mixing them all, otherwise up to the last one picked
+    channelCount = static_cast<size_t>(info->maxInputChannels);
+    if (!picked.empty()) {
+        int last = *std::max_element(picked.begin(), picked.end());
+        if (last >= info->maxInputChannels || *std::min_element(picked.begin(), picked.end()) < 0) {
+            std::cerr << deviceName << " has " << info->maxInputChannels << " input channels, channel " << last + 1 << " was asked for." << std::endl;
+            return false;
+        }
+        channelCount = static_cast<size_t>(last + 1);
+    }
+
+    PaStreamParameters inputParameters;
+    inputParameters.device = selected;
+    inputParameters.channelCount = static_cast<int>(channelCount);
+    inputParameters.sampleFormat = paFloat32;
+    inputParameters.suggestedLatency = info->defaultLowInputLatency;
+    inputParameters.hostApiSpecificStreamInfo = NULL;
+
+    // The device's own rate unless one is asked for, so the OS doesn't resample
+    this->sampleRate = requestedRate > 0.0 ? requestedRate : info->defaultSampleRate;
+    this->ring = &ring;
+    err = Pa_OpenStream(&stream, &inputParameters, NULL, this->sampleRate, getBlockFrames(blockDuration), paClipOff, &PortAudioSource::callback, this);
+    if (err == paNoError) {
+        err = Pa_StartStream(stream);
+    }
+    if (err != paNoError) {
+        std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
+        stop();
+        return false;
+    }
+
+    const PaStreamInfo* streamInfo = Pa_GetStreamInfo(stream);
+    inputLatency = streamInfo ? streamInfo->inputLatency : 0.0;
+    return true;
+}
+
+void PortAudioSource::stop() {
+    if (stream) {
+        Pa_StopStream(stream);
+        Pa_CloseStream(stream);
+        stream = nullptr;
+    }
+    if (isInitialized) {
+        Pa_Terminate();
+        isInitialized = false;
+    }
+}
+
+std::string PortAudioSource::getDescription() const {
+    return "input device " + deviceName + " (" + std::to_string(channelCount) + " channels at " + std::to_string(static_cast<int>(sampleRate)) + " Hz)";
+}
+
+int PortAudioSource::callback(const void* inputBuffer, void* outputBuffer, unsigned long framesPerBuffer,
+                              const PaStreamCallbackTimeInfo* timeInfo, PaStreamCallbackFlags statusFlags, void* userData) {
+    PortAudioSource* source = static_cast<PortAudioSource*>(userData);
+    const float* input = static_cast<const float*>(inputBuffer);
+
+    // The first sample was captured this long ago; fall back to one buffer if the host gives no times
+    double inputLatency = timeInfo ? timeInfo->currentTime - timeInfo->inputBufferAdcTime : 0.0;
+    if (inputLatency <= 0.0 || inputLatency > 1.0) {
+        inputLatency = static_cast<double>(framesPerBuffer) / source->sampleRate;
+    }
+
+    AudioBlock block;
+    block.captureNs = toNanoseconds(std::chrono::steady_clock::now()) - static_cast<int64_t>(inputLatency * 1e9);
+    block.frames = static_cast<uint32_t>(std::min<unsigned long>(framesPerBuffer, MAX_AUDIO_BLOCK_FRAMES));
+    if (input) {
+        downmixChannels(input, block.frames, source->channelCount, source->picked, block.samples.data());
+    } else {
+        std::fill(block.samples.begin(), block.samples.begin() + block.frames, 0.0f);
+    }
+    source->deliver(*source->ring, std::move(block));
+    return paContinue;
+}
+
+PacedAudioSource::~PacedAudioSource() {
+    stop();
+}
+
+bool PacedAudioSource::start(double sampleRate, double blockDuration, AudioRing& ring) {
+    if (!open(sampleRate)) {
+        return false;
+    }
+    size_t blockFrames = getBlockFrames(blockDuration);
+    running.store(true);
+    thread = std::thread([this, blockFrames, &ring]() { run(blockFrames, ring); });
+    return true;
+}
+
+void PacedAudioSource::stop() {
+    running.store(false);
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void PacedAudioSource::run(size_t blockFrames, AudioRing& ring) {
+    auto startTime = std::chrono::steady_clock::now();
+    int64_t startNs = toNanoseconds(startTime);
+    uint64_t position = 0;
+
+    while (running.load()) {
+        AudioBlock block;
+        block.captureNs = startNs + static_cast<int64_t>(position * 1e9 / sampleRate);
+        block.frames = static_cast<uint32_t>(blockFrames);
+        if (!render(block.samples.data(), blockFrames)) {
+            std::cout << std::endl << getDescription() << " finished." << std::endl;
+            break;
+        }
+        position += blockFrames;
+
+        // Handed over once its last sample would have been captured
+        std::this_thread::sleep_until(startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(position / sampleRate / speed)));
+        deliver(ring, std::move(block));
+    }
+}
+
+FileAudioSource::FileAudioSource(const std::string& path, double speed, bool loop, const std::vector<int>& channels) :
+    PacedAudioSource(speed),
+    path(path),
+    loop(loop),
+    picked(channels) {}
+
+FileAudioSource::~FileAudioSource() {
+    // The thread reads the file until it is stopped
+    stop();
+#ifdef VISUALHIVE_HAS_SNDFILE
+    if (file) {
+        sf_close(static_cast<SNDFILE*>(file));
+    }
+#endif
+}
+
+std::string FileAudioSource::getDescription() const {
+    return "file " + path;
+}
+
+#ifdef VISUALHIVE_HAS_SNDFILE
+bool FileAudioSource::open(double sampleRate) {
+    SF_INFO info{};
+    file = sf_open(path.c_str(), SFM_READ, &info);
+    if (!file) {
+        std::cerr << "Could not open " << path << ": " << sf_strerror(nullptr) << std::endl;
+        return false;
+    }
+    for (int channel : picked) {
+        if (channel < 0 || channel >= info.channels) {
+            std::cerr << path << " has " << info.channels << " channels, channel " << channel + 1 << " was asked for." << std::endl;
+            sf_close(static_cast<SNDFILE*>(file));
+            file = nullptr;
+            return false;
+        }
+    }
+    this->sampleRate = info.samplerate;
+    channels = info.channels;
+    return true;
+}
+
+bool FileAudioSource::render(float* samples, size_t frames) {
+    SNDFILE* sndfile = static_cast<SNDFILE*>(file);
+    interleaved.resize(frames * channels);
+    sf_count_t framesRead = sf_readf_float(sndfile, interleaved.data(), frames);
+    if (framesRead < static_cast<sf_count_t>(frames) && loop) {
+        sf_seek(sndfile, 0, SEEK_SET);
+        framesRead += sf_readf_float(sndfile, interleaved.data() + framesRead * channels, frames - framesRead);
+    }
+    if (framesRead <= 0) {
+        return false;
+    }
+
+    // A short last block is padded with silence
+    std::fill(interleaved.begin() + framesRead * channels, interleaved.end(), 0.0f);
+    downmixChannels(interleaved.data(), frames, channels, picked, samples);
+    return true;
+}
+#else
+bool FileAudioSource::open(double sampleRate) {
+    std::cerr << "Built without libsndfile, audio files can't be played." << std::endl;
+    return false;
+}
+
+bool FileAudioSource::render(float* samples, size_t frames) {
+    return false;
+}
+#endif
+
+std::string GeneratorAudioSource::getDescription() const {
+    return "click generator at " + std::to_string(static_cast<int>(std::round(bpm))) + " BPM";
+}
+
+bool GeneratorAudioSource::open(double sampleRate) {
+    if (bpm <= 0.0) {
+        std::cerr << "The audio generator needs a tempo above 0." << std::endl;
+        return false;
+    }
+    this->sampleRate = sampleRate;
+    periodSamples = static_cast<uint64_t>(std::llround(sampleRate * 60.0 / bpm));
+    return true;
+}
+
+bool GeneratorAudioSource::render(float* samples, size_t frames) {
+    const uint64_t clickLength = static_cast<uint64_t>(GENERATOR_CLICK_SECONDS * sampleRate);
+    for (size_t i = 0; i < frames; ++i) {
+        uint64_t position = (sample + i) % periodSamples;
+        float value = 0.0f;
+        if (position < clickLength) {
+            noise = noise * 1664525u + 1013904223u;
+            float white = static_cast<float>(noise >> 8) / 8388608.0f - 1.0f;
+            value = GENERATOR_CLICK_LEVEL * white * static_cast<float>(std::exp(-static_cast<double>(position) / (GENERATOR_CLICK_DECAY_SECONDS * sampleRate)));
+        }
+        samples[i] = value;
+    }
+    sample += frames;
+    return true;
+}
+
+std::unique_ptr<AudioSource> createAudioSource(const AppConfig& config) {
+    if (config.audioSource == "device") {
+        return std::make_unique<PortAudioSource>(config.audioDevice, config.audioSampleRate, config.audioChannels);
+    }
+    if (config.audioSource == "file") {
+        return std::make_unique<FileAudioSource>(config.audioFile, config.audioSpeed, config.audioLoop, config.audioChannels);
+    }
+    if (config.audioSource == "generator") {
+        return std::make_unique<GeneratorAudioSource>(config.generatorBpm, config.audioSpeed);
+    }
+    std::cerr << "Unknown audio source " << config.audioSource << std::endl;
+    return nullptr;
+}
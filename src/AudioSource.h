@@ -0,0 +1,205 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <portaudio.h>
+#include "ConfigManager.h"
+#include "SpscQueue.h"
+
+// Most samples an audio source hands over at once: the longest detection hop
+// at 96 kHz, with room to spare
+const size_t MAX_AUDIO_BLOCK_FRAMES = 2048;
+
+// Blocks the ring holds before a source has to drop them
+const size_t AUDIO_RING_BLOCKS = 64;
+
+// Input samples behind each resampled output
+const size_t RESAMPLER_TAPS = 32;
+
+// One block of mono samples. Fixed size, so sources never allocate to deliver one.
+struct AudioBlock {
+    int64_t captureNs; // steady_clock time the first sample was captured
+    uint32_t frames;
+    std::array<float, MAX_AUDIO_BLOCK_FRAMES> samples;
+};
+
+// Blocks from the source's thread to the detection loop, lock-free
+using AudioRing = SpscQueue<AudioBlock>;
+
+// Where the detection loop's audio comes from. A source delivers mono blocks
+// at its own rate into the ring from a thread of its own, and drops blocks
+// rather than wait when the ring is full. The detection loop resamples them.
+class AudioSource {
+public:
+    virtual ~AudioSource() = default;
+
+    // Starts delivering blocks of about `blockDuration` seconds, at `sampleRate`
+    // if the source has no rate of its own. False if the source could not
+    // start; the reason has been printed.
+    virtual bool start(double sampleRate, double blockDuration, AudioRing& ring) = 0;
+    virtual void stop() = 0;
+
+    // Rate of the delivered blocks, once started
+    double getSampleRate() const { return sampleRate; }
+
+    // For the startup log
+    virtual std::string getDescription() const = 0;
+    // Seconds from sound to a block in the ring that the source itself adds, 0 if unknown
+    virtual double getInputLatency() const { return 0.0; }
+
+    uint64_t getDroppedBlocks() const { return droppedBlocks.load(std::memory_order_relaxed); }
+
+protected:
+    // Frames in a block of `blockDuration` at the source's rate
+    size_t getBlockFrames(double blockDuration) const;
+
+    void deliver(AudioRing& ring, AudioBlock&& block) {
+        if (!ring.tryPush(std::move(block))) {
+            droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    double sampleRate = 0.0;
+
+private:
+    std::atomic<uint64_t> droppedBlocks{0};
+};
+
+// Channels of the source mixed into the mono analysis signal, 0-based; all of
+// them if empty. Loops are compiled for 2, 4, 6 and 8 channels, so they
+// vectorise; other counts take a generic loop.
+void downmixChannels(const float* interleaved, size_t frames, size_t channels, const std::vector<int>& picked, float* mono);
+
+// Rational resampler: the input is upsampled by `up`, low-pass filtered and
+// downsampled by `down`, computing only the outputs that are kept. Each output
+// is a RESAMPLER_TAPS-long dot product with one of `up` filter phases. The
+// filter is a Blackman-windowed sinc cut off just below the lower Nyquist rate.
+class AudioResampler {
+public:
+    // Whole-number rates
+    AudioResampler(uint32_t inputRate, uint32_t outputRate);
+
+    bool isPassthrough() const { return up == down; }
+    uint32_t getUp() const { return up; }
+    uint32_t getDown() const { return down; }
+
+    // Appends the output for the next `frames` input samples to `output`
+    void process(const float* input, size_t frames, std::vector<float>& output);
+    // Where output sample `index` falls in the input, in input samples since the first
+    double getInputPosition(uint64_t index) const;
+
+private:
+    uint32_t up;
+    uint32_t down;
+    std::vector<float> phases; // `up` phases of RESAMPLER_TAPS taps each, reversed to run forwards over the input
+    std::vector<float> history; // Input from historyStart on
+    int64_t historyStart; // Input index of history[0]; starts negative, as if silence came first
+    uint64_t nextOutput = 0;
+};
+
+// An input device through PortAudio, found by its number in the list of input
+// devices or by part of its name, case-insensitive. An empty choice opens the
+// default input. Never asks; the list is printed when the choice matches nothing.
+class PortAudioSource : public AudioSource {
+public:
+    // `sampleRate` 0 opens the device at its own rate; `channels` as for downmixChannels()
+    PortAudioSource(const std::string& device, double sampleRate, const std::vector<int>& channels);
+    ~PortAudioSource() override;
+
+    bool start(double sampleRate, double blockDuration, AudioRing& ring) override;
+    void stop() override;
+    std::string getDescription() const override;
+    double getInputLatency() const override { return inputLatency; }
+
+private:
+    static int callback(const void* inputBuffer, void* outputBuffer, unsigned long framesPerBuffer,
+                        const PaStreamCallbackTimeInfo* timeInfo, PaStreamCallbackFlags statusFlags, void* userData);
+
+    std::string device;
+    double requestedRate;
+    std::vector<int> picked;
+    std::string deviceName;
+    size_t channelCount = 0;
+    PaStream* stream = nullptr;
+    bool isInitialized = false;
+    double inputLatency = 0.0;
+    AudioRing* ring = nullptr;
+};
+
+// Renders blocks on a thread of its own and hands them over at `speed` times
+// the rate they would be captured live. Blocks are stamped on the audio's own
+// clock from the moment the source started, so above a speed of 1 beat times
+// run ahead of the wall clock; the tempo estimate is unaffected.
+class PacedAudioSource : public AudioSource {
+public:
+    explicit PacedAudioSource(double speed) : speed(speed) {}
+    ~PacedAudioSource() override;
+
+    bool start(double sampleRate, double blockDuration, AudioRing& ring) override;
+    void stop() override;
+
+protected:
+    // Called by start() before the thread begins; sets the source's rate, from
+    // `sampleRate` if it has none of its own. False if there is nothing to play.
+    virtual bool open(double sampleRate) = 0;
+    // On the source's thread. Fills `frames` samples; false once there is nothing more to play.
+    virtual bool render(float* samples, size_t frames) = 0;
+
+    double speed;
+
+private:
+    void run(size_t blockFrames, AudioRing& ring);
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+};
+
+// A WAV, FLAC, AIFF or Ogg file at its own rate, mixed down to mono, from the
+// start again at the end if `loop`. Needs libsndfile at build time.
+class FileAudioSource : public PacedAudioSource {
+public:
+    // `channels` as for downmixChannels()
+    FileAudioSource(const std::string& path, double speed, bool loop, const std::vector<int>& channels);
+    ~FileAudioSource() override;
+
+    std::string getDescription() const override;
+
+protected:
+    bool open(double sampleRate) override;
+    bool render(float* samples, size_t frames) override;
+
+private:
+    std::string path;
+    bool loop;
+    std::vector<int> picked;
+    void* file = nullptr; // SNDFILE
+    int channels = 0;
+    std::vector<float> interleaved;
+};
+
+// Clicks at a steady tempo, for running the whole tempo path without any audio
+class GeneratorAudioSource : public PacedAudioSource {
+public:
+    GeneratorAudioSource(double bpm, double speed) : PacedAudioSource(speed), bpm(bpm) {}
+    ~GeneratorAudioSource() override { stop(); }
+
+    std::string getDescription() const override;
+
+protected:
+    bool open(double sampleRate) override;
+    bool render(float* samples, size_t frames) override;
+
+private:
+    double bpm;
+    uint64_t periodSamples = 0;
+    uint64_t sample = 0;
+    uint32_t noise = 1;
+};
+
+// The source "audio": { "source": ... } asks for, nullptr for an unknown one
+std::unique_ptr<AudioSource> createAudioSource(const AppConfig& config);
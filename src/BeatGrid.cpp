@@ -0,0 +1,166 @@
+#include "BeatGrid.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+
+const char BEAT_GRID_MAGIC[4] = { 'V', 'H', 'B', 'G' };
+const uint32_t BEAT_GRID_VERSION = 1;
+const char* BEAT_GRID_EXTENSION = ".vhbg";
+
+// Beat spacing when a grid has fewer than two beats and no tempo
+static const double DEFAULT_BEAT_INTERVAL_SEC = 0.5;
+
+bool BeatGrid::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Could not open beat grid for writing: " << path << std::endl;
+        return false;
+    }
+
+    BeatGridHeader header = { durationSec, bpm, static_cast<uint32_t>(tempoCurve.size()), static_cast<uint32_t>(beats.size()) };
+    file.write(BEAT_GRID_MAGIC, sizeof(BEAT_GRID_MAGIC));
+    file.write(reinterpret_cast<const char*>(&BEAT_GRID_VERSION), sizeof(BEAT_GRID_VERSION));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(tempoCurve.data()), tempoCurve.size() * sizeof(TempoPoint));
+    file.write(reinterpret_cast<const char*>(beats.data()), beats.size() * sizeof(double));
+    return static_cast<bool>(file);
+}
+
+bool BeatGrid::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open beat grid: " << path << std::endl;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    BeatGridHeader header{};
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(magic, BEAT_GRID_MAGIC, sizeof(magic)) != 0 || version != BEAT_GRID_VERSION) {
+        std::cerr << "Not a VisualHive beat grid (or an unsupported version): " << path << std::endl;
+        return false;
+    }
+
+    // The counts are checked against the file before allocating, a corrupt
+    // header could ask for gigabytes. Beats must increase, their spacing is divided by.
+    std::streamoff dataStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    uint64_t bytesLeft = static_cast<uint64_t>(file.tellg() - dataStart);
+    file.seekg(dataStart);
+    uint64_t bytesNeeded = sizeof(TempoPoint) * static_cast<uint64_t>(header.tempoPointCount)
+                         + sizeof(double) * static_cast<uint64_t>(header.beatCount);
+    if (bytesNeeded <= bytesLeft) {
+        tempoCurve.resize(header.tempoPointCount);
+        beats.resize(header.beatCount);
+        file.read(reinterpret_cast<char*>(tempoCurve.data()), tempoCurve.size() * sizeof(TempoPoint));
+        file.read(reinterpret_cast<char*>(beats.data()), beats.size() * sizeof(double));
+    }
+    bool isIncreasing = std::adjacent_find(beats.begin(), beats.end(), [](double a, double b) { return !(b > a); }) == beats.end();
+    if (!file || bytesNeeded > bytesLeft || !isIncreasing) {
+        tempoCurve.clear();
+        beats.clear();
+        std::cerr << "Truncated beat grid: " << path << std::endl;
+        return false;
+    }
+
+    name = std::filesystem::path(path).stem().string();
+    durationSec = header.durationSec;
+    bpm = header.bpm;
+    return true;
+}
+
+double BeatGrid::getBeatAt(double timeSec) const {
+    if (beats.empty()) {
+        return bpm > 0.0 ? timeSec * bpm / 60.0 : 0.0;
+    }
+
+    auto spacing = [this](size_t i) {
+        if (beats.size() >= 2) {
+            return beats[i + 1] - beats[i];
+        }
+        return bpm > 0.0 ? 60.0 / bpm : DEFAULT_BEAT_INTERVAL_SEC;
+    };
+
+    size_t next = std::upper_bound(beats.begin(), beats.end(), timeSec) - beats.begin();
+    if (next == 0) {
+        return (timeSec - beats.front()) / spacing(0);
+    }
+    if (next == beats.size()) {
+        double lastSpacing = spacing(beats.size() >= 2 ? beats.size() - 2 : 0);
+        return static_cast<double>(beats.size() - 1) + (timeSec - beats.back()) / lastSpacing;
+    }
+    return static_cast<double>(next - 1) + (timeSec - beats[next - 1]) / (beats[next] - beats[next - 1]);
+}
+
+double BeatGrid::getBpmAt(double timeSec) const {
+    if (beats.size() < 2) {
+        return bpm;
+    }
+    size_t next = std::upper_bound(beats.begin(), beats.end(), timeSec) - beats.begin();
+    next = std::clamp<size_t>(next, 1, beats.size() - 1);
+    return 60.0 / (beats[next] - beats[next - 1]);
+}
+
+uint32_t getTrackId(std::string_view name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+BeatGridLibrary::BeatGridLibrary(const std::string& directory) {
+    std::error_code error;
+    if (!std::filesystem::is_directory(directory, error)) {
+        return;
+    }
+
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.path().extension() != BEAT_GRID_EXTENSION) {
+            continue;
+        }
+        BeatGrid grid;
+        if (grid.load(entry.path().string())) {
+            uint32_t trackId = getTrackId(grid.name);
+            grids[trackId] = std::move(grid);
+        }
+    }
+    std::cout << "Loaded " << grids.size() << " beat grids from " << directory << std::endl;
+}
+
+const BeatGrid* BeatGridLibrary::find(uint32_t trackId) const {
+    auto it = grids.find(trackId);
+    return it != grids.end() ? &it->second : nullptr;
+}
+
+void BeatGridSource::capture(std::chrono::steady_clock::time_point now) {
+    position = getPosition(now);
+}
+
+bool BeatGridSource::isActive() const {
+    return grid && position >= 0.0 && position < grid->durationSec;
+}
+
+double BeatGridSource::getBpm() const {
+    return grid ? grid->getBpmAt(position) : 0.0;
+}
+
+double BeatGridSource::getBeat(std::chrono::steady_clock::time_point now) const {
+    return grid ? grid->getBeatAt(getPosition(now)) : 0.0;
+}
+
+void BeatGridSource::play(const BeatGrid* grid, std::chrono::steady_clock::time_point time, double positionSec) {
+    this->grid = grid;
+    trackStart = time - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(positionSec));
+    position = positionSec;
+}
+
+double BeatGridSource::getPosition(std::chrono::steady_clock::time_point now) const {
+    return std::chrono::duration<double>(now - trackStart).count();
+}
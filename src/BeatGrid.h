@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BeatSource.h"
+
+// One point of a track's tempo curve
+struct TempoPoint {
+    float timeSec;
+    float bpm;
+};
+
+// Fixed part of a beat grid file, after the magic and version. The tempo
+// points and then the beat times (double seconds) follow it.
+struct BeatGridHeader {
+    double durationSec;
+    double bpm;
+    uint32_t tempoPointCount;
+    uint32_t beatCount;
+};
+static_assert(sizeof(BeatGridHeader) == 24, "BeatGridHeader layout is part of the file format");
+
+extern const char BEAT_GRID_MAGIC[4];
+extern const uint32_t BEAT_GRID_VERSION;
+extern const char* BEAT_GRID_EXTENSION;
+
+// Tempo curve and beat times of one track, written by visualhive-analyze and
+// preloaded by the live engine so a known track is beat-locked from its first bar
+struct BeatGrid {
+    std::string name; // File name without the extension, what /vh/track refers to
+    double durationSec = 0.0;
+    double bpm = 0.0; // The rounded tempo the track spends most time at
+    std::vector<TempoPoint> tempoCurve;
+    std::vector<double> beats; // Seconds from the start of the track
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+    // Beat position `timeSec` into the track, fractional between beats and
+    // extrapolated before the first and after the last one
+    double getBeatAt(double timeSec) const;
+    // Tempo from the spacing of the beats around `timeSec`
+    double getBpmAt(double timeSec) const;
+};
+
+// Id of a track name as carried by events, FNV-1a of the name
+uint32_t getTrackId(std::string_view name);
+
+// Every beat grid in a directory, loaded once at startup
+class BeatGridLibrary {
+public:
+    // A missing directory gives an empty library
+    explicit BeatGridLibrary(const std::string& directory);
+
+    const BeatGrid* find(uint32_t trackId) const;
+    size_t size() const { return grids.size(); }
+
+private:
+    std::map<uint32_t, BeatGrid> grids;
+};
+
+// Tempo and beat from the grid of the track that is playing, as announced
+// over OSC. Active from the moment the track starts until it ends.
+class BeatGridSource : public BeatSource {
+public:
+    std::string getName() const override { return "track"; }
+    void capture(std::chrono::steady_clock::time_point now) override;
+    bool isActive() const override;
+    double getBpm() const override;
+    double getBeat(std::chrono::steady_clock::time_point now) const override;
+
+    // Frame loop only. `grid` was at `positionSec` into the track at `time`; nullptr stops.
+    void play(const BeatGrid* grid, std::chrono::steady_clock::time_point time, double positionSec);
+    const BeatGrid* getGrid() const { return grid; }
+
+private:
+    double getPosition(std::chrono::steady_clock::time_point now) const;
+
+    const BeatGrid* grid = nullptr;
+    std::chrono::steady_clock::time_point trackStart;
+    double position = 0.0; // Captured for this frame
+};
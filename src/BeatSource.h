@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <string>
+
+// Where the frame loop takes its tempo and beat position from: the audio
+// estimator, an external clock, ... The frame loop asks once per frame and
+// uses the first active source in order of preference.
+class BeatSource {
+public:
+    virtual ~BeatSource() = default;
+
+    virtual std::string getName() const = 0;
+
+    // Called by the frame loop once per frame before any other query, for
+    // sources that read a snapshot of shared state
+    virtual void capture(std::chrono::steady_clock::time_point /*now*/) {}
+
+    // False while the source has nothing to offer, e.g. the clock is stopped
+    virtual bool isActive() const = 0;
+
+    virtual double getBpm() const = 0;
+
+    // Beat position at `now`, counted from the source's own start or sync point
+    virtual double getBeat(std::chrono::steady_clock::time_point now) const = 0;
+
+    // A beat that starts a phrase, and so a bar, for quantising to bars and
+    // phrases. Sources that know nothing of the music's bars count them from beat zero.
+    virtual double getPhraseStart() const { return 0.0; }
+
+    // Beats since the latest start of a phrase `phraseBeats` long, in [0, phraseBeats)
+    double getPhraseBeat(double beat, double phraseBeats) const {
+        double position = std::fmod(beat - getPhraseStart(), phraseBeats);
+        return position < 0.0 ? position + phraseBeats : position;
+    }
+
+    // When the next whole beat falls, so things can be started on it rather than on the frame after
+    virtual std::chrono::steady_clock::time_point getNextBeatTime(std::chrono::steady_clock::time_point now) const {
+        double bpm = getBpm();
+        if (bpm <= 0.0) {
+            return now;
+        }
+        double beat = getBeat(now);
+        double secondsToBeat = (std::ceil(beat) - beat) * 60.0 / bpm;
+        return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(secondsToBeat));
+    }
+};
@@ -0,0 +1,1048 @@
+#include "Benchmarks.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <condition_variable>
+#include <random>
+#include <cmath>
+#include <ctime>
+#include <limits>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+#include "TaskScheduler.h"
+#include "Compositor.h"
+#include "EventQueue.h"
+#include "MidiInput.h"
+#include "OscServer.h"
+#include "AbletonLinkManager.h"
+#include "BpmDetector.h"
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Frames composited per measurement, after a short warm-up
+static const int BENCHMARK_WARMUP_FRAMES = 10;
+static const int BENCHMARK_FRAMES = 100;
+
+// Length of each event storm and how often the consumer drains, like a frame loop would
+static const std::chrono::milliseconds STORM_DURATION(500);
+static const std::chrono::milliseconds DRAIN_INTERVAL(1);
+
+// Beats of synthetic MIDI clock per tempo
+static const int CLOCK_BENCHMARK_BEATS = 256;
+
+// Messages parsed in place, and messages sent through the localhost socket
+static const int OSC_PARSE_MESSAGES = 1000000;
+static const int OSC_SEND_MESSAGES = 200000;
+static const int OSC_BUNDLE_SIZE = 8;
+
+// How long the Link peers get to find each other, and how many phase samples are compared
+static const std::chrono::seconds LINK_DISCOVERY_TIMEOUT(10);
+static const int LINK_PHASE_SAMPLES = 200;
+
+// Length of each synthetic track, and when the tempo estimate counts as locked:
+// within the tolerance of the true tempo and staying there for the hold time
+static const double TEMPO_BENCHMARK_SECONDS = 60.0;
+static const double TEMPO_LOCK_TOLERANCE_BPM = 1.0;
+static const double TEMPO_LOCK_HOLD_SECONDS = 5.0;
+
+// Length of each synthetic arrangement for the meter benchmark, and where in
+// the bar it starts, so the first beat heard is not a downbeat
+static const double METER_BENCHMARK_SECONDS = 150.0;
+static const int METER_BENCHMARK_FIRST_BEAT = 2;
+
+// Audio pushed through each downmix and resample case
+static const double RESAMPLE_BENCHMARK_SECONDS = 60.0;
+
+int runBenchmark(const std::string& name) {
+    if (name == "compositor") {
+        return runCompositorBenchmark();
+    }
+    if (name == "events") {
+        return runEventQueueBenchmark();
+    }
+    if (name == "midi-clock") {
+        return runMidiClockBenchmark();
+    }
+    if (name == "osc") {
+        return runOscBenchmark();
+    }
+    if (name == "link") {
+        return runLinkBenchmark();
+    }
+    if (name == "tempo") {
+        return runTempoBenchmark();
+    }
+    if (name == "resample") {
+        return runResampleBenchmark();
+    }
+    if (name == "meter") {
+        return runMeterBenchmark();
+    }
+
+    std::cerr << "Unknown benchmark: " << name << "\n";
+    std::cerr << "Available benchmarks: compositor, events, midi-clock, osc, link, tempo, resample, meter\n";
+    return 1;
+}
+
+int runCompositorBenchmark() {
+    // A 1080p clip and a large logo with alpha, like a typical bounced foreground
+    cv::Mat background(1080, 1920, CV_8UC3);
+    cv::randu(background, cv::Scalar(0, 0, 0), cv::Scalar(255, 255, 255));
+    cv::Mat foreground(1000, 1000, CV_8UC4);
+    cv::randu(foreground, cv::Scalar(0, 0, 0, 0), cv::Scalar(255, 255, 255, 255));
+
+    const std::vector<cv::Size> resolutions = { cv::Size(1920, 1080), cv::Size(3840, 2160) };
+    const size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "Compositor benchmark (" << BENCHMARK_FRAMES << " frames per run)\n";
+    std::cout << std::left << std::setw(12) << "Resolution" << std::setw(10) << "Threads"
+              << std::setw(14) << "ms/frame" << std::setw(10) << "Speedup" << "\n";
+    std::cout << std::string(46, '-') << "\n";
+
+    for (const cv::Size& size : resolutions) {
+        double singleThreadMs = 0.0;
+        for (size_t threads = 1; threads <= maxThreads; ++threads) {
+            TaskScheduler scheduler(threads - 1); // The caller is the last thread, a single thread runs inline
+            Compositor compositor(scheduler);
+            cv::Mat output;
+
+            for (int i = 0; i < BENCHMARK_WARMUP_FRAMES; ++i) {
+                compositor.composite(background, foreground, size, 60.0, cv::Scalar(255, 255, 255), cv::INTER_LINEAR, output);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < BENCHMARK_FRAMES; ++i) {
+                // Vary the scale like the bounce effect does, so nothing is cached between frames
+                double scale = 60.0 + (i % 10);
+                compositor.composite(background, foreground, size, scale, cv::Scalar(255, 255, 255), cv::INTER_LINEAR, output);
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / BENCHMARK_FRAMES;
+            if (threads == 1) {
+                singleThreadMs = ms;
+            }
+
+            std::cout << std::left << std::setw(12) << (std::to_string(size.width) + "x" + std::to_string(size.height))
+                      << std::setw(10) << threads
+                      << std::setw(14) << std::fixed << std::setprecision(2) << ms
+                      << std::setprecision(2) << singleThreadMs / ms << "x\n";
+        }
+    }
+
+    return 0;
+}
+
+// The queue the frame loop used before: a mutex, a std::queue and a notify on every push
+class MutexEventQueue {
+public:
+    bool push(const Event& event) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push(event);
+        _cond.notify_one();
+        return true;
+    }
+
+    size_t drain(Event* events, size_t maxEvents) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        size_t count = 0;
+        while (count < maxEvents && !_queue.empty()) {
+            events[count++] = _queue.front();
+            _queue.pop();
+        }
+        return count;
+    }
+
+private:
+    std::queue<Event> _queue;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+};
+
+struct StormResult {
+    size_t pushed = 0;
+    size_t drained = 0;
+    double pushNs = 0.0;
+    double meanLatencyUs = 0.0;
+    double maxLatencyUs = 0.0;
+};
+
+// One producer thread per entry in `producers`, each pushing its own pattern as fast as it can
+template <typename Queue>
+static StormResult runStorm(Queue& queue, const std::vector<AppEventType>& producers, bool withRepeats) {
+    std::atomic<bool> running{true};
+    std::atomic<size_t> pushed{0};
+    std::atomic<long long> pushNanos{0};
+    std::vector<std::thread> threads;
+
+    for (size_t p = 0; p < producers.size(); ++p) {
+        threads.emplace_back([&, p]() {
+            AppEventType type = producers[p];
+            size_t count = 0;
+            auto start = std::chrono::steady_clock::now();
+            while (running.load(std::memory_order_relaxed)) {
+                Event event = { type, static_cast<int>('a' + p), static_cast<int>(count % 128), (count % 32) != 31 };
+                // Held keys: one key-down, a run of auto-repeats, one key-up
+                event.isRepeat = withRepeats && type == AppEventType::Keyboard && (count % 32) != 0 && (count % 32) != 31;
+                event.timestamp = std::chrono::steady_clock::now();
+                queue.push(event);
+                ++count;
+            }
+            pushNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+            pushed.fetch_add(count);
+        });
+    }
+
+    StormResult result;
+    std::vector<Event> batch(4096);
+    double latencySumUs = 0.0;
+    auto end = std::chrono::steady_clock::now() + STORM_DURATION;
+    while (std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(DRAIN_INTERVAL);
+        size_t count = queue.drain(batch.data(), batch.size());
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            double latencyUs = std::chrono::duration<double, std::micro>(now - batch[i].timestamp).count();
+            latencySumUs += latencyUs;
+            result.maxLatencyUs = std::max(result.maxLatencyUs, latencyUs);
+        }
+        result.drained += count;
+    }
+
+    running.store(false);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    result.pushed = pushed.load();
+    result.pushNs = result.pushed ? static_cast<double>(pushNanos.load()) / result.pushed : 0.0;
+    result.meanLatencyUs = result.drained ? latencySumUs / result.drained : 0.0;
+    return result;
+}
+
+int runEventQueueBenchmark() {
+    struct Scenario {
+        std::string name;
+        std::vector<AppEventType> producers;
+    };
+    // Network producers push keyboard-style actions, like OSC triggers
+    const std::vector<Scenario> scenarios = {
+        { "keyboard", { AppEventType::Keyboard } },
+        { "midi", { AppEventType::MIDI } },
+        { "network x2", { AppEventType::Keyboard, AppEventType::Keyboard } },
+        { "all", { AppEventType::Keyboard, AppEventType::MIDI, AppEventType::Keyboard, AppEventType::Keyboard } },
+    };
+
+    std::cout << "Event queue benchmark (" << STORM_DURATION.count() << " ms storms, drained every "
+              << DRAIN_INTERVAL.count() << " ms)\n";
+    std::cout << std::left << std::setw(12) << "Producers" << std::setw(12) << "Queue"
+              << std::setw(14) << "Pushes/s" << std::setw(12) << "ns/push" << std::setw(12) << "Drained"
+              << std::setw(14) << "Mean lat us" << std::setw(14) << "Max lat us" << "\n";
+    std::cout << std::string(90, '-') << "\n";
+
+    auto print = [](const std::string& producers, const std::string& queue, const StormResult& result, size_t extra) {
+        std::cout << std::left << std::setw(12) << producers << std::setw(12) << queue
+                  << std::setw(14) << static_cast<size_t>(result.pushed / (STORM_DURATION.count() / 1000.0))
+                  << std::setw(12) << std::fixed << std::setprecision(1) << result.pushNs
+                  << std::setw(12) << result.drained
+                  << std::setw(14) << result.meanLatencyUs
+                  << std::setw(14) << result.maxLatencyUs;
+        if (extra) {
+            std::cout << extra << " dropped/coalesced";
+        }
+        std::cout << "\n";
+    };
+
+    for (const Scenario& scenario : scenarios) {
+        MutexEventQueue mutexQueue;
+        print(scenario.name, "mutex", runStorm(mutexQueue, scenario.producers, false), 0);
+
+        EventQueue lockFreeQueue;
+        StormResult result = runStorm(lockFreeQueue, scenario.producers, true);
+        print(scenario.name, "lock-free", result, lockFreeQueue.getDroppedCount() + lockFreeQueue.getCoalescedCount());
+    }
+
+    return 0;
+}
+
+int runMidiClockBenchmark() {
+    // Pulse jitter as seen from USB controllers and DJ software: a normal spread
+    // plus an occasional late pulse when the driver thread is descheduled
+    const std::vector<double> tempos = { 90.0, 128.0, 174.0 };
+    const std::vector<double> jittersMs = { 0.0, 0.5, 2.0 };
+    const double latePulseMs = 8.0;
+    const int latePulseEvery = 97;
+
+    std::cout << "MIDI clock benchmark (" << CLOCK_BENCHMARK_BEATS << " beats per run, late pulse of "
+              << latePulseMs << " ms every " << latePulseEvery << " pulses)\n";
+    std::cout << std::left << std::setw(8) << "BPM" << std::setw(12) << "Jitter ms"
+              << std::setw(20) << "Per-pulse BPM err" << std::setw(18) << "Fitted BPM err"
+              << std::setw(18) << "Phase err ms" << "\n";
+    std::cout << std::string(76, '-') << "\n";
+
+    std::mt19937 random(42);
+    for (double tempo : tempos) {
+        for (double jitterMs : jittersMs) {
+            std::normal_distribution<double> jitter(0.0, jitterMs);
+            MidiClock clock;
+            clock.onStart();
+
+            const double pulseSeconds = 60.0 / (tempo * MIDI_CLOCK_PPQN);
+            const auto start = std::chrono::steady_clock::now();
+            double previousArrival = 0.0;
+            double pulseError = 0.0;
+            double fittedError = 0.0;
+            double phaseErrorMs = 0.0;
+            int measured = 0;
+
+            const int pulses = CLOCK_BENCHMARK_BEATS * MIDI_CLOCK_PPQN;
+            for (int pulse = 0; pulse < pulses; ++pulse) {
+                double idealSeconds = pulse * pulseSeconds;
+                double arrival = idealSeconds + (jitterMs > 0.0 ? jitter(random) / 1000.0 : 0.0);
+                if (pulse % latePulseEvery == latePulseEvery - 1) {
+                    arrival += latePulseMs / 1000.0;
+                }
+                auto arrivalTime = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(arrival));
+                clock.onTick(arrivalTime);
+
+                // Skip the first beat while the fit fills up
+                if (pulse >= 2 * MIDI_CLOCK_PPQN) {
+                    double perPulseBpm = 60.0 / ((arrival - previousArrival) * MIDI_CLOCK_PPQN);
+                    pulseError += std::abs(perPulseBpm - tempo);
+                    fittedError += std::abs(clock.getBpm() - tempo);
+
+                    // Where the clock puts the beat half a pulse later, against where it really is
+                    double probeSeconds = idealSeconds + pulseSeconds / 2.0;
+                    auto probeTime = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(probeSeconds));
+                    double expectedBeat = probeSeconds * tempo / 60.0;
+                    phaseErrorMs += std::abs(clock.getBeat(probeTime) - expectedBeat) * 60000.0 / tempo;
+                    ++measured;
+                }
+                previousArrival = arrival;
+            }
+
+            std::cout << std::left << std::setw(8) << std::fixed << std::setprecision(0) << tempo
+                      << std::setw(12) << std::setprecision(1) << jitterMs
+                      << std::setw(20) << std::setprecision(3) << pulseError / measured
+                      << std::setw(18) << fittedError / measured
+                      << std::setw(18) << phaseErrorMs / measured << "\n";
+        }
+    }
+
+    return 0;
+}
+
+// Minimal OSC encoder standing in for a lighting desk
+static void appendOscString(std::vector<char>& packet, const char* text) {
+    size_t length = std::strlen(text);
+    packet.insert(packet.end(), text, text + length);
+    packet.resize(packet.size() + 4 - length % 4, '\0');
+}
+
+static void appendOscInt(std::vector<char>& packet, uint32_t value) {
+    value = htonl(value);
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    packet.insert(packet.end(), bytes, bytes + 4);
+}
+
+static std::vector<char> makeOscKeyMessage(char key, bool isDown) {
+    std::vector<char> packet;
+    char keyText[2] = { key, '\0' };
+    appendOscString(packet, "/vh/key");
+    appendOscString(packet, ",si");
+    appendOscString(packet, keyText);
+    appendOscInt(packet, isDown ? 1 : 0);
+    return packet;
+}
+
+static std::vector<char> makeOscBundle(const std::vector<std::vector<char>>& messages) {
+    std::vector<char> packet;
+    appendOscString(packet, "#bundle");
+    appendOscInt(packet, 0);
+    appendOscInt(packet, 1); // Immediately
+    for (const auto& message : messages) {
+        appendOscInt(packet, static_cast<uint32_t>(message.size()));
+        packet.insert(packet.end(), message.begin(), message.end());
+    }
+    return packet;
+}
+
+int runOscBenchmark() {
+    std::vector<char> message = makeOscKeyMessage('a', true);
+    std::vector<std::vector<char>> bundleMessages;
+    for (int i = 0; i < OSC_BUNDLE_SIZE; ++i) {
+        bundleMessages.push_back(makeOscKeyMessage(static_cast<char>('a' + i), i % 2 == 0));
+    }
+    std::vector<char> bundle = makeOscBundle(bundleMessages);
+
+    std::cout << "OSC benchmark\n";
+
+    // Parsing alone, straight from a buffer into a queue that is drained as it goes
+    {
+        EventQueue queue(4096);
+        OscServer parser(-1, queue);
+        std::vector<Event> batch(4096);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < OSC_PARSE_MESSAGES / OSC_BUNDLE_SIZE; ++i) {
+            parser.handlePacket(bundle.data(), bundle.size(), start);
+            if (i % 256 == 0) {
+                queue.drain(batch.data(), batch.size());
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / OSC_PARSE_MESSAGES;
+        std::cout << "  parse + push:  " << std::fixed << std::setprecision(1) << ns << " ns/message ("
+                  << parser.getMalformedCount() << " malformed)\n";
+    }
+
+    // End to end through a localhost socket, half single messages and half bundles
+    EventQueue queue(65536);
+    OscServer server(0, queue);
+    if (!server.isOpen()) {
+        return 1;
+    }
+
+    std::atomic<bool> draining{true};
+    std::atomic<size_t> drained{0};
+    std::thread consumer([&]() {
+        std::vector<Event> batch(4096);
+        while (draining.load()) {
+            drained.fetch_add(queue.drain(batch.data(), batch.size()));
+            std::this_thread::sleep_for(DRAIN_INTERVAL);
+        }
+        drained.fetch_add(queue.drain(batch.data(), batch.size()));
+    });
+
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+
+    size_t sent = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (sent < static_cast<size_t>(OSC_SEND_MESSAGES)) {
+        const std::vector<char>& packet = (sent / OSC_BUNDLE_SIZE) % 2 == 0 ? message : bundle;
+        if (sendto(sender, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr*>(&address), sizeof(address)) > 0) {
+            sent += &packet == &message ? 1 : OSC_BUNDLE_SIZE;
+        }
+    }
+    double sendSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    close(sender);
+
+    // Let the server catch up with what the kernel has buffered
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    server.stop();
+    draining.store(false);
+    consumer.join();
+
+    std::cout << "  localhost:     " << sent << " messages sent in " << std::setprecision(3) << sendSeconds << " s ("
+              << static_cast<size_t>(sent / sendSeconds) << " messages/s)\n";
+    std::cout << "                 " << server.getMessageCount() << " received, " << drained.load() << " drained, "
+              << server.getMalformedCount() << " malformed, " << server.getDroppedCount() << " dropped on a full queue\n";
+    return 0;
+}
+
+int runLinkBenchmark() {
+    // The frame loop's source, and a second peer standing in for another machine
+    AppConfig config;
+    AbletonLinkManager follower(config, true);
+    ableton::Link peer(config.default_bpm);
+    peer.enable(true);
+
+    std::cout << "Ableton Link benchmark (quantum " << config.phraseLength << ")\n";
+
+    auto start = std::chrono::steady_clock::now();
+    while (follower.getPeerCount() == 0) {
+        if (std::chrono::steady_clock::now() - start > LINK_DISCOVERY_TIMEOUT) {
+            std::cerr << "  the peers did not find each other, is multicast on the loopback interface blocked?\n";
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double discoveryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  discovery:          " << std::fixed << std::setprecision(1) << discoveryMs << " ms\n";
+
+    // Change the tempo on the other peer and wait for the follower's next frame to see it
+    const double newTempo = config.default_bpm + 3.0;
+    auto state = peer.captureAppSessionState();
+    state.setTempo(newTempo, peer.clock().micros());
+    peer.commitAppSessionState(state);
+    start = std::chrono::steady_clock::now();
+    while (true) {
+        follower.capture(std::chrono::steady_clock::now());
+        if (std::abs(follower.getBpm() - newTempo) < 0.001) {
+            break;
+        }
+        if (std::chrono::steady_clock::now() - start > LINK_DISCOVERY_TIMEOUT) {
+            std::cerr << "  the tempo change did not arrive\n";
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double tempoMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  tempo propagation:  " << tempoMs << " ms\n";
+
+    // Beat position both peers report for the same instant, one sample per simulated frame
+    double sumErrorMs = 0.0;
+    double maxErrorMs = 0.0;
+    double captureUs = 0.0;
+    for (int i = 0; i < LINK_PHASE_SAMPLES; ++i) {
+        auto now = std::chrono::steady_clock::now();
+        follower.capture(now);
+        captureUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - now).count();
+        double followerBeat = follower.getBeat(now);
+        double peerBeat = peer.captureAppSessionState().beatAtTime(peer.clock().micros() - std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - now), config.phraseLength);
+        double errorMs = std::abs(followerBeat - peerBeat) * 60000.0 / newTempo;
+        sumErrorMs += errorMs;
+        maxErrorMs = std::max(maxErrorMs, errorMs);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::cout << "  phase error:        " << std::setprecision(3) << sumErrorMs / LINK_PHASE_SAMPLES << " ms mean, "
+              << maxErrorMs << " ms max\n";
+    std::cout << "  session capture:    " << std::setprecision(2) << captureUs / LINK_PHASE_SAMPLES << " us per frame\n";
+    return 0;
+}
+
+// Worst results a row of the tempo benchmark may have before it counts as a regression
+struct TempoLimits {
+    double lockSec;       // Time to lock, a track that never locks always fails
+    double bpmError;      // Mean steady-state error from the lock on
+    double octavePercent; // Estimates at double or half the tempo
+};
+
+// A synthetic track for the tempo benchmark
+struct TempoScenario {
+    const char* name;
+    double startBpm;
+    double endBpm;     // Reached linearly by the end of the track
+    bool isDrumKit;    // Kick, snare and hats instead of clicks
+    double swing;      // Where the offbeat hat falls within the beat, 0.5 is straight
+    double noiseLevel; // White noise under hits peaking around 0.8
+    TempoLimits limits;
+};
+
+// A detection engine in the tempo benchmark, with the limits every track must meet too
+struct TempoEngine {
+    const char* name;
+    DetectionSettings settings;
+    TempoLimits limits;
+};
+
+static double getScenarioBpm(const TempoScenario& scenario, double timeSec) {
+    return scenario.startBpm + (scenario.endBpm - scenario.startBpm) * timeSec / TEMPO_BENCHMARK_SECONDS;
+}
+
+// Renders a scenario at SAMPLE_RATE and returns the true beat times in seconds
+static std::vector<double> renderScenario(const TempoScenario& scenario, std::mt19937& random, std::vector<float>& samples) {
+    const double sampleRate = SAMPLE_RATE;
+    samples.assign(static_cast<size_t>(TEMPO_BENCHMARK_SECONDS * sampleRate), 0.0f);
+    std::uniform_real_distribution<float> white(-1.0f, 1.0f);
+
+    // Integrate the tempo so the beats of a ramp are exact
+    std::vector<double> beats;
+    std::vector<double> offbeats;
+    double phase = 0.75;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        double previous = phase;
+        phase += getScenarioBpm(scenario, i / sampleRate) / 60.0 / sampleRate;
+        if (std::floor(phase) > std::floor(previous)) {
+            beats.push_back(i / sampleRate);
+        }
+        if (std::floor(phase - scenario.swing) > std::floor(previous - scenario.swing)) {
+            offbeats.push_back(i / sampleRate);
+        }
+    }
+
+    auto addHit = [&](double startSec, double lengthSec, auto&& voice) {
+        size_t start = static_cast<size_t>(startSec * sampleRate);
+        size_t end = std::min(samples.size(), start + static_cast<size_t>(lengthSec * sampleRate));
+        for (size_t i = start; i < end; ++i) {
+            samples[i] += voice((i - start) / sampleRate);
+        }
+    };
+    auto click = [&](double t) { return 0.8f * white(random) * static_cast<float>(std::exp(-t / 0.003)); };
+    // Sine swept down from 120 to 50 Hz, the sweep's phase integrated in closed form
+    auto kick = [](double t) {
+        double sweepPhase = 2.0 * M_PI * (50.0 * t + 70.0 * 0.03 * (1.0 - std::exp(-t / 0.03)));
+        return static_cast<float>(0.8 * std::sin(sweepPhase) * std::exp(-t / 0.12));
+    };
+    auto snare = [&](double t) {
+        return static_cast<float>((0.4 * white(random) + 0.2 * std::sin(2.0 * M_PI * 190.0 * t)) * std::exp(-t / 0.05));
+    };
+    float previousHat = 0.0f;
+    auto hat = [&](double t) {
+        float noise = white(random);
+        float highPassed = noise - previousHat;
+        previousHat = noise;
+        return 0.15f * highPassed * static_cast<float>(std::exp(-t / 0.01));
+    };
+
+    for (size_t beat = 0; beat < beats.size(); ++beat) {
+        if (!scenario.isDrumKit) {
+            addHit(beats[beat], 0.02, click);
+            continue;
+        }
+        addHit(beats[beat], 0.25, kick);
+        if (beat % 2 == 1) {
+            addHit(beats[beat], 0.2, snare);
+        }
+    }
+    if (scenario.isDrumKit) {
+        for (double offbeat : offbeats) {
+            addHit(offbeat, 0.04, hat);
+        }
+    }
+    if (scenario.noiseLevel > 0.0) {
+        for (float& sample : samples) {
+            sample += static_cast<float>(scenario.noiseLevel) * white(random);
+        }
+    }
+    return beats;
+}
+
+// Runs one track through one engine and prints its row of the tempo benchmark.
+// Adds a line to `regressions` for every limit of the track or engine the row breaks.
+static bool measureTempoDetection(const TempoScenario& scenario, const std::vector<double>& beats, const std::vector<float>& samples,
+                                  const TempoEngine& engine, std::vector<std::string>& regressions) {
+    const char* engineName = engine.name;
+    OfflineBeatTracker tracker(SAMPLE_RATE, engine.settings);
+    if (!tracker.isValid()) {
+        return false;
+    }
+    const uint_t hopSize = tracker.getHopSize();
+
+    // Estimates as (time, bpm), and the tracker's beats against the nearest true one while locked
+    std::vector<std::pair<double, double>> estimates;
+    double pllLockSec = -1.0;
+    double phaseErrorMs = 0.0;
+    int phaseMeasured = 0;
+    double confidence = 0.0;
+
+    std::clock_t cpuStart = std::clock();
+    for (size_t offset = 0; offset + hopSize <= samples.size(); offset += hopSize) {
+        if (tracker.process(samples.data() + offset)) {
+            estimates.emplace_back(tracker.getTime(), tracker.getBpm());
+            confidence += tracker.getConfidence();
+        }
+        if (!tracker.isBeat()) {
+            continue;
+        }
+        BeatPhase phase = tracker.getPhase();
+        if (!phase.locked) {
+            continue;
+        }
+        if (pllLockSec < 0.0) {
+            pllLockSec = tracker.getTime();
+        }
+        double anchorSec = phase.anchorNs / 1e9;
+        auto nearest = std::lower_bound(beats.begin(), beats.end(), anchorSec);
+        double errorSec = std::numeric_limits<double>::max();
+        if (nearest != beats.end()) {
+            errorSec = *nearest - anchorSec;
+        }
+        if (nearest != beats.begin()) {
+            errorSec = std::min(errorSec, anchorSec - *(nearest - 1));
+        }
+        phaseErrorMs += errorSec * 1000.0;
+        ++phaseMeasured;
+    }
+    double cpuSec = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    // Locked at the first estimate from which every estimate for the hold time is within tolerance
+    auto isClose = [&](const std::pair<double, double>& estimate) {
+        return std::abs(estimate.second - getScenarioBpm(scenario, estimate.first)) <= TEMPO_LOCK_TOLERANCE_BPM;
+    };
+    double lockSec = -1.0;
+    size_t lockIndex = estimates.size();
+    for (size_t i = 0; i < estimates.size() && lockSec < 0.0; ++i) {
+        if (estimates[i].first + TEMPO_LOCK_HOLD_SECONDS > TEMPO_BENCHMARK_SECONDS) {
+            break;
+        }
+        bool isHeld = true;
+        for (size_t j = i; j < estimates.size() && estimates[j].first <= estimates[i].first + TEMPO_LOCK_HOLD_SECONDS; ++j) {
+            isHeld = isHeld && isClose(estimates[j]);
+        }
+        if (isHeld) {
+            lockSec = estimates[i].first;
+            lockIndex = i;
+        }
+    }
+
+    // Steady-state error from the lock on, octave errors over the whole track
+    double bpmError = 0.0;
+    for (size_t i = lockIndex; i < estimates.size(); ++i) {
+        bpmError += std::abs(estimates[i].second - getScenarioBpm(scenario, estimates[i].first));
+    }
+    int octaveErrors = 0;
+    for (const auto& [timeSec, bpm] : estimates) {
+        double ratio = bpm / getScenarioBpm(scenario, timeSec);
+        if (std::abs(ratio - 2.0) < 0.08 || std::abs(ratio - 0.5) < 0.02) {
+            ++octaveErrors;
+        }
+    }
+
+    auto printSeconds = [](double seconds) {
+        std::ostringstream text;
+        if (seconds < 0.0) {
+            text << "never";
+        } else {
+            text << std::fixed << std::setprecision(1) << seconds;
+        }
+        return text.str();
+    };
+    double hops = std::floor(samples.size() / static_cast<double>(hopSize));
+    double meanBpmError = lockIndex < estimates.size() ? bpmError / (estimates.size() - lockIndex) : 0.0;
+    double octavePercent = estimates.empty() ? 0.0 : 100.0 * octaveErrors / estimates.size();
+    std::cout << std::left << std::setw(20) << scenario.name << std::setw(17) << engineName << std::setw(8) << printSeconds(lockSec)
+              << std::setw(12) << printSeconds(pllLockSec) << std::fixed << std::setprecision(2)
+              << std::setw(9) << meanBpmError
+              << std::setw(10) << std::setprecision(1) << octavePercent
+              << std::setw(14) << std::setprecision(2) << (phaseMeasured > 0 ? phaseErrorMs / phaseMeasured : 0.0)
+              << std::setw(12) << (estimates.empty() ? 0.0 : confidence / estimates.size())
+              << std::setw(11) << std::setprecision(1) << estimates.size() / TEMPO_BENCHMARK_SECONDS
+              << std::setw(10) << std::setprecision(3) << cpuSec * 1000.0 / TEMPO_BENCHMARK_SECONDS
+              << std::setw(8) << std::setprecision(2) << cpuSec * 1e6 / hops << "\n";
+
+    // The tighter of the track's and the engine's limits applies
+    auto check = [&](const char* what, double value, double trackLimit, double engineLimit, bool isBroken) {
+        double limit = std::min(trackLimit, engineLimit);
+        if (isBroken || value > limit) {
+            std::ostringstream text;
+            text << std::fixed << std::setprecision(2) << scenario.name << " / " << engineName << ": " << what << " "
+                 << value << " over the limit of " << limit << " (" << (trackLimit <= engineLimit ? "track" : "engine") << ")";
+            regressions.push_back(text.str());
+        }
+    };
+    check("lock s", lockSec, scenario.limits.lockSec, engine.limits.lockSec, lockSec < 0.0);
+    check("BPM err", meanBpmError, scenario.limits.bpmError, engine.limits.bpmError, false);
+    check("octave %", octavePercent, scenario.limits.octavePercent, engine.limits.octavePercent, false);
+    return true;
+}
+
+int runTempoBenchmark() {
+    // Limits as { lock s, BPM err, octave % }. A ramp is followed a little
+    // behind, so its steady-state error is allowed to be larger.
+    const std::vector<TempoScenario> scenarios = {
+        { "click 128",          128.0, 128.0, false, 0.5,   0.0, { 15.0, 0.5,  20.0 } },
+        { "click 174",          174.0, 174.0, false, 0.5,   0.0, { 15.0, 0.5,  20.0 } },
+        { "click 90",            90.0,  90.0, false, 0.5,   0.0, { 15.0, 0.5,  20.0 } },
+        { "drums 124",          124.0, 124.0, true,  0.5,   0.0, { 15.0, 0.5,  20.0 } },
+        { "drums 124 noise",    124.0, 124.0, true,  0.5,   0.3, { 20.0, 0.75, 25.0 } },
+        { "drums 100 swing",    100.0, 100.0, true,  0.667, 0.0, { 20.0, 0.75, 25.0 } },
+        { "drums 120-130 ramp", 120.0, 130.0, true,  0.5,   0.0, { 25.0, 1.0,  25.0 } },
+    };
+
+    // aubio's envelope through the tempogram and its readings through the
+    // original median estimator, at the live loop's hop, against the onset
+    // engine at its shorter ones. The median estimator is the slow reference.
+    const std::vector<TempoEngine> engines = {
+        { "aubio tempogram", { DetectionEngine::Aubio, HOP_SIZE, DEFAULT_MIN_BPM, DEFAULT_MAX_BPM },       { 20.0, 0.75, 20.0 } },
+        { "aubio median",    { DetectionEngine::AubioMedian, HOP_SIZE, DEFAULT_MIN_BPM, DEFAULT_MAX_BPM }, { 30.0, 1.0,  30.0 } },
+        { "onset 256",       { DetectionEngine::Onset, 256, DEFAULT_MIN_BPM, DEFAULT_MAX_BPM },            { 8.0,  0.75, 5.0 } },
+        { "onset 128",       { DetectionEngine::Onset, 128, DEFAULT_MIN_BPM, DEFAULT_MAX_BPM },            { 8.0,  0.75, 5.0 } },
+    };
+
+    std::cout << "Tempo detection benchmark (" << TEMPO_BENCHMARK_SECONDS << " s per track at " << SAMPLE_RATE
+              << " Hz, locked within " << TEMPO_LOCK_TOLERANCE_BPM << " BPM for " << TEMPO_LOCK_HOLD_SECONDS << " s)\n";
+    std::cout << std::left << std::setw(20) << "Track" << std::setw(17) << "Engine" << std::setw(8) << "Lock s"
+              << std::setw(12) << "PLL lock s" << std::setw(9) << "BPM err" << std::setw(10) << "Octave %"
+              << std::setw(14) << "Phase err ms" << std::setw(12) << "Confidence" << std::setw(11) << "Updates/s" << std::setw(10) << "CPU ms/s"
+              << std::setw(8) << "us/hop" << "\n";
+    std::cout << std::string(131, '-') << "\n";
+
+    std::mt19937 random(42);
+    std::vector<float> samples;
+    std::vector<std::string> regressions;
+    for (const TempoScenario& scenario : scenarios) {
+        std::vector<double> beats = renderScenario(scenario, random, samples);
+        for (const TempoEngine& engine : engines) {
+            if (!measureTempoDetection(scenario, beats, samples, engine, regressions)) {
+                return 1;
+            }
+        }
+    }
+
+    if (!regressions.empty()) {
+        std::cerr << "\n" << regressions.size() << " tempo detection results over their limits:\n";
+        for (const std::string& regression : regressions) {
+            std::cerr << "  " << regression << "\n";
+        }
+        return 1;
+    }
+    std::cout << "\nEvery track is within its limits.\n";
+    return 0;
+}
+
+// A synthetic arrangement for the meter benchmark
+struct MeterScenario {
+    const char* name;
+    double bpm;
+    double downbeatAccent; // Extra kick level on the first beat of the bar
+    bool hasBassline;      // A note per bar under the drums
+    bool hasSections;      // Hats and bass drop out for alternate 8-bar phrases, with a crash where each starts
+    double noiseLevel;
+};
+
+// Renders a scenario at SAMPLE_RATE and returns the true beat times; beat i is
+// beat (i + METER_BENCHMARK_FIRST_BEAT) % 4 of its bar
+static std::vector<double> renderMeterScenario(const MeterScenario& scenario, std::mt19937& random, std::vector<float>& samples) {
+    const double sampleRate = SAMPLE_RATE;
+    const double beatSec = 60.0 / scenario.bpm;
+    samples.assign(static_cast<size_t>(METER_BENCHMARK_SECONDS * sampleRate), 0.0f);
+    std::uniform_real_distribution<float> white(-1.0f, 1.0f);
+
+    auto addHit = [&](double startSec, double lengthSec, auto&& voice) {
+        size_t start = static_cast<size_t>(startSec * sampleRate);
+        size_t end = std::min(samples.size(), start + static_cast<size_t>(lengthSec * sampleRate));
+        for (size_t i = start; i < end; ++i) {
+            samples[i] += voice((i - start) / sampleRate);
+        }
+    };
+    auto kick = [](double level) {
+        return [level](double t) {
+            double sweepPhase = 2.0 * M_PI * (50.0 * t + 70.0 * 0.03 * (1.0 - std::exp(-t / 0.03)));
+            return static_cast<float>(level * std::sin(sweepPhase) * std::exp(-t / 0.12));
+        };
+    };
+    auto snare = [&](double t) {
+        return static_cast<float>((0.4 * white(random) + 0.2 * std::sin(2.0 * M_PI * 190.0 * t)) * std::exp(-t / 0.05));
+    };
+    float previousHat = 0.0f;
+    auto hat = [&](double level, double decaySec) {
+        return [&, level, decaySec](double t) {
+            float noise = white(random);
+            float highPassed = noise - previousHat;
+            previousHat = noise;
+            return static_cast<float>(level * highPassed * std::exp(-t / decaySec));
+        };
+    };
+    // Root and fifth of a four-bar progression, held for the bar
+    const double roots[] = { 110.0, 87.3, 130.8, 98.0 };
+    auto bass = [](double root) {
+        return [root](double t) {
+            double envelope = std::min(t / 0.01, 1.0) * std::exp(-t / 1.5);
+            return static_cast<float>(0.25 * envelope * (std::sin(2.0 * M_PI * root * t) + 0.6 * std::sin(2.0 * M_PI * 1.5 * root * t)));
+        };
+    };
+
+    std::vector<double> beats;
+    for (int beat = 0; beat * beatSec < METER_BENCHMARK_SECONDS; ++beat) {
+        double beatTime = beat * beatSec;
+        beats.push_back(beatTime);
+        int barBeat = (beat + METER_BENCHMARK_FIRST_BEAT) % 4;
+        int bar = (beat + METER_BENCHMARK_FIRST_BEAT) / 4;
+        bool isQuiet = scenario.hasSections && (bar / 8) % 2 == 1;
+
+        addHit(beatTime, 0.25, kick(barBeat == 0 ? 0.6 + scenario.downbeatAccent : 0.6));
+        if (barBeat % 2 == 1) {
+            addHit(beatTime, 0.2, snare);
+        }
+        if (!isQuiet) {
+            addHit(beatTime + beatSec / 2, 0.04, hat(0.15, 0.01));
+        }
+        if (scenario.hasBassline && barBeat == 0 && !isQuiet) {
+            addHit(beatTime, 4 * beatSec, bass(roots[bar % 4]));
+        }
+        if (scenario.hasSections && barBeat == 0 && bar % 8 == 0) {
+            addHit(beatTime, 1.5, hat(0.3, 0.5));
+        }
+    }
+    if (scenario.noiseLevel > 0.0) {
+        for (float& sample : samples) {
+            sample += static_cast<float>(scenario.noiseLevel) * white(random);
+        }
+    }
+    return beats;
+}
+
+// Runs one arrangement through one engine, the level meter and the meter
+// tracker as the live loop does, and prints its row of the meter benchmark
+static bool measureMeterDetection(const MeterScenario& scenario, const std::vector<double>& beats,
+                                  const std::vector<float>& samples, const char* engineName, const DetectionSettings& settings) {
+    OfflineBeatTracker tracker(SAMPLE_RATE, settings);
+    if (!tracker.isValid()) {
+        return false;
+    }
+    const uint_t hopSize = tracker.getHopSize();
+    AudioLevelMeter levelMeter(SAMPLE_RATE, hopSize);
+    MeterTracker meter;
+
+    // The true beat a tracker beat number falls on, -1 if none is near
+    auto findBeat = [&](const BeatPhase& phase, double beatNumber) -> long {
+        double timeSec = phase.anchorNs / 1e9 + (beatNumber - phase.anchorBeat) * phase.periodSec;
+        auto nearest = std::lower_bound(beats.begin(), beats.end(), timeSec - phase.periodSec / 2);
+        if (nearest == beats.end() || std::abs(*nearest - timeSec) > phase.periodSec / 4) {
+            return -1;
+        }
+        return static_cast<long>(nearest - beats.begin()) + METER_BENCHMARK_FIRST_BEAT;
+    };
+
+    // From the last beat the meter was wrong (or unsure) on, and how often it was right over the second half
+    double barFoundSec = -1.0;
+    double phraseFoundSec = -1.0;
+    int barRight = 0;
+    int phraseRight = 0;
+    int measured = 0;
+    double meterSec = 0.0;
+
+    for (size_t offset = 0; offset + hopSize <= samples.size(); offset += hopSize) {
+        tracker.process(samples.data() + offset);
+        int64_t hopEndNs = static_cast<int64_t>((offset + hopSize) * 1e9 / SAMPLE_RATE);
+        auto meterStart = std::chrono::steady_clock::now();
+        meter.addHop(levelMeter.process(samples.data() + offset, hopEndNs), tracker.getPhase());
+        meterSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - meterStart).count();
+        if (!tracker.isBeat()) {
+            continue;
+        }
+
+        BeatPhase phase = tracker.getPhase();
+        MeterPhase meterPhase = meter.getPhase();
+        long downbeat = findBeat(phase, meterPhase.downbeat);
+        long phraseStart = findBeat(phase, meterPhase.phraseStart);
+        bool isBarRight = phase.locked && meterPhase.barConfidence >= METER_MIN_CONFIDENCE && downbeat >= 0 && downbeat % 4 == 0;
+        bool isPhraseRight = isBarRight && meterPhase.phraseConfidence >= METER_MIN_CONFIDENCE && phraseStart >= 0 && phraseStart % 32 == 0;
+        double timeSec = tracker.getTime();
+        if (!isBarRight) {
+            barFoundSec = -1.0;
+        } else if (barFoundSec < 0.0) {
+            barFoundSec = timeSec;
+        }
+        if (!isPhraseRight) {
+            phraseFoundSec = -1.0;
+        } else if (phraseFoundSec < 0.0) {
+            phraseFoundSec = timeSec;
+        }
+        if (timeSec >= METER_BENCHMARK_SECONDS / 2) {
+            barRight += isBarRight;
+            phraseRight += isPhraseRight;
+            ++measured;
+        }
+    }
+
+    auto printSeconds = [](double seconds) {
+        std::ostringstream text;
+        if (seconds < 0.0) {
+            text << "never";
+        } else {
+            text << std::fixed << std::setprecision(1) << seconds;
+        }
+        return text.str();
+    };
+    double hops = std::floor(samples.size() / static_cast<double>(hopSize));
+    MeterPhase last = meter.getPhase();
+    std::cout << std::left << std::setw(22) << scenario.name << std::setw(17) << engineName
+              << std::setw(12) << printSeconds(barFoundSec) << std::fixed << std::setprecision(1)
+              << std::setw(8) << (measured > 0 ? 100.0 * barRight / measured : 0.0)
+              << std::setw(15) << printSeconds(phraseFoundSec)
+              << std::setw(11) << (measured > 0 ? 100.0 * phraseRight / measured : 0.0)
+              << std::setprecision(2) << std::setw(13) << last.barConfidence << std::setw(16) << last.phraseConfidence
+              << std::setw(8) << meterSec * 1e6 / hops << "\n";
+    return true;
+}
+
+int runMeterBenchmark() {
+    const std::vector<MeterScenario> scenarios = {
+        { "accented kick 128",    128.0, 0.3, false, false, 0.0 },
+        { "bassline 124",         124.0, 0.0, true,  false, 0.0 },
+        { "sections 124",         124.0, 0.0, true,  true,  0.0 },
+        { "sections 124 noise",   124.0, 0.0, true,  true,  0.2 },
+        { "sections 140",         140.0, 0.0, true,  true,  0.0 },
+    };
+    const std::vector<std::pair<const char*, DetectionSettings>> engines = {
+        { "aubio tempogram", { DetectionEngine::Aubio, HOP_SIZE, DEFAULT_MIN_BPM, DEFAULT_MAX_BPM } },
+        { "onset 256",       { DetectionEngine::Onset, 256, DEFAULT_MIN_BPM, DEFAULT_MAX_BPM } },
+    };
+
+    std::cout << "Meter benchmark (" << METER_BENCHMARK_SECONDS << " s per arrangement, 8-bar phrases; "
+              << "found = right on every beat from then on, % over the second half)\n";
+    std::cout << std::left << std::setw(22) << "Arrangement" << std::setw(17) << "Engine" << std::setw(12) << "Bar found s"
+              << std::setw(8) << "Bar %" << std::setw(15) << "Phrase found s" << std::setw(11) << "Phrase %"
+              << std::setw(13) << "Bar conf" << std::setw(16) << "Phrase conf" << std::setw(8) << "us/hop" << "\n";
+    std::cout << std::string(122, '-') << "\n";
+
+    std::mt19937 random(42);
+    std::vector<float> samples;
+    for (const MeterScenario& scenario : scenarios) {
+        std::vector<double> beats = renderMeterScenario(scenario, random, samples);
+        for (const auto& [engineName, settings] : engines) {
+            if (!measureMeterDetection(scenario, beats, samples, engineName, settings)) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int runResampleBenchmark() {
+    struct ResampleCase {
+        uint32_t sampleRate;
+        size_t channels;
+        std::vector<int> picked;
+    };
+    const std::vector<ResampleCase> cases = {
+        { 44100, 2, {} },
+        { 48000, 2, {} },
+        { 48000, 8, {} },
+        { 48000, 8, { 0, 1 } },
+        { 96000, 2, {} },
+        { 96000, 8, {} },
+    };
+
+    std::cout << "Audio front-end benchmark (" << RESAMPLE_BENCHMARK_SECONDS << " s of audio per case, blocks of one "
+              << HOP_SIZE << "-sample hop, resampled to " << SAMPLE_RATE << " Hz)\n";
+    std::cout << std::left << std::setw(10) << "Rate" << std::setw(10) << "Channels" << std::setw(8) << "Mix"
+              << std::setw(16) << "Downmix ms/s" << std::setw(17) << "Resample ms/s" << std::setw(14) << "us/block"
+              << "Outputs/s\n";
+    std::cout << std::string(85, '-') << "\n";
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    for (const ResampleCase& testCase : cases) {
+        // Blocks as a source at this rate delivers them for the live loop's hop
+        const size_t blockFrames = std::min<size_t>(static_cast<size_t>(std::lround(static_cast<double>(HOP_SIZE) * testCase.sampleRate / SAMPLE_RATE)), MAX_AUDIO_BLOCK_FRAMES);
+        const size_t blocks = static_cast<size_t>(RESAMPLE_BENCHMARK_SECONDS * testCase.sampleRate / blockFrames);
+        std::vector<float> interleaved(blockFrames * testCase.channels);
+        for (float& sample : interleaved) {
+            sample = noise(random);
+        }
+
+        AudioResampler resampler(testCase.sampleRate, SAMPLE_RATE);
+        std::vector<float> mono(blockFrames);
+        std::vector<float> output;
+        output.reserve(blockFrames * 2);
+        std::chrono::steady_clock::duration downmixTime{0};
+        std::chrono::steady_clock::duration resampleTime{0};
+        size_t outputs = 0;
+        for (size_t block = 0; block < blocks; ++block) {
+            auto start = std::chrono::steady_clock::now();
+            downmixChannels(interleaved.data(), blockFrames, testCase.channels, testCase.picked, mono.data());
+            auto mixed = std::chrono::steady_clock::now();
+            resampler.process(mono.data(), blockFrames, output);
+            auto resampled = std::chrono::steady_clock::now();
+            downmixTime += mixed - start;
+            resampleTime += resampled - mixed;
+            outputs += output.size();
+            output.clear();
+        }
+
+        const double audioSec = static_cast<double>(blocks * blockFrames) / testCase.sampleRate;
+        const double downmixMs = std::chrono::duration<double, std::milli>(downmixTime).count();
+        const double resampleMs = std::chrono::duration<double, std::milli>(resampleTime).count();
+        std::cout << std::left << std::setw(10) << testCase.sampleRate << std::setw(10) << testCase.channels
+                  << std::setw(8) << (testCase.picked.empty() ? "all" : std::to_string(testCase.picked.size()))
+                  << std::fixed << std::setprecision(3)
+                  << std::setw(16) << downmixMs / audioSec << std::setw(17) << resampleMs / audioSec
+                  << std::setw(14) << (downmixMs + resampleMs) * 1000.0 / blocks
+                  << std::setprecision(0) << outputs / audioSec << "\n";
+    }
+
+    return 0;
+}
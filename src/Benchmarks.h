@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+// Built-in benchmarks, run with `VisualHive --benchmark <name>`.
+// Returns the process exit code.
+int runBenchmark(const std::string& name);
+
+// Compositor throughput at 1080p and 4K for 1 to N threads
+int runCompositorBenchmark();
+
+// Event queue under keyboard, MIDI and network producer storms,
+// against the previous mutex-and-notify queue
+int runEventQueueBenchmark();
+
+// MIDI clock tempo and phase error under synthetic pulse jitter
+int runMidiClockBenchmark();
+
+// OSC parse cost, and throughput from a localhost sender through the UDP server
+int runOscBenchmark();
+
+// Two Link peers in one process: discovery, tempo propagation and phase agreement
+int runLinkBenchmark();
+
+// Tempo detection on synthetic clicks and drums (tempo ramps, swing, noise),
+// aubio through the tempogram and the median estimator side by side with the
+// onset engine: time to lock, steady-state error, octave errors, confidence,
+// update rate and CPU per second of audio
+int runTempoBenchmark();
+
+// Downbeat and phrase detection on synthetic arrangements (accented kicks,
+// a bassline, sections with crashes, noise): when the bar and the 8-bar phrase
+// are found for good, how often they are right, confidence and CPU per hop
+int runMeterBenchmark();
+
+// Downmixing 2 and 8 channels and resampling 48 and 96 kHz to the detection
+// rate, block by block as the live loop does: CPU per second of audio and per block
+int runResampleBenchmark();
@@ -1,4 +1,5 @@
 #include "BpmDetector.h"
+#include <thread>
 
 // --- Global Constant Definitions ---
 const uint_t SAMPLE_RATE = 44100;
@@ -7,6 +8,10 @@ const uint_t WIN_SIZE = 1024;
 const uint_t HOP_SIZE = 512;
 const std::chrono::milliseconds READ_INTERVAL = std::chrono::milliseconds(100);
 const std::chrono::milliseconds CALCULATION_INTERVAL = std::chrono::milliseconds(500);
+// How long the detection loop sleeps when the audio ring is empty, well under a hop
+const std::chrono::milliseconds AUDIO_POLL_INTERVAL = std::chrono::milliseconds(1);
+// Audio resampled before its CPU cost is reported
+const double RESAMPLE_REPORT_SECONDS = 10.0;
 const size_t BUFFER_SIZE = 15;
 const double PERCENTAGE_TOLERANCE = 0.1;
 const double INITIAL_ROUNDING_TOLERANCE = 0.2;
@@ -15,32 +20,138 @@ const double MAX_ROUNDING_TOLERANCE = 0.5;
 const double TOLERANCE_SHRINK_RATE = 0.05;
 const double TOLERANCE_GROWTH_RATE = 0.1;
 
+// Beat phase tracking: how much of each beat's timing error goes into the
+// phase and into the period, how far from the grid a detection may land (in
+// beats), when a new tempo estimate re-seeds the loop, how far the period may
+// drift from the estimate, and the runs of hits and misses that lock and re-seed it
+const double PLL_PHASE_GAIN = 0.25;
+const double PLL_PERIOD_GAIN = 0.05;
+const double PLL_CAPTURE_WINDOW = 0.2;
+const double PLL_RELOCK_TEMPO_CHANGE = 0.03;
+const double PLL_MAX_PERIOD_TRIM = 0.02;
+const int PLL_LOCK_BEATS = 4;
+const int PLL_MAX_MISSES = 8;
+
+// Tempogram: spacing of the candidate tempos, multiples of the period the
+// comb filter looks at, how fast old audio fades, the confidence needed to
+// publish, how far the estimate must move to change the published tempo, and
+// the preferred range
+const double TEMPOGRAM_BIN_BPM = 0.25;
+const int TEMPOGRAM_MULTIPLES = 4;
+const double TEMPOGRAM_HALF_LIFE = 4.0;
+const double TEMPOGRAM_MIN_CONFIDENCE = 0.1;
+const double TEMPOGRAM_HYSTERESIS = 0.15;
+const double DEFAULT_MIN_BPM = 88.0;
+const double DEFAULT_MAX_BPM = 176.0;
+
+// Meter: beats to the bar, bars in the longest phrase looked for, bars each
+// side of a phrase boundary compared, the start of a beat (in beats) its kick
+// accent is taken from, how fast bar and phrase scores fade (in beats), how
+// fast the running means of the beat features follow, the least change of
+// log band levels that counts as the norm, and the confidence
+// needed before bars and phrases are counted from the detected downbeat
+const int METER_BEATS_PER_BAR = 4;
+const int METER_CYCLE_BARS = 32;
+const int METER_NOVELTY_BARS = 2;
+const double METER_ACCENT_WINDOW = 0.25;
+const double METER_BAR_HALF_LIFE = 64.0;
+const double METER_PHRASE_HALF_LIFE = 256.0;
+const double METER_MEAN_RATE = 0.05;
+const double METER_MIN_CHANGE = 0.3;
+const double METER_MIN_CONFIDENCE = 0.2;
+
 // --- Shared BPM Data (Thread-Safe) ---
 std::shared_ptr<double> g_BPM = std::make_shared<double>(0.0);
+std::atomic<double> g_tempoConfidence{0.0};
+BeatPhaseTracker g_beatPhase;
+MeterTracker g_meter;
+SeqLock<AudioLevels> g_audioLevels;
 
 // --- Static and Global Variables for state management ---
 static aubio_tempo_t* tempo_detector = nullptr;
-static PaStream* stream = nullptr;
-static AudioData audio_data;
-static std::deque<double> timeWindow;
-static std::vector<double> sortedWindow;
-static std::vector<double> lastReadings;
+static aubio_onset_t* onset_detector = nullptr; // DetectionEngine::Aubio only, for its onset envelope
+static std::unique_ptr<TempogramEstimator> tempogram;
+static std::unique_ptr<OnsetTempoEngine> onsetEngine; // Set when bpmDetectionInit() picks the onset engine
+static std::unique_ptr<AudioLevelMeter> levelMeter;
+static std::unique_ptr<AudioSource> audioSource;
+static AudioRing audioRing(AUDIO_RING_BLOCKS);
+static std::atomic<bool> isDetectionStopping{false};
+static std::unique_ptr<AudioResampler> resampler; // From the source's rate to SAMPLE_RATE
+static std::vector<float> analysisSamples; // At SAMPLE_RATE, not analysed yet
+static uint64_t analysedFrames = 0; // At SAMPLE_RATE
+static uint64_t sourceFrames = 0; // At the source's rate
+static uint_t analysisHop = HOP_SIZE;
+static std::chrono::steady_clock::duration resampleTime{0};
+static bool isResampleCostReported = false;
+// aubio's input and output, sized for the hop
+static fvec_t* input_buffer = nullptr;
+static fvec_t* tempo = nullptr;
+static TempoEstimator estimator;
 
 static auto lastCalculationTime = std::chrono::steady_clock::now();
 static auto lastReadingTime = std::chrono::steady_clock::now();
 
-// --- Static variables for rounding logic ---
-static double roundingTolerance = INITIAL_ROUNDING_TOLERANCE;
-static double candidateBPM = -1.0;
-static int confirmationCount = 0;
+// Samples fed to aubio so far, the clock aubio_tempo_get_last() counts in
+static uint64_t processedFrames = 0;
+
+void TempoEstimator::addReading(double bpm) {
+    auto it = std::lower_bound(readings.begin(), readings.end(), bpm);
+    readings.insert(it, bpm);
+}
+
+bool TempoEstimator::update() {
+    if (readings.size() == 0) {
+        return false;
+    }
+
+    lastReading = readings[readings.size() / 2];
+    addValue(lastReading);
+
+    // --- Dynamic Rounding Logic (relocated from calculateMedianBPM) ---
+    double median_double = calculateMedianBPM();
+    double corrected_bpm = median_double - (median_double * 0.015);
+
+    double floor_bpm = std::floor(corrected_bpm);
+    double ceil_bpm = std::ceil(corrected_bpm);
+    double rounded_bpm;
+
+    bool strongEvidence = (bpm > 0 &&
+                           ((corrected_bpm > bpm && corrected_bpm > ceil_bpm + 0.1) ||
+                            (corrected_bpm < bpm && corrected_bpm < floor_bpm + 0.1)));
 
-void addValue(std::deque<double>& timeWindow, std::vector<double>& sortedWindow, double value, size_t windowSize) {
+    if (strongEvidence) {
+        roundingTolerance = INITIAL_ROUNDING_TOLERANCE;
+        rounded_bpm = std::round(corrected_bpm);
+    } else if (std::abs(corrected_bpm - floor_bpm) < roundingTolerance || std::abs(corrected_bpm - ceil_bpm) < roundingTolerance) {
+        rounded_bpm = std::round(corrected_bpm);
+        if (rounded_bpm == bpm) {
+            roundingTolerance = std::max(MIN_ROUNDING_TOLERANCE, roundingTolerance - TOLERANCE_SHRINK_RATE);
+        } else {
+            roundingTolerance = INITIAL_ROUNDING_TOLERANCE;
+        }
+    } else {
+        if (corrected_bpm < bpm) {
+            rounded_bpm = std::ceil(corrected_bpm);
+        } else {
+            rounded_bpm = std::floor(corrected_bpm);
+        }
+        roundingTolerance = std::min(MAX_ROUNDING_TOLERANCE, roundingTolerance + TOLERANCE_GROWTH_RATE);
+    }
+
+    correctedBpm = corrected_bpm;
+    bpm = rounded_bpm;
+    readings.clear();
+    return true;
+}
+
+void TempoEstimator::addValue(double value) {
+    const size_t windowSize = BUFFER_SIZE;
     if (value < 100) {
         value *= 2;
     }
 
     if (timeWindow.size() >= windowSize) {
-        double currentMedian = *g_BPM;
+        double currentMedian = bpm;
         double min_val = sortedWindow.front();
         double max_val = sortedWindow.back();
         
@@ -66,11 +177,12 @@ void addValue(std::deque<double>& timeWindow, std::vector<double>& sortedWindow,
     }
 }
 
-double calculateMedianBPM(const std::vector<double>& window) {
+double TempoEstimator::calculateMedianBPM() {
+    const std::vector<double>& window = sortedWindow;
     if (window.empty()) {
         return 0;
     }
-     double currentBPM = *g_BPM;
+     double currentBPM = bpm;
 
     std::vector<double> sortedBPMs(window.begin(), window.end());
     std::sort(sortedBPMs.begin(), sortedBPMs.end());
@@ -118,211 +230,697 @@ double calculateMedianBPM(const std::vector<double>& window) {
     return rounded_bpm;
 }
 
-static int paCallbackMethod(const void* inputBuffer, void* outputBuffer,
-    unsigned long framesPerBuffer,
-    const PaStreamCallbackTimeInfo* timeInfo,
-    PaStreamCallbackFlags statusFlags,
-    void* userData) {
-    auto data = reinterpret_cast<AudioData*>(userData);
-    const float *input_data = reinterpret_cast<const float*>(inputBuffer);
-    
-    std::lock_guard<std::mutex> lock(data->mtx);
-
-    if (inputBuffer == NULL) {
-        data->buffer.assign(framesPerBuffer, 0.0f);
-    } else {
-        data->buffer.assign(input_data, input_data + framesPerBuffer);
+TempogramEstimator::TempogramEstimator(double frameRate, double minBpm, double maxBpm) :
+    frameRate(frameRate),
+    minBpm(minBpm),
+    maxBpm(maxBpm),
+    decay(std::exp2(-1.0 / (TEMPOGRAM_HALF_LIFE * frameRate))) {
+    // Lags out to the highest multiple of the slowest tempo, plus one to interpolate
+    size_t lags = static_cast<size_t>(std::ceil(TEMPOGRAM_MULTIPLES * 60.0 * frameRate / minBpm)) + 2;
+    recent.assign(lags, 0.0);
+    autocorrelation.assign(lags, 0.0);
+
+    // Flat over an octave, leaning towards the middle of a wider range
+    double centre = std::sqrt(minBpm * maxBpm);
+    double octaves = std::max(1.0, std::log2(maxBpm / minBpm));
+    for (double tempo = minBpm; tempo <= maxBpm; tempo += TEMPOGRAM_BIN_BPM) {
+        double distance = std::log2(tempo / centre) / octaves;
+        prior.push_back(std::exp(-0.5 * distance * distance));
     }
-    return paContinue;
 }
 
-PaDeviceIndex listAndSelectInputDevice() {
-    PaDeviceIndex inputDeviceIndex = Pa_GetDefaultInputDevice();
-    const PaDeviceInfo* deviceInfo;
-    int numDevices = Pa_GetDeviceCount();
-
-    if (numDevices < 0) {
-        std::cerr << "PortAudio error: Failed to get device count." << std::endl;
-        return paNoDevice;
+void TempogramEstimator::addFrame(double value) {
+    // Faded like the autocorrelation, and divided by its total weight so it isn't dragged towards 0 at first
+    meanSum = decay * meanSum + value;
+    meanWeight = decay * meanWeight + 1.0;
+    double mean = meanSum / meanWeight;
+    const size_t lags = recent.size();
+    size_t newest = frameCount % lags;
+    recent[newest] = value - mean;
+    ++frameCount;
+
+    size_t available = static_cast<size_t>(std::min<uint64_t>(frameCount, lags));
+    for (size_t lag = 0; lag < available; ++lag) {
+        autocorrelation[lag] = decay * autocorrelation[lag] + recent[newest] * recent[(newest + lags - lag) % lags];
     }
+}
 
-    std::cout << "Available Audio Input Devices:" << std::endl;
-    std::vector<PaDeviceIndex> inputDeviceList;
+bool TempogramEstimator::update() {
+    // Wait for the longest lag
+    if (frameCount < recent.size() || autocorrelation[0] <= 0.0) {
+        return false;
+    }
 
-    for (int i = 0; i < numDevices; ++i) {
-        deviceInfo = Pa_GetDeviceInfo(i);
-        if (deviceInfo->maxInputChannels > 0) {
-            std::cout << "  [" << inputDeviceList.size() << "] " << deviceInfo->name;
-            if (i == Pa_GetDefaultInputDevice()) {
-                std::cout << " (Default)";
-            }
-            std::cout << std::endl;
-            inputDeviceList.push_back(i);
+    auto combAt = [this](double tempo) {
+        double period = 60.0 * frameRate / tempo;
+        double sum = 0.0;
+        for (int multiple = 1; multiple <= TEMPOGRAM_MULTIPLES; ++multiple) {
+            sum += getAutocorrelation(multiple * period);
+        }
+        return sum / (TEMPOGRAM_MULTIPLES * autocorrelation[0]);
+    };
+    size_t best = 0;
+    double bestScore = -std::numeric_limits<double>::max();
+    std::vector<double> scores(prior.size());
+    for (size_t i = 0; i < prior.size(); ++i) {
+        scores[i] = combAt(minBpm + i * TEMPOGRAM_BIN_BPM) * prior[i];
+        if (scores[i] > bestScore) {
+            bestScore = scores[i];
+            best = i;
         }
     }
 
-    if (inputDeviceList.empty()) {
-        std::cerr << "No audio input devices found. Exiting." << std::endl;
-        return paNoDevice;
+    // Between candidate tempos, from the curve through the best and its neighbours
+    double offset = 0.0;
+    if (best > 0 && best + 1 < scores.size()) {
+        double curvature = scores[best - 1] - 2.0 * scores[best] + scores[best + 1];
+        if (curvature < 0.0) {
+            offset = std::clamp(0.5 * (scores[best - 1] - scores[best + 1]) / curvature, -0.5, 0.5);
+        }
+    }
+    double estimate = minBpm + (best + offset) * TEMPOGRAM_BIN_BPM;
+    confidence = std::clamp(combAt(estimate), 0.0, 1.0);
+    if (confidence < TEMPOGRAM_MIN_CONFIDENCE) {
+        return false;
     }
 
-    int userChoice = 0;
-    while (true) {
-        std::cout << "Select a device by number: ";
-        std::cin >> userChoice;
-        if (std::cin.fail() || userChoice < 0 || userChoice >= inputDeviceList.size()) {
-            std::cin.clear();
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-            std::cout << "Invalid selection. Please enter a valid number." << std::endl;
-        } else {
-            return inputDeviceList[userChoice];
-        }
+    if (bpm <= 0.0 || std::abs(estimate - bpm) >= TEMPOGRAM_HYSTERESIS) {
+        bpm = std::round(estimate * 10.0) / 10.0;
     }
+    return true;
 }
 
-PaError bpmDetectionInit() {
-    PaError err;
-    
+double TempogramEstimator::getAutocorrelation(double lag) const {
+    size_t lower = std::min(static_cast<size_t>(lag), autocorrelation.size() - 2);
+    double fraction = lag - lower;
+    return autocorrelation[lower] * (1.0 - fraction) + autocorrelation[lower + 1] * fraction;
+}
+
+bool bpmDetectionInit(const DetectionSettings& settings, std::unique_ptr<AudioSource> source) {
     tempo_detector = new_aubio_tempo("specflux", WIN_SIZE, HOP_SIZE, SAMPLE_RATE);
     if (!tempo_detector) {
         std::cerr << "Error creating aubio tempo detector." << std::endl;
-        return 1;
-    }
-
-    err = Pa_Initialize();
-    if (err != paNoError) {
-        std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
-        return err;
-    }
-
-    PaDeviceIndex selectedDevice = listAndSelectInputDevice();
-    if (selectedDevice == paNoDevice) {
-        Pa_Terminate();
-        del_aubio_tempo(tempo_detector);
-        return 1;
-    }
-
-    PaStreamParameters inputParameters;
-    inputParameters.device = selectedDevice;
-    inputParameters.channelCount = 1;
-    inputParameters.sampleFormat = paFloat32;
-    inputParameters.suggestedLatency = Pa_GetDeviceInfo(selectedDevice)->defaultLowInputLatency;
-    inputParameters.hostApiSpecificStreamInfo = NULL;
-
-    err = Pa_OpenStream(&stream,
-        &inputParameters,
-        NULL,
-        SAMPLE_RATE,
-        HOP_SIZE,
-        paClipOff,
-        paCallbackMethod,
-        &audio_data);
-    if (err != paNoError) {
-        std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
-        Pa_Terminate();
-        del_aubio_tempo(tempo_detector);
-        return err;
-    }
-
-    err = Pa_StartStream(stream);
-    if (err != paNoError) {
-        std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
-        Pa_Terminate();
-        del_aubio_tempo(tempo_detector);
-        return err;
+        return false;
     }
-    
-    std::cout << "\nListening on device: " << Pa_GetDeviceInfo(selectedDevice)->name << std::endl;
+    uint_t bufferFrames = HOP_SIZE;
+    if (settings.engine == DetectionEngine::Onset) {
+        onsetEngine = std::make_unique<OnsetTempoEngine>(SAMPLE_RATE, settings.hopSize);
+        bufferFrames = settings.hopSize;
+    } else if (settings.engine == DetectionEngine::Aubio) {
+        onset_detector = new_aubio_onset("specflux", WIN_SIZE, HOP_SIZE, SAMPLE_RATE);
+        if (!onset_detector) {
+            std::cerr << "Error creating aubio onset detector." << std::endl;
+            return false;
+        }
+        tempogram = std::make_unique<TempogramEstimator>(static_cast<double>(SAMPLE_RATE) / HOP_SIZE, settings.minBpm, settings.maxBpm);
+    }
+    input_buffer = new_fvec(HOP_SIZE);
+    tempo = new_fvec(1);
+    levelMeter = std::make_unique<AudioLevelMeter>(SAMPLE_RATE, bufferFrames);
+
+    analysisHop = bufferFrames;
+
+    if (!source || !source->start(SAMPLE_RATE, static_cast<double>(bufferFrames) / SAMPLE_RATE, audioRing)) {
+        return false;
+    }
+    audioSource = std::move(source);
+    resampler = std::make_unique<AudioResampler>(static_cast<uint32_t>(std::lround(audioSource->getSampleRate())), SAMPLE_RATE);
+    std::cout << "\nListening to " << audioSource->getDescription() << std::endl;
+    if (!resampler->isPassthrough()) {
+        std::cout << "Resampling to " << SAMPLE_RATE << " Hz on the analysis thread (" << resampler->getUp() << "/"
+                  << resampler->getDown() << " polyphase, " << RESAMPLER_TAPS << " taps)" << std::endl;
+    }
+
+    // Beats are dated from the capture time of each buffer, so these only delay detection, not the beat grid
+    uint_t windowFrames = onsetEngine ? static_cast<uint_t>(onsetEngine->getWindowSize()) : WIN_SIZE;
+    std::cout << "Audio latency: input " << audioSource->getInputLatency() * 1000.0 << " ms, hop "
+              << bufferFrames * 1000.0 / SAMPLE_RATE << " ms, analysis window " << windowFrames * 1000.0 / SAMPLE_RATE << " ms ("
+              << (onsetEngine ? "onset engine" : tempogram ? "aubio, tempogram" : "aubio, median") << ")" << std::endl;
     std::cout << "Press Ctrl+C to stop." << std::endl;
 
-    return paNoError;
+    return true;
 }
 
-void bpmDetectionLoop() {
-    while (true) {
-        std::lock_guard<std::mutex> lock(audio_data.mtx);
-        
-        if (!audio_data.buffer.empty()) {
-            fvec_t* input_buffer = new_fvec(audio_data.buffer.size());
-            if (!input_buffer) {
-                std::cerr << "ERROR: Failed to create new_fvec!" << std::endl;
-                // Proper error handling and cleanup would be needed here
-                continue;
-            }
+// Band levels of the hop, published for the frame loop
+static const AudioLevels& publishLevels(const float* samples, int64_t captureNs) {
+    const AudioLevels& levels = levelMeter->process(samples, captureNs + static_cast<int64_t>(analysisHop * 1e9 / SAMPLE_RATE));
+    g_audioLevels.store(levels);
+    return levels;
+}
+
+// The onset engine's side of the live loop: beats into the phase tracker, the estimate into g_BPM
+static void runOnsetEngine(const float* samples, std::chrono::steady_clock::time_point timestamp) {
+    // Engine time of the first sample of this hop
+    double hopStart = onsetEngine->getTime();
+    bool isUpdated = onsetEngine->process(samples);
+
+    if (onsetEngine->isBeat()) {
+        auto beatTime = timestamp + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(onsetEngine->getBeatTime() - hopStart));
+        g_beatPhase.onBeat(beatTime, onsetEngine->getBpm());
+    }
+    if (isUpdated) {
+        *g_BPM = onsetEngine->getBpm();
+        std::cout << "\t\t\t  [ onset engine ] -> " << onsetEngine->getBpm() << " ---" << '\r' << std::flush;
+    }
+}
 
-            for (size_t i = 0; i < audio_data.buffer.size(); ++i) {
-                input_buffer->data[i] = audio_data.buffer[i];
+// aubio's side of the live loop
+static void runAubio(const float* samples, std::chrono::steady_clock::time_point timestamp) {
+    std::copy(samples, samples + HOP_SIZE, input_buffer->data);
+    aubio_tempo_do(tempo_detector, input_buffer, tempo);
+    processedFrames += HOP_SIZE;
+
+    // A beat in this hop: place it in time from how many samples ago aubio put it
+    if (tempo->data[0] != 0) {
+        double samplesAgo = static_cast<double>(processedFrames) - static_cast<double>(aubio_tempo_get_last(tempo_detector));
+        double secondsIntoBuffer = (static_cast<double>(HOP_SIZE) - samplesAgo) / SAMPLE_RATE;
+        auto beatTime = timestamp + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(secondsIntoBuffer));
+        g_beatPhase.onBeat(beatTime, *g_BPM);
+    }
+
+    // The tempo's output is spent, so it takes the onset detector's
+    if (onset_detector) {
+        aubio_onset_do(onset_detector, input_buffer, tempo);
+        tempogram->addFrame(aubio_onset_get_descriptor(onset_detector));
+    }
+
+    // Intervals on the audio's clock, which a file source may run faster than the wall clock
+    auto now = timestamp;
+
+    if (tempogram) {
+        if (now - lastReadingTime >= READ_INTERVAL) {
+            if (tempogram->update()) {
+                *g_BPM = tempogram->getBpm();
+                g_tempoConfidence.store(tempogram->getConfidence());
+                std::cout << "\t\t\t  [ tempogram ] -> " << tempogram->getBpm() << " (confidence " << tempogram->getConfidence() << ") ---" << '\r' << std::flush;
             }
+            lastReadingTime = now;
+        }
+        return;
+    }
+
+    if (now - lastReadingTime >= READ_INTERVAL) {
+        estimator.addReading(aubio_tempo_get_bpm(tempo_detector));
+        lastReadingTime = now;
+    }
 
-            fvec_t* tempo = new_fvec(1);
-            if (!tempo) {
-                std::cerr << "ERROR: Failed to create new_fvec for tempo!" << std::endl;
-                del_fvec(input_buffer);
-                continue;
+    if (now - lastCalculationTime >= CALCULATION_INTERVAL) {
+        if (estimator.update()) {
+            *g_BPM = estimator.getBpm();
+
+            std::cout << "\t\t\t  [ ";
+            for (auto n : estimator.getWindow()) {
+                std::cout << n << " ";
             }
+            std::cout << " ] -> " << estimator.getLastReading() << " - " << estimator.getCorrectedBpm() << " - " << estimator.getBpm() << " - " << estimator.getTolerance() << " ---" << '\r' << std::flush;
+        }
+        lastCalculationTime = now;
+    }
+}
+
+// Resamples a block from the source and analyses every whole hop there is
+static void analyseBlock(const AudioBlock& block) {
+    const double sourceRate = audioSource->getSampleRate();
+    const uint64_t blockStart = sourceFrames;
+    sourceFrames += block.frames;
+
+    auto resampleStart = std::chrono::steady_clock::now();
+    resampler->process(block.samples.data(), block.frames, analysisSamples);
+    resampleTime += std::chrono::steady_clock::now() - resampleStart;
+    if (!resampler->isPassthrough() && !isResampleCostReported && sourceFrames >= RESAMPLE_REPORT_SECONDS * sourceRate) {
+        double cpuMs = std::chrono::duration<double, std::milli>(resampleTime).count();
+        std::cout << std::endl << "Resampling " << sourceRate << " -> " << SAMPLE_RATE << " Hz: "
+                  << cpuMs / (sourceFrames / sourceRate) << " ms CPU per second of audio" << std::endl;
+        isResampleCostReported = true;
+    }
+
+    size_t offset = 0;
+    for (; offset + analysisHop <= analysisSamples.size(); offset += analysisHop, analysedFrames += analysisHop) {
+        // Dated from where the hop's first sample falls in this block
+        double sourcePosition = resampler->getInputPosition(analysedFrames) - static_cast<double>(blockStart);
+        int64_t captureNs = block.captureNs + static_cast<int64_t>(sourcePosition * 1e9 / sourceRate);
+        auto timestamp = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(captureNs)));
+
+        const float* samples = analysisSamples.data() + offset;
+        const AudioLevels& levels = publishLevels(samples, captureNs);
+        if (onsetEngine) {
+            runOnsetEngine(samples, timestamp);
+        } else {
+            runAubio(samples, timestamp);
+        }
+        g_meter.addHop(levels, g_beatPhase.getPhase());
+    }
+    analysisSamples.erase(analysisSamples.begin(), analysisSamples.begin() + offset);
+}
+
+void bpmDetectionLoop() {
+    AudioBlock block;
+    uint64_t reportedDrops = 0;
+    while (!isDetectionStopping.load()) {
+        if (!audioRing.tryPop(block)) {
+            std::this_thread::sleep_for(AUDIO_POLL_INTERVAL);
+            continue;
+        }
+        analyseBlock(block);
+
+        uint64_t drops = audioSource->getDroppedBlocks();
+        if (drops != reportedDrops) {
+            std::cerr << std::endl << "Audio analysis fell behind, " << drops << " blocks dropped so far." << std::endl;
+            reportedDrops = drops;
+        }
+    }
+    audioSource->stop();
+}
+
+void bpmDetectionStop() {
+    isDetectionStopping.store(true);
+}
+
+void BeatPhaseTracker::onBeat(std::chrono::steady_clock::time_point beatTime, double referenceBpm) {
+    if (referenceBpm <= 0.0) {
+        return;
+    }
+    double newReferencePeriod = 60.0 / referenceBpm;
+    int64_t beatNs = std::chrono::duration_cast<std::chrono::nanoseconds>(beatTime.time_since_epoch()).count();
+
+    // First beat, or the estimate moved too far for the loop to follow: start over on this beat
+    if (!seeded || std::abs(newReferencePeriod - referencePeriod) / referencePeriod > PLL_RELOCK_TEMPO_CHANGE) {
+        // Keep counting beats across a re-seed
+        double beat = seeded ? std::round(phase.anchorBeat + (beatNs - phase.anchorNs) / 1e9 / phase.periodSec) : 0.0;
+        phase = { beatNs, beat, newReferencePeriod, false };
+        referencePeriod = newReferencePeriod;
+        seeded = true;
+        hits = 0;
+        misses = 0;
+        publish();
+        return;
+    }
+    referencePeriod = newReferencePeriod;
+
+    double beatsSinceAnchor = (beatNs - phase.anchorNs) / 1e9 / phase.periodSec;
+    double nearestBeat = std::round(beatsSinceAnchor);
+    double errorSec = (beatsSinceAnchor - nearestBeat) * phase.periodSec;
+
+    if (std::abs(errorSec) > PLL_CAPTURE_WINDOW * phase.periodSec) {
+        // Off the grid: an offbeat or a false detection, unless it keeps happening
+        if (++misses >= PLL_MAX_MISSES) {
+            phase = { beatNs, std::round(phase.anchorBeat + beatsSinceAnchor), phase.periodSec, false };
+            hits = 0;
+            misses = 0;
+            publish();
+        }
+        return;
+    }
+    misses = 0;
+
+    // Move the anchor to this beat, part of the way from the prediction to the detection
+    double predictedNs = phase.anchorNs + nearestBeat * phase.periodSec * 1e9;
+    phase.anchorNs = static_cast<int64_t>(predictedNs + PLL_PHASE_GAIN * errorSec * 1e9);
+    phase.anchorBeat += nearestBeat;
+    phase.periodSec += PLL_PERIOD_GAIN * errorSec / std::max(nearestBeat, 1.0);
+    phase.periodSec = std::clamp(phase.periodSec, referencePeriod * (1.0 - PLL_MAX_PERIOD_TRIM), referencePeriod * (1.0 + PLL_MAX_PERIOD_TRIM));
+
+    hits = std::min(hits + 1, PLL_LOCK_BEATS);
+    phase.locked = hits >= PLL_LOCK_BEATS;
+    publish();
+}
+
+void BeatPhaseTracker::publish() {
+    published.store(phase);
+}
+
+MeterTracker::MeterTracker() :
+    recentBeats(2 * METER_NOVELTY_BARS * METER_BEATS_PER_BAR),
+    recentNovelty(METER_BEATS_PER_BAR + 1, 0.0),
+    barScores(METER_CYCLE_BARS * METER_BEATS_PER_BAR, 0.0),
+    phraseScores(METER_CYCLE_BARS * METER_BEATS_PER_BAR, 0.0),
+    barDecay(std::exp2(-1.0 / METER_BAR_HALF_LIFE)),
+    phraseDecay(std::exp2(-1.0 / METER_PHRASE_HALF_LIFE)) {}
+
+void MeterTracker::addHop(const AudioLevels& levels, const BeatPhase& phase) {
+    if (!phase.locked || phase.periodSec <= 0.0) {
+        return;
+    }
+    double position = phase.anchorBeat + (levels.captureNs - phase.anchorNs) / 1e9 / phase.periodSec;
+    int64_t beat = static_cast<int64_t>(std::floor(position));
+
+    // A hop that falls back behind the beat, after the grid is pulled back, still counts towards it
+    if (beatHops > 0 && beat > currentBeat) {
+        closeBeat();
+        if (beat > currentBeat + 1) {
+            // The grid jumped, so the recent beats are not the ones before this one
+            closedBeats = 0;
+            noveltyCount = 0;
+        }
+    }
+    if (beatHops == 0) {
+        currentBeat = beat;
+        accent = 0.0f;
+        bandSums.fill(0.0f);
+    }
+
+    for (size_t band = 0; band < bandSums.size(); ++band) {
+        bandSums[band] += levels.bands[band];
+    }
+    if (position - currentBeat < METER_ACCENT_WINDOW) {
+        accent = std::max(accent, levels.bands[static_cast<size_t>(AudioBand::Kick)]);
+    }
+    ++beatHops;
+}
 
-            aubio_tempo_do(tempo_detector, input_buffer, tempo);
-            
-            auto now = std::chrono::steady_clock::now();
-            
-            if (now - lastReadingTime >= READ_INTERVAL) {
-                double bpm = aubio_tempo_get_bpm(tempo_detector);
-                auto it = std::lower_bound(lastReadings.begin(), lastReadings.end(), bpm);
-                lastReadings.insert(it, bpm);
-                lastReadingTime = now;
+void MeterTracker::closeBeat() {
+    const size_t cycle = barScores.size();
+    const size_t history = recentBeats.size();
+    const size_t noveltyBeats = history / 2;
+
+    BandLevels& levels = recentBeats[closedBeats % history];
+    for (size_t band = 0; band < levels.size(); ++band) {
+        levels[band] = std::log(bandSums[band] / beatHops + 1e-4f);
+    }
+    beatHops = 0;
+
+    // Features against their running means, so only what stands out scores.
+    // Changes of level are measured against at least METER_MIN_CHANGE, so
+    // the small ones of a steady loop do not.
+    auto score = [](double value, double& mean, double floor) {
+        mean = mean > 0.0 ? mean + (value - mean) * METER_MEAN_RATE : value;
+        return std::max(value / std::max(mean, floor) - 1.0, 0.0);
+    };
+
+    // Any change of timbre from the beat before marks a bar. What comes in
+    // since the same beat of the bar before, a crash or an entry, marks a
+    // phrase; the rhythm within the bar cancels out.
+    const size_t bar = METER_BEATS_PER_BAR;
+    double barScore = score(accent, accentMean, 0.0);
+    double phraseScore = 0.0;
+    if (closedBeats > 0) {
+        const BandLevels& previous = recentBeats[(closedBeats - 1) % history];
+        double change = 0.0;
+        for (size_t band = 0; band < levels.size(); ++band) {
+            change += std::abs(levels[band] - previous[band]);
+        }
+        barScore += score(change, changeMean, METER_MIN_CHANGE);
+    }
+    if (closedBeats >= bar) {
+        const BandLevels& barBefore = recentBeats[(closedBeats - bar) % history];
+        double rise = 0.0;
+        for (size_t band = 0; band < levels.size(); ++band) {
+            rise += std::max(levels[band] - barBefore[band], 0.0f);
+        }
+        phraseScore = score(rise, riseMean, METER_MIN_CHANGE);
+    }
+    for (double& value : barScores) {
+        value *= barDecay;
+    }
+    for (double& value : phraseScores) {
+        value *= phraseDecay;
+    }
+    const int64_t cycleLength = static_cast<int64_t>(cycle);
+    size_t cycleBeat = static_cast<size_t>((currentBeat % cycleLength + cycleLength) % cycleLength);
+    barScores[cycleBeat] += barScore;
+    phraseScores[cycleBeat] += phraseScore;
+    ++closedBeats;
+
+    // The bars either side of the beat noveltyBeats ago, now that the ones after it are in
+    if (closedBeats >= history) {
+        BandLevels before{};
+        BandLevels after{};
+        for (size_t i = 0; i < noveltyBeats; ++i) {
+            const BandLevels& older = recentBeats[(closedBeats + i) % history];
+            const BandLevels& newer = recentBeats[(closedBeats + noveltyBeats + i) % history];
+            for (size_t band = 0; band < before.size(); ++band) {
+                before[band] += older[band];
+                after[band] += newer[band];
+            }
+        }
+        double novelty = 0.0;
+        for (size_t band = 0; band < before.size(); ++band) {
+            novelty += std::abs(after[band] - before[band]) / noveltyBeats;
+        }
+        double noveltyScore = score(novelty, noveltyMean, METER_MIN_CHANGE);
+
+        // Novelty rises and falls over the whole window, so only its peak within half a bar scores
+        const size_t peakBeats = recentNovelty.size();
+        const size_t radius = peakBeats / 2;
+        recentNovelty[noveltyCount % peakBeats] = noveltyScore;
+        ++noveltyCount;
+        if (noveltyCount >= peakBeats) {
+            double centre = recentNovelty[(noveltyCount - 1 - radius) % peakBeats];
+            bool isPeak = centre > 0.0;
+            for (size_t i = 0; i < peakBeats && isPeak; ++i) {
+                double other = recentNovelty[(noveltyCount + i) % peakBeats];
+                isPeak = i < radius ? centre > other : centre >= other;
             }
-            
-            if (now - lastCalculationTime >= CALCULATION_INTERVAL) {
-                if (lastReadings.size() > 0) {
-                    double last_reading = lastReadings[2]; 
-                    addValue(timeWindow, sortedWindow, last_reading, BUFFER_SIZE);
-                    
-                    // --- Dynamic Rounding Logic (relocated from calculateMedianBPM) ---
-                    double median_double = calculateMedianBPM(sortedWindow);
-                    double corrected_bpm = median_double - (median_double * 0.015);
-
-                    double floor_bpm = std::floor(corrected_bpm);
-                    double ceil_bpm = std::ceil(corrected_bpm);
-                    double rounded_bpm;
-                    
-                    bool strongEvidence = (*g_BPM > 0 && 
-                                           ((corrected_bpm > *g_BPM && corrected_bpm > ceil_bpm + 0.1) ||
-                                            (corrected_bpm < *g_BPM && corrected_bpm < floor_bpm + 0.1)));
-
-                    if (strongEvidence) {
-                        roundingTolerance = INITIAL_ROUNDING_TOLERANCE;
-                        rounded_bpm = std::round(corrected_bpm);
-                    } else if (std::abs(corrected_bpm - floor_bpm) < roundingTolerance || std::abs(corrected_bpm - ceil_bpm) < roundingTolerance) {
-                        rounded_bpm = std::round(corrected_bpm);
-                        if (rounded_bpm == *g_BPM) {
-                            roundingTolerance = std::max(MIN_ROUNDING_TOLERANCE, roundingTolerance - TOLERANCE_SHRINK_RATE);
-                        } else {
-                            roundingTolerance = INITIAL_ROUNDING_TOLERANCE;
-                        }
-                    } else {
-                        if (corrected_bpm < *g_BPM) {
-                            rounded_bpm = std::ceil(corrected_bpm);
-                        } else {
-                            rounded_bpm = std::floor(corrected_bpm);
-                        }
-                        roundingTolerance = std::min(MAX_ROUNDING_TOLERANCE, roundingTolerance + TOLERANCE_GROWTH_RATE);
-                    }
-
-                    *g_BPM = rounded_bpm;
-                    
-                    std::cout << "\t\t\t  [ ";
-                    for (auto n : sortedWindow) {
-                        std::cout << n << " ";
-                    }
-                    std::cout << " ] -> " << last_reading << " - " << corrected_bpm << " - " << rounded_bpm << " - " << roundingTolerance << " ---" << '\r' << std::flush;
-                }
-                lastCalculationTime = now;
-                lastReadings.clear();
+            if (isPeak) {
+                phraseScores[(cycleBeat + 2 * cycle - noveltyBeats + 1 - radius) % cycle] += centre;
             }
+        }
+    }
+
+    publish();
+}
+
+double MeterTracker::fold(const std::vector<double>& scores, size_t offset, size_t stride) {
+    double sum = 0.0;
+    for (size_t beat = offset % stride; beat < scores.size(); beat += stride) {
+        sum += scores[beat];
+    }
+    return sum;
+}
 
-            del_fvec(input_buffer);
-            del_fvec(tempo);
-            audio_data.buffer.clear();
+void MeterTracker::publish() {
+    const size_t cycle = barScores.size();
+    const size_t bar = METER_BEATS_PER_BAR;
+
+    // Best and runner-up of a set of candidates, as a confidence
+    auto confidence = [](double best, double second) { return best > 0.0 ? (best - std::max(second, 0.0)) / best : 0.0; };
+
+    // The downbeat: the beat of the bar where beats stand out, and where phrases change
+    size_t downbeat = 0;
+    double best = -1.0;
+    double second = -1.0;
+    for (size_t beat = 0; beat < bar; ++beat) {
+        double value = fold(barScores, beat, bar) + fold(phraseScores, beat, bar);
+        if (value > best) {
+            second = best;
+            best = value;
+            downbeat = beat;
+        } else if (value > second) {
+            second = value;
         }
     }
+    phase.barConfidence = confidence(best, second);
+
+    // The bar an 8-bar phrase starts on, then which of the 8-bar starts begin 16 and 32 bars
+    const size_t shortPhrase = 8 * bar;
+    size_t phraseStart = downbeat;
+    best = -1.0;
+    second = -1.0;
+    for (size_t start = downbeat; start < shortPhrase; start += bar) {
+        double value = fold(phraseScores, start, shortPhrase);
+        if (value > best) {
+            second = best;
+            best = value;
+            phraseStart = start;
+        } else if (value > second) {
+            second = value;
+        }
+    }
+    phase.phraseConfidence = confidence(best, second);
+    for (size_t length = shortPhrase * 2; length <= cycle; length *= 2) {
+        size_t later = phraseStart + length / 2;
+        if (fold(phraseScores, later, length) > fold(phraseScores, phraseStart, length)) {
+            phraseStart = later;
+        }
+    }
+
+    // The latest beat up to the current one at `cycleBeat` of a cycle `length` beats long
+    auto latest = [this](size_t cycleBeat, size_t length) {
+        const int64_t period = static_cast<int64_t>(length);
+        int64_t since = ((currentBeat - static_cast<int64_t>(cycleBeat)) % period + period) % period;
+        return static_cast<double>(currentBeat - since);
+    };
+    phase.downbeat = latest(downbeat, bar);
+    phase.phraseStart = latest(phraseStart, cycle);
+    published.store(phase);
+}
+
+void AudioBeatSource::capture(std::chrono::steady_clock::time_point now) {
+    phase = g_beatPhase.getPhase();
+    meter = g_meter.getPhase();
+    bool shouldTrack = phase.locked && phase.periodSec > 0.0 && manualBpm == 0.0 && tempoOffset == 0.0;
+    if (shouldTrack == isTracking) {
+        return;
+    }
+
+    double beat = getBeat(now);
+    isTracking = shouldTrack;
+    if (isTracking) {
+        // Snap onto the detected grid, which moves the beat by less than half a beat
+        trackedBeatOffset = std::round(beat - getTrackedBeat(now));
+    } else {
+        keepBeat(now, beat);
+    }
+}
+
+double AudioBeatSource::getBpm() const {
+    if (isTracking) {
+        return 60.0 / phase.periodSec;
+    }
+    return (manualBpm > 0.0 ? manualBpm : *g_BPM) + tempoOffset;
+}
+
+double AudioBeatSource::getBeat(std::chrono::steady_clock::time_point now) const {
+    return isTracking ? getTrackedBeat(now) + trackedBeatOffset : getFreeBeat(now);
+}
+
+double AudioBeatSource::getPhraseStart() const {
+    if (!isTracking || meter.barConfidence < METER_MIN_CONFIDENCE) {
+        return 0.0;
+    }
+    // Without a clear phrase, phrases at least start on a downbeat
+    double start = meter.phraseConfidence >= METER_MIN_CONFIDENCE ? meter.phraseStart : meter.downbeat;
+    return start + trackedBeatOffset;
+}
+
+double AudioBeatSource::getTrackedBeat(std::chrono::steady_clock::time_point now) const {
+    int64_t nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+    return phase.anchorBeat + (nowNs + detectionDelayNs - phase.anchorNs) / 1e9 / phase.periodSec;
+}
+
+double AudioBeatSource::getFreeBeat(std::chrono::steady_clock::time_point now) const {
+    double beatDurationSec = 60.0 / getBpm();
+    double elapsedSeconds = std::chrono::duration<double>(now - syncTime).count();
+    return elapsedSeconds / beatDurationSec;
+}
+
+void AudioBeatSource::sync(std::chrono::steady_clock::time_point now) {
+    syncTime = now;
+    if (isTracking) {
+        trackedBeatOffset = -std::round(getTrackedBeat(now));
+    }
+}
+
+void AudioBeatSource::setTempo(std::chrono::steady_clock::time_point now, double bpm) {
+    double beat = getBeat(now);
+    manualBpm = std::max(bpm, 0.0);
+    tempoOffset = 0.0;
+    isTracking = false;
+    keepBeat(now, beat);
+}
+
+void AudioBeatSource::nudgeTempo(std::chrono::steady_clock::time_point now, double deltaBpm) {
+    double beat = getBeat(now);
+    tempoOffset += deltaBpm;
+    isTracking = false;
+    keepBeat(now, beat);
+}
+
+void AudioBeatSource::keepBeat(std::chrono::steady_clock::time_point now, double beat) {
+    if (getBpm() > 0.0) {
+        syncTime = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(beat * 60.0 / getBpm()));
+    }
+}
+
+// aubio may be built on FFTW, whose planner is not thread-safe
+static std::mutex aubioSetupMutex;
+
+OfflineBeatTracker::OfflineBeatTracker(uint_t sampleRate, const DetectionSettings& settings) :
+    sampleRate(sampleRate),
+    tempogram(static_cast<double>(sampleRate) / HOP_SIZE, settings.minBpm, settings.maxBpm),
+    // The live loop's intervals, counted in samples instead of wall time
+    readIntervalFrames(static_cast<uint64_t>(sampleRate * READ_INTERVAL.count() / 1000.0)),
+    calculationIntervalFrames(static_cast<uint64_t>(sampleRate * CALCULATION_INTERVAL.count() / 1000.0)),
+    nextReading(readIntervalFrames),
+    nextCalculation(calculationIntervalFrames) {
+    if (settings.engine == DetectionEngine::Onset) {
+        onsetEngine = std::make_unique<OnsetTempoEngine>(sampleRate, settings.hopSize);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(aubioSetupMutex);
+        tempoDetector = new_aubio_tempo("specflux", WIN_SIZE, HOP_SIZE, sampleRate);
+        if (tempoDetector && settings.engine == DetectionEngine::Aubio) {
+            onsetDetector = new_aubio_onset("specflux", WIN_SIZE, HOP_SIZE, sampleRate);
+        }
+    }
+    if (!tempoDetector) {
+        std::cerr << "Error creating aubio tempo detector." << std::endl;
+        return;
+    }
+    hop = new_fvec(HOP_SIZE);
+    tempo = new_fvec(1);
+    onset = new_fvec(1);
+}
+
+OfflineBeatTracker::~OfflineBeatTracker() {
+    if (hop) {
+        del_fvec(hop);
+    }
+    if (tempo) {
+        del_fvec(tempo);
+    }
+    if (onset) {
+        del_fvec(onset);
+    }
+    std::lock_guard<std::mutex> lock(aubioSetupMutex);
+    if (tempoDetector) {
+        del_aubio_tempo(tempoDetector);
+    }
+    if (onsetDetector) {
+        del_aubio_onset(onsetDetector);
+    }
+}
+
+bool OfflineBeatTracker::process(const float* samples) {
+    if (onsetEngine) {
+        bool isUpdated = onsetEngine->process(samples);
+        processedFrames += onsetEngine->getHopSize();
+        beatDetected = onsetEngine->isBeat();
+        if (beatDetected) {
+            auto beatTime = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(onsetEngine->getBeatTime())));
+            tracker.onBeat(beatTime, onsetEngine->getBpm());
+        }
+        return isUpdated;
+    }
+
+    std::copy(samples, samples + HOP_SIZE, hop->data);
+    aubio_tempo_do(tempoDetector, hop, tempo);
+    processedFrames += HOP_SIZE;
+    if (onsetDetector) {
+        aubio_onset_do(onsetDetector, hop, onset);
+        tempogram.addFrame(aubio_onset_get_descriptor(onsetDetector));
+    }
+
+    beatDetected = tempo->data[0] != 0;
+    if (beatDetected) {
+        double beatSec = aubio_tempo_get_last(tempoDetector) / sampleRate;
+        auto beatTime = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(beatSec)));
+        tracker.onBeat(beatTime, getBpm());
+    }
+
+    bool isUpdated = false;
+    if (onsetDetector) {
+        if (processedFrames >= nextReading) {
+            isUpdated = tempogram.update();
+            nextReading += readIntervalFrames;
+        }
+        return isUpdated;
+    }
+    if (processedFrames >= nextReading) {
+        estimator.addReading(aubio_tempo_get_bpm(tempoDetector));
+        nextReading += readIntervalFrames;
+    }
+    if (processedFrames >= nextCalculation) {
+        isUpdated = estimator.update();
+        nextCalculation += calculationIntervalFrames;
+    }
+    return isUpdated;
+}
+
+double OfflineBeatTracker::getBpm() const {
+    if (onsetEngine) {
+        return onsetEngine->getBpm();
+    }
+    return onsetDetector ? tempogram.getBpm() : estimator.getBpm();
 }
@@ -3,15 +3,20 @@
 
 #include <iostream>
 #include <vector>
+#include <array>
 #include <deque>
 #include <limits>
 #include <numeric>
 #include <algorithm>
 #include <aubio/aubio.h>
-#include <portaudio.h>
 #include <mutex>
 #include <memory> // For std::shared_ptr
 #include <chrono>
+#include <atomic>
+#include "AudioSource.h"
+#include "BeatSource.h"
+#include "SeqLock.h"
+#include "OnsetTempoEngine.h"
 
 // --- Global Constants ---
 extern const uint_t SAMPLE_RATE;
@@ -20,6 +25,8 @@ extern const uint_t WIN_SIZE;
 extern const uint_t HOP_SIZE;
 extern const std::chrono::milliseconds READ_INTERVAL;
 extern const std::chrono::milliseconds CALCULATION_INTERVAL;
+extern const std::chrono::milliseconds AUDIO_POLL_INTERVAL;
+extern const double RESAMPLE_REPORT_SECONDS;
 extern const size_t BUFFER_SIZE;
 extern const double PERCENTAGE_TOLERANCE;
 extern const double INITIAL_ROUNDING_TOLERANCE;
@@ -27,28 +34,310 @@ extern const double MIN_ROUNDING_TOLERANCE;
 extern const double MAX_ROUNDING_TOLERANCE;
 extern const double TOLERANCE_SHRINK_RATE;
 extern const double TOLERANCE_GROWTH_RATE;
+extern const double PLL_PHASE_GAIN;
+extern const double PLL_PERIOD_GAIN;
+extern const double PLL_CAPTURE_WINDOW;
+extern const double PLL_RELOCK_TEMPO_CHANGE;
+extern const double PLL_MAX_PERIOD_TRIM;
+extern const int PLL_LOCK_BEATS;
+extern const int PLL_MAX_MISSES;
+extern const double TEMPOGRAM_BIN_BPM;
+extern const int TEMPOGRAM_MULTIPLES;
+extern const double TEMPOGRAM_HALF_LIFE;
+extern const double TEMPOGRAM_MIN_CONFIDENCE;
+extern const double TEMPOGRAM_HYSTERESIS;
+extern const double DEFAULT_MIN_BPM;
+extern const double DEFAULT_MAX_BPM;
+extern const int METER_BEATS_PER_BAR;
+extern const int METER_CYCLE_BARS;
+extern const int METER_NOVELTY_BARS;
+extern const double METER_ACCENT_WINDOW;
+extern const double METER_BAR_HALF_LIFE;
+extern const double METER_PHRASE_HALF_LIFE;
+extern const double METER_MEAN_RATE;
+extern const double METER_MIN_CHANGE;
+extern const double METER_MIN_CONFIDENCE;
 
 // --- Data Structures ---
-struct AudioData {
-    std::vector<float> buffer;
-    std::mutex mtx;
+// Beat grid published by the phase tracker
+struct BeatPhase {
+    int64_t anchorNs; // steady_clock time of a beat
+    double anchorBeat; // Number of that beat since the tracker started
+    double periodSec;
+    bool locked;
+};
+
+// Phase-locked loop on the beats aubio detects. The rounded tempo estimate
+// seeds the period; every detected beat that lands near the predicted one
+// pulls the phase, and slowly the period, towards it. Detections far from the
+// grid are ignored, and a run of them re-seeds the loop. Only the audio
+// thread updates the tracker; any thread can read the grid.
+class BeatPhaseTracker {
+public:
+    // Audio thread. `beatTime` is when the detected beat was heard.
+    void onBeat(std::chrono::steady_clock::time_point beatTime, double referenceBpm);
+
+    BeatPhase getPhase() const { return published.load(); }
+
+private:
+    void publish();
+
+    BeatPhase phase{0, 0.0, 0.0, false};
+    bool seeded = false;
+    double referencePeriod = 0.0;
+    int hits = 0;
+    int misses = 0;
+    SeqLock<BeatPhase> published;
+};
+
+// Where bars and phrases begin, counted in the phase tracker's beats
+struct MeterPhase {
+    double downbeat; // A beat that starts a bar
+    double phraseStart; // A downbeat that starts a METER_CYCLE_BARS phrase; shorter phrases start every 8 or 16 bars from it
+    double barConfidence; // 0-1: how clearly one beat of the bar stands out
+    double phraseConfidence; // 0-1: the same for the bars of an 8-bar phrase
+};
+
+// Bar downbeats and phrase boundaries from the band levels, beat by beat on
+// the phase tracker's grid. Each beat is summed up by the kick level at its
+// start and its mean band levels. A beat with a heavier kick or a change in
+// timbre from the one before scores for its place in the bar; a beat where
+// the METER_NOVELTY_BARS after it sound different from those before scores
+// for its place in the phrase. Scores are kept per beat of a METER_CYCLE_BARS
+// cycle and fade, so the meter follows the music: a hop costs a few additions,
+// a beat one pass over the cycle. Only the audio thread updates the tracker;
+// any thread can read the phase.
+class MeterTracker {
+public:
+    MeterTracker();
+
+    // Audio thread, every hop, with the grid it was heard on. Nothing is
+    // counted until the grid is locked.
+    void addHop(const AudioLevels& levels, const BeatPhase& phase);
+
+    MeterPhase getPhase() const { return published.load(); }
+
+private:
+    using BandLevels = std::array<float, static_cast<size_t>(AudioBand::Count)>;
+
+    // Scores the beat whose hops have been summed, and publishes the meter
+    void closeBeat();
+    // Sum of `scores` over every `stride` beats of the cycle from `offset`
+    static double fold(const std::vector<double>& scores, size_t offset, size_t stride);
+    void publish();
+
+    int64_t currentBeat = 0;
+    int beatHops = 0;
+    float accent = 0.0f; // Loudest kick in the first METER_ACCENT_WINDOW of the beat
+    BandLevels bandSums{};
+
+    std::vector<BandLevels> recentBeats; // Log band levels of the last 2 * METER_NOVELTY_BARS bars, circular
+    size_t closedBeats = 0; // In a row, since the grid last jumped
+    std::vector<double> recentNovelty; // Scores of the last bar's phrase boundary candidates and one more, circular
+    size_t noveltyCount = 0;
+    double accentMean = 0.0;
+    double changeMean = 0.0;
+    double riseMean = 0.0;
+    double noveltyMean = 0.0;
+    std::vector<double> barScores; // Per beat of the cycle
+    std::vector<double> phraseScores;
+    double barDecay;
+    double phraseDecay;
+
+    MeterPhase phase{0.0, 0.0, 0.0, 0.0};
+    SeqLock<MeterPhase> published;
+};
+
+// The original estimate behind g_BPM, kept as DetectionEngine::AubioMedian:
+// aubio's tempo readings go through an outlier filter into a window whose
+// median is rounded to a whole BPM, with a tolerance that tightens while the
+// tempo holds and widens while it drifts. Driven by audio time, so the live
+// loop and the offline analyzer get the same answers: addReading() every
+// READ_INTERVAL, update() every CALCULATION_INTERVAL.
+class TempoEstimator {
+public:
+    void addReading(double bpm);
+    // Folds the readings since the last update into the window; false if there were none
+    bool update();
+
+    double getBpm() const { return bpm; }
+    const std::vector<double>& getWindow() const { return sortedWindow; }
+    double getLastReading() const { return lastReading; }
+    double getCorrectedBpm() const { return correctedBpm; }
+    double getTolerance() const { return roundingTolerance; }
+
+private:
+    void addValue(double value);
+    double calculateMedianBPM();
+
+    std::deque<double> timeWindow;
+    std::vector<double> sortedWindow;
+    std::vector<double> readings;
+    double roundingTolerance = INITIAL_ROUNDING_TOLERANCE;
+    double bpm = 0.0;
+    double lastReading = 0.0;
+    double correctedBpm = 0.0;
+};
+
+// Tempo from a running tempogram: the autocorrelation of the onset envelope,
+// updated every hop and fading with TEMPOGRAM_HALF_LIFE, so a hop costs one
+// multiply-add per lag however much audio the tempogram remembers. update()
+// runs a comb filter over it for every tempo in the preferred range, in steps
+// of TEMPOGRAM_BIN_BPM; keeping to that range settles the octave. The
+// confidence is how strongly the envelope repeats at the winning period, the
+// normalised autocorrelation averaged over its multiples.
+class TempogramEstimator {
+public:
+    // `frameRate` envelope values per second. [minBpm, maxBpm] should span an
+    // octave; a wider range leans towards its middle.
+    explicit TempogramEstimator(double frameRate, double minBpm = DEFAULT_MIN_BPM, double maxBpm = DEFAULT_MAX_BPM);
+
+    // One onset envelope value, every hop
+    void addFrame(double value);
+    // Reads the tempogram. False until the confidence reaches TEMPOGRAM_MIN_CONFIDENCE.
+    bool update();
+
+    double getBpm() const { return bpm; }
+    double getConfidence() const { return confidence; }
+
+private:
+    // Linearly interpolated between lags
+    double getAutocorrelation(double lag) const;
+
+    double frameRate;
+    double minBpm;
+    double maxBpm;
+    double decay; // Per hop
+    std::vector<double> recent; // The last autocorrelation.size() envelope values less the mean, circular
+    std::vector<double> autocorrelation; // Indexed by lag in hops
+    std::vector<double> prior; // Per candidate tempo
+    uint64_t frameCount = 0;
+    double meanSum = 0.0;
+    double meanWeight = 0.0;
+    double bpm = 0.0;
+    double confidence = 0.0;
+};
+
+// What the detection pipeline runs on: aubio's onset envelope into the tempogram,
+// aubio's tempo readings into the original median estimator, or the in-tree
+// onset engine at a shorter hop. All of them feed aubio's or the engine's
+// beats to the phase tracker.
+enum class DetectionEngine {
+    Aubio,
+    AubioMedian,
+    Onset,
+};
+
+struct DetectionSettings {
+    DetectionEngine engine = DetectionEngine::Aubio;
+    uint_t hopSize = HOP_SIZE; // Onset engine only
+    double minBpm = DEFAULT_MIN_BPM; // Preferred tempo range of the tempogram
+    double maxBpm = DEFAULT_MAX_BPM;
 };
 
 // --- Shared BPM Data (Thread-Safe) ---
 extern std::shared_ptr<double> g_BPM;
+extern std::atomic<double> g_tempoConfidence; // 0-1 behind g_BPM, 0 for estimators without one
+extern BeatPhaseTracker g_beatPhase;
+extern MeterTracker g_meter; // Bars and phrases on g_beatPhase's grid
+extern SeqLock<AudioLevels> g_audioLevels; // Latest hop's band levels, for the frame loop
+
+// The live detection pipeline, any DetectionEngine and the BeatPhaseTracker,
+// run on audio time instead of wall time, for files and synthetic signals.
+// Times are seconds from the first sample. Safe to use from several threads,
+// one tracker per thread.
+class OfflineBeatTracker {
+public:
+    explicit OfflineBeatTracker(uint_t sampleRate, const DetectionSettings& settings = {});
+    ~OfflineBeatTracker();
+
+    OfflineBeatTracker(const OfflineBeatTracker&) = delete;
+    OfflineBeatTracker& operator=(const OfflineBeatTracker&) = delete;
+
+    bool isValid() const { return tempoDetector != nullptr || onsetEngine != nullptr; }
+    uint_t getHopSize() const { return onsetEngine ? static_cast<uint_t>(onsetEngine->getHopSize()) : HOP_SIZE; }
+
+    // One hop of getHopSize() mono samples. Returns true if the tempo estimate was updated.
+    bool process(const float* samples);
+
+    double getTime() const { return static_cast<double>(processedFrames) / sampleRate; }
+    double getBpm() const;
+    // 0 for estimators without a confidence
+    double getConfidence() const { return onsetDetector ? tempogram.getConfidence() : 0.0; }
+    // Whether aubio placed a beat in the last hop
+    bool isBeat() const { return beatDetected; }
+    BeatPhase getPhase() const { return tracker.getPhase(); }
+
+private:
+    double sampleRate;
+    aubio_tempo_t* tempoDetector = nullptr;
+    aubio_onset_t* onsetDetector = nullptr; // DetectionEngine::Aubio only
+    std::unique_ptr<OnsetTempoEngine> onsetEngine;
+    fvec_t* hop = nullptr;
+    fvec_t* tempo = nullptr;
+    fvec_t* onset = nullptr;
+    TempoEstimator estimator;
+    TempogramEstimator tempogram;
+    BeatPhaseTracker tracker;
+    uint64_t processedFrames = 0;
+    uint64_t readIntervalFrames;
+    uint64_t calculationIntervalFrames;
+    uint64_t nextReading;
+    uint64_t nextCalculation;
+    bool beatDetected = false;
+};
+
+// --- Beat Source ---
+// Tempo and beat from the audio. While the phase tracker is locked, beats
+// fall on detected beats and a manual sync only picks which one is beat zero.
+// Otherwise the position counts from the last manual sync at the estimated
+// tempo. The tempo can be set or nudged by hand, which leaves the tracker
+// out until it is handed back; the beat position carries on from where it was.
+class AudioBeatSource : public BeatSource {
+public:
+    // `detectionDelayMs` is how long after a beat sounds it is detected; tracked beats are moved back by it
+    explicit AudioBeatSource(double detectionDelayMs = 0.0) :
+        detectionDelayNs(static_cast<int64_t>(detectionDelayMs * 1e6)) {}
+
+    std::string getName() const override { return "audio"; }
+    void capture(std::chrono::steady_clock::time_point now) override;
+    bool isActive() const override { return getBpm() > 0.0; }
+    double getBpm() const override;
+    double getBeat(std::chrono::steady_clock::time_point now) const override;
+    // The detected phrase start while the tracker is followed and the meter is clear, otherwise beat zero
+    double getPhraseStart() const override;
+
+    // Frame loop only. Makes the beat nearest to `now` beat zero.
+    void sync(std::chrono::steady_clock::time_point now);
+
+    bool isPhaseLocked() const { return isTracking; }
+
+    // Frame loop only. A tempo of 0 goes back to the estimate.
+    void setTempo(std::chrono::steady_clock::time_point now, double bpm);
+    void nudgeTempo(std::chrono::steady_clock::time_point now, double deltaBpm);
+
+private:
+    void keepBeat(std::chrono::steady_clock::time_point now, double beat);
+    double getTrackedBeat(std::chrono::steady_clock::time_point now) const;
+    double getFreeBeat(std::chrono::steady_clock::time_point now) const;
+
+    int64_t detectionDelayNs;
+    std::chrono::steady_clock::time_point syncTime = std::chrono::steady_clock::now();
+    double manualBpm = 0.0;
+    double tempoOffset = 0.0;
+
+    // Tracker grid and meter captured for this frame
+    BeatPhase phase{0, 0.0, 0.0, false};
+    MeterPhase meter{0.0, 0.0, 0.0, 0.0};
+    bool isTracking = false;
+    double trackedBeatOffset = 0.0;
+};
 
 // --- Function Declarations ---
-PaError bpmDetectionInit();
+// Starts `source` feeding the detection loop; false if either could not be set up
+bool bpmDetectionInit(const DetectionSettings& settings, std::unique_ptr<AudioSource> source);
+// Analyses the source's audio until bpmDetectionStop(), then stops the source
 void bpmDetectionLoop();
-
-// Helper functions (could be made private or remain here)
-void addValue(std::deque<double>& timeWindow, std::vector<double>& sortedWindow, double value, size_t windowSize);
-double calculateMedianBPM(const std::vector<double>& window, double currentBPM);
-PaDeviceIndex listAndSelectInputDevice();
-static int paCallbackMethod(const void* inputBuffer, void* outputBuffer,
-    unsigned long framesPerBuffer,
-    const PaStreamCallbackTimeInfo* timeInfo,
-    PaStreamCallbackFlags statusFlags,
-    void* userData);
+void bpmDetectionStop();
 
 #endif // BPM_DETECTOR_H
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "Compositor.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <opencv2/imgproc.hpp>
+
+// Bands handed out per thread, more than one so a slow band does not stall the frame
+static const size_t BANDS_PER_THREAD = 4;
+static const size_t CACHE_LINE_SIZE = 64;
+
+Compositor::Compositor(TaskScheduler& scheduler) : scheduler(scheduler) {
+}
+
+int Compositor::getBandRows(int rows, size_t step, size_t threadCount) {
+    // Smallest number of rows whose byte size is a whole number of cache lines
+    size_t granularity = CACHE_LINE_SIZE / std::gcd(step, CACHE_LINE_SIZE);
+    size_t bands = std::max<size_t>(1, threadCount * BANDS_PER_THREAD);
+    size_t bandRows = (rows + bands - 1) / bands;
+    bandRows = (bandRows + granularity - 1) / granularity * granularity;
+    return static_cast<int>(std::max(bandRows, granularity));
+}
+
+void Compositor::buildColumnTaps(int srcWidth, int dstWidth, int interpolation) {
+    if (srcWidth == tapsSrcWidth && dstWidth == tapsDstWidth && interpolation == tapsInterpolation) {
+        return;
+    }
+
+    columnTaps.resize(dstWidth);
+    double scale = static_cast<double>(srcWidth) / dstWidth;
+    for (int x = 0; x < dstWidth; ++x) {
+        ColumnTap& tap = columnTaps[x];
+        if (interpolation == cv::INTER_NEAREST) {
+            int sx = std::min(static_cast<int>(x * scale), srcWidth - 1);
+            tap = { sx * 3, sx * 3, 0 };
+        } else {
+            // Pixel centres line up the same way as in cv::resize
+            double fx = std::clamp((x + 0.5) * scale - 0.5, 0.0, static_cast<double>(srcWidth - 1));
+            int sx0 = static_cast<int>(fx);
+            int sx1 = std::min(sx0 + 1, srcWidth - 1);
+            tap = { sx0 * 3, sx1 * 3, static_cast<int>(std::lround((fx - sx0) * 256)) };
+        }
+    }
+
+    tapsSrcWidth = srcWidth;
+    tapsDstWidth = dstWidth;
+    tapsInterpolation = interpolation;
+}
+
+void Compositor::prepareForeground(const cv::Mat& foreground, cv::Size size, int interpolation) {
+    if (foreground.channels() == 4) {
+        // Only the alpha channel decides where the foreground colour goes, so
+        // extract it once per image and scale a quarter of the data every frame
+        if (foreground.data != foregroundSource.data || foregroundAlpha.size() != foreground.size()) {
+            cv::extractChannel(foreground, foregroundAlpha, 3);
+            foregroundSource = foreground;
+        }
+        cv::resize(foregroundAlpha, scaledForeground, size, 0, 0, interpolation);
+    } else {
+        foregroundSource.release();
+        cv::resize(foreground, scaledForeground, size, 0, 0, interpolation);
+    }
+}
+
+bool Compositor::composite(const cv::Mat& background, const cv::Mat& foreground, cv::Size renderSize,
+                           double foregroundScalePercent, const cv::Scalar& foregroundColor, int interpolation,
+                           cv::Mat& output) {
+    if (!background.empty() && background.type() != CV_8UC3) {
+        return false;
+    }
+    if (!foreground.empty() && foreground.type() != CV_8UC4 && foreground.type() != CV_8UC3) {
+        return false;
+    }
+
+    const int width = renderSize.width;
+    const int height = renderSize.height;
+
+    // Background placement, same letterboxing as scaleToFit()
+    int imageWidth = 0, imageHeight = 0;
+    if (!background.empty()) {
+        double srcAspectRatio = static_cast<double>(background.cols) / background.rows;
+        double targetAspectRatio = static_cast<double>(width) / height;
+        if (srcAspectRatio > targetAspectRatio) {
+            imageWidth = width;
+            imageHeight = static_cast<int>(imageWidth / srcAspectRatio);
+        } else {
+            imageHeight = height;
+            imageWidth = static_cast<int>(imageHeight * srcAspectRatio);
+        }
+        buildColumnTaps(background.cols, imageWidth, interpolation);
+    }
+    const int imageX = (width - imageWidth) / 2;
+    const int imageY = (height - imageHeight) / 2;
+
+    // Foreground placement, same sizing rules as AssetManager::blend()
+    cv::Rect foregroundRect;
+    if (!foreground.empty()) {
+        int targetWidth = static_cast<int>(width * (foregroundScalePercent / 100.0));
+        double aspectRatio = static_cast<double>(foreground.rows) / foreground.cols;
+        int newHeight = static_cast<int>(targetWidth * aspectRatio);
+        if (targetWidth > width) {
+            targetWidth = width;
+            newHeight = static_cast<int>(targetWidth * aspectRatio);
+        }
+        if (newHeight > height) {
+            newHeight = height;
+            targetWidth = static_cast<int>(newHeight / aspectRatio);
+        }
+        if (targetWidth > 0 && newHeight > 0) {
+            foregroundRect = cv::Rect((width - targetWidth) / 2, (height - newHeight) / 2, targetWidth, newHeight);
+            prepareForeground(foreground, foregroundRect.size(), interpolation);
+        }
+    }
+    const bool foregroundHasAlpha = !foregroundRect.empty() && scaledForeground.channels() == 1;
+    const uchar color[3] = {
+        cv::saturate_cast<uchar>(foregroundColor[0]),
+        cv::saturate_cast<uchar>(foregroundColor[1]),
+        cv::saturate_cast<uchar>(foregroundColor[2])
+    };
+
+    output.create(height, width, CV_8UC3);
+
+    const int bandRows = getBandRows(height, output.step, scheduler.size());
+    const size_t bandCount = (height + bandRows - 1) / bandRows;
+    const ColumnTap* taps = columnTaps.data();
+
+    scheduler.parallelFor(bandCount, [&](size_t band) {
+        int firstRow = static_cast<int>(band) * bandRows;
+        int lastRow = std::min(height, firstRow + bandRows);
+
+        for (int y = firstRow; y < lastRow; ++y) {
+            uchar* dst = output.ptr<uchar>(y);
+
+            // --- Background ---
+            if (y < imageY || y >= imageY + imageHeight) {
+                std::memset(dst, 0, width * 3);
+            } else {
+                std::memset(dst, 0, imageX * 3);
+                std::memset(dst + (imageX + imageWidth) * 3, 0, (width - imageX - imageWidth) * 3);
+
+                uchar* out = dst + imageX * 3;
+                int localY = y - imageY;
+                if (interpolation == cv::INTER_NEAREST) {
+                    int sy = std::min(static_cast<int>(localY * static_cast<double>(background.rows) / imageHeight), background.rows - 1);
+                    const uchar* row = background.ptr<uchar>(sy);
+                    for (int x = 0; x < imageWidth; ++x, out += 3) {
+                        const uchar* p = row + taps[x].x0;
+                        out[0] = p[0];
+                        out[1] = p[1];
+                        out[2] = p[2];
+                    }
+                } else {
+                    double fy = std::clamp((localY + 0.5) * background.rows / imageHeight - 0.5, 0.0, static_cast<double>(background.rows - 1));
+                    int sy0 = static_cast<int>(fy);
+                    int sy1 = std::min(sy0 + 1, background.rows - 1);
+                    int wy1 = static_cast<int>(std::lround((fy - sy0) * 256));
+                    int wy0 = 256 - wy1;
+                    const uchar* row0 = background.ptr<uchar>(sy0);
+                    const uchar* row1 = background.ptr<uchar>(sy1);
+                    for (int x = 0; x < imageWidth; ++x, out += 3) {
+                        const ColumnTap& tap = taps[x];
+                        int wx1 = tap.weight;
+                        int wx0 = 256 - wx1;
+                        for (int c = 0; c < 3; ++c) {
+                            int top = row0[tap.x0 + c] * wx0 + row0[tap.x1 + c] * wx1;
+                            int bottom = row1[tap.x0 + c] * wx0 + row1[tap.x1 + c] * wx1;
+                            out[c] = static_cast<uchar>((top * wy0 + bottom * wy1 + (1 << 15)) >> 16);
+                        }
+                    }
+                }
+            }
+
+            // --- Foreground ---
+            if (y < foregroundRect.y || y >= foregroundRect.y + foregroundRect.height) {
+                continue;
+            }
+            uchar* out = dst + foregroundRect.x * 3;
+            const uchar* src = scaledForeground.ptr<uchar>(y - foregroundRect.y);
+            if (foregroundHasAlpha) {
+                for (int x = 0; x < foregroundRect.width; ++x, out += 3) {
+                    if (src[x]) {
+                        out[0] = color[0];
+                        out[1] = color[1];
+                        out[2] = color[2];
+                    }
+                }
+            } else {
+                std::memcpy(out, src, foregroundRect.width * 3);
+            }
+        }
+    });
+
+    return true;
+}
+
+void Compositor::fill(cv::Mat& output, const cv::Scalar& color) {
+    const int bandRows = getBandRows(output.rows, output.step, scheduler.size());
+    const size_t bandCount = (output.rows + bandRows - 1) / bandRows;
+
+    scheduler.parallelFor(bandCount, [&](size_t band) {
+        int firstRow = static_cast<int>(band) * bandRows;
+        int lastRow = std::min(output.rows, firstRow + bandRows);
+        output.rowRange(firstRow, lastRow).setTo(color);
+    });
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "TaskScheduler.h"
+
+// Fused scale-and-blend kernel that splits the output frame into horizontal
+// bands and composites them in parallel on the task scheduler.
+//
+// One pass over each output row letterboxes the background into the frame and
+// stamps the foreground on top, so every output pixel is written once while it
+// is still in cache. Band boundaries fall on whole cache lines of the output
+// buffer, so no two threads ever write to the same line.
+class Compositor {
+public:
+    Compositor(TaskScheduler& scheduler);
+
+    // Same result as scaleToFit() followed by AssetManager::blend(), for 8-bit
+    // BGR backgrounds. Returns false (leaving `output` untouched) for anything
+    // else, so the caller can fall back to the generic path.
+    bool composite(const cv::Mat& background, const cv::Mat& foreground, cv::Size renderSize,
+                   double foregroundScalePercent, const cv::Scalar& foregroundColor, int interpolation,
+                   cv::Mat& output);
+
+    // Fills the whole frame with one colour, band-parallel
+    void fill(cv::Mat& output, const cv::Scalar& color);
+
+    // Rows per band for a frame with the given row stride
+    static int getBandRows(int rows, size_t step, size_t threadCount);
+
+private:
+    struct ColumnTap {
+        int x0;
+        int x1;
+        int weight; // 0..256, weight of x1
+    };
+
+    void buildColumnTaps(int srcWidth, int dstWidth, int interpolation);
+    void prepareForeground(const cv::Mat& foreground, cv::Size size, int interpolation);
+
+    TaskScheduler& scheduler;
+
+    // Horizontal sampling positions, rebuilt only when the scaling changes
+    std::vector<ColumnTap> columnTaps;
+    int tapsSrcWidth = -1;
+    int tapsDstWidth = -1;
+    int tapsInterpolation = -1;
+
+    // Foreground alpha (or colour, for images without alpha) at its on-screen size.
+    // The image the alpha came from is referenced, not just its address, so its
+    // buffer cannot be freed and reused by another image while the alpha is kept.
+    cv::Mat foregroundSource;
+    cv::Mat foregroundAlpha;
+    cv::Mat scaledForeground;
+};
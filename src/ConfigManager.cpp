@@ -1,9 +1,10 @@
 #include "ConfigManager.h"
 #include <iostream>
+#include <algorithm>
 
 using json = nlohmann::json;
 
-ConfigManager::ConfigManager(const std::string& configFilePath) {
+ConfigManager::ConfigManager(const std::string& configFilePath) : configFilePath(configFilePath) {
     std::ifstream configFile(configFilePath);
     if (!configFile.is_open()) {
         std::cerr << "Error: Could not open config file at " << configFilePath << std::endl;
@@ -12,6 +13,7 @@ ConfigManager::ConfigManager(const std::string& configFilePath) {
         config.keyMappingFile = "config/key_mapping.csv";
         config.assetsConfigFile = "config/assets_config.json";
         config.windowName = "visual-hive Output";
+        live.store(parseLive(json::object()));
         return;
     }
 
@@ -24,51 +26,194 @@ ConfigManager::ConfigManager(const std::string& configFilePath) {
         config.assetsDir = data["paths"].value("assets_directory", "assets");
         config.keyMappingFile = data["paths"].value("key_mapping_file", "config/key_mapping.csv");
         config.assetsConfigFile = data["paths"].value("assets_config_file", "config/assets_config.json");
+        config.assetCacheDirectory = data["paths"].value("asset_cache_directory", "cache");
+        config.watchAssets = data["paths"].value("watch_assets", true);
+        config.watchConfig = data["paths"].value("watch_config", true);
     }
 
     if (data.count("display")) {
         config.windowName = data["display"].value("window_name", "visual-hive Output");
+        config.cpuUpscale = data["display"].value("upscale", "gpu") == "cpu";
     }
     
     if (data.count("ableton_link")) {
         config.phraseLength = data["ableton_link"].value("phrase_length", 4);
         config.default_bpm = data["ableton_link"].value("default_bpm", 125.0);
+        config.linkEnabled = data["ableton_link"].value("enabled", false);
+        config.linkStartStopSync = data["ableton_link"].value("start_stop_sync", false);
+        config.linkLatencyMs = data["ableton_link"].value("latency_ms", 0.0);
     }
 
-    // Load the assets configuration
-    loadAssetsConfig(config.assetsConfigFile);
-}
+    if (data.count("beat")) {
+        config.beatSource = data["beat"].value("source", "auto");
+        config.beatGridDirectory = data["beat"].value("grid_directory", "beatgrids");
+    }
 
-void ConfigManager::loadAssetsConfig(const std::string& assetsConfigFilePath) {
-    std::ifstream assetsFile(assetsConfigFilePath);
-    if (!assetsFile.is_open()) {
-        std::cerr << "Error: Could not open assets config file at " << assetsConfigFilePath << std::endl;
-        return;
+    if (data.count("latency")) {
+        config.audioDelayMs = data["latency"].value("audio_delay_ms", 0.0);
     }
-    
-    json data;
-    assetsFile >> data;
-    assetsFile.close();
-    
-    if (data.count("color_mappings")) {
-        for (auto& [key, value] : data["color_mappings"].items()) {
-            if (value.is_array() && value.size() == 3) {
-                // Read colors as RGB from JSON and convert to BGR for OpenCV
-                int r = value[0].get<int>();
-                int g = value[1].get<int>();
-                int b = value[2].get<int>();
-                config.colorMappings[key] = cv::Scalar(b, g, r); // Store as BGR
+
+    if (data.count("audio")) {
+        config.audioSource = data["audio"].value("source", "device");
+        if (data["audio"].count("device")) {
+            const auto& device = data["audio"]["device"];
+            config.audioDevice = device.is_number() ? std::to_string(device.get<int>()) : device.get<std::string>();
+        }
+        config.audioSampleRate = std::max(data["audio"].value("sample_rate", 0.0), 0.0);
+        if (data["audio"].count("channels")) {
+            // Numbered from 1 in the config, as on a mixer
+            config.audioChannels.clear();
+            for (int channel : data["audio"]["channels"].get<std::vector<int>>()) {
+                if (channel < 1) {
+                    std::cerr << "Ignoring audio channel " << channel << ", channels are numbered from 1" << std::endl;
+                    continue;
+                }
+                config.audioChannels.push_back(channel - 1);
+            }
+        }
+        config.audioFile = data["audio"].value("file", "");
+        config.audioSpeed = std::max(data["audio"].value("speed", 1.0), 0.01);
+        config.audioLoop = data["audio"].value("loop", true);
+        config.generatorBpm = data["audio"].value("generator_bpm", 128.0);
+        config.detectionEngine = data["audio"].value("engine", "aubio");
+        if (config.detectionEngine != "aubio" && config.detectionEngine != "aubio-median" && config.detectionEngine != "onset") {
+            std::cerr << "Unknown audio engine " << config.detectionEngine << ", using aubio" << std::endl;
+            config.detectionEngine = "aubio";
+        }
+        config.onsetHopSize = data["audio"].value("hop_size", 256);
+        if (config.onsetHopSize != 128 && config.onsetHopSize != 256 && config.onsetHopSize != 512) {
+            std::cerr << "Unsupported audio hop_size " << config.onsetHopSize << ", using 256" << std::endl;
+            config.onsetHopSize = 256;
+        }
+        if (data["audio"].count("preferred_bpm")) {
+            std::vector<double> range = data["audio"]["preferred_bpm"].get<std::vector<double>>();
+            if (range.size() == 2 && range[0] > 0.0 && range[1] >= range[0] * 2.0) {
+                config.preferredMinBpm = range[0];
+                config.preferredMaxBpm = range[1];
+            } else {
+                std::cerr << "audio preferred_bpm must be [min, max] spanning at least an octave, using ["
+                          << config.preferredMinBpm << ", " << config.preferredMaxBpm << "]" << std::endl;
             }
         }
     }
-    
-    if (data.count("foreground_scales")) {
-        for (auto& [key, value] : data["foreground_scales"].items()) {
-            if (value.is_number()) {
-                config.foregroundScales[key] = value.get<double>();
+
+    if (data.count("performance")) {
+        config.adaptiveQuality = data["performance"].value("adaptive_quality", true);
+        config.pipelineDepth = data["performance"].value("pipeline_depth", 1);
+        config.workerThreads = data["performance"].value("worker_threads", 0);
+    }
+
+    if (data.count("threads")) {
+        config.lockMemory = data["threads"].value("lock_memory", false);
+
+        // Keys in the same order as ThreadRole
+        const char* roleKeys[] = { "audio", "frame", "decoder", "io" };
+        for (size_t i = 0; i < config.threadPolicies.size(); ++i) {
+            if (!data["threads"].count(roleKeys[i])) {
+                continue;
+            }
+            const json& role = data["threads"][roleKeys[i]];
+            ThreadRolePolicy& policy = config.threadPolicies[i];
+            policy.cpus = role.value("cpus", std::vector<int>{});
+            policy.policy = parseSchedulingPolicy(role.value("policy", "default"));
+            policy.priority = role.value("priority", 0);
+            policy.nice = role.value("nice", 0);
+        }
+    }
+
+    if (data.count("midi")) {
+        config.midiEnabled = data["midi"].value("enabled", true);
+        config.midiPort = data["midi"].value("port", "");
+        config.midiVirtualPort = data["midi"].value("virtual_port", false);
+        config.midiClock = data["midi"].value("clock", true);
+
+        // Actions are given as the key they stand for, e.g. "36": "b"
+        const std::pair<const char*, std::map<int, int>*> tables[] = {
+            { "notes", &config.midiNoteActions },
+            { "controls", &config.midiControlActions },
+        };
+        for (const auto& [section, table] : tables) {
+            if (!data["midi"].count(section)) {
+                continue;
+            }
+            for (auto& [key, value] : data["midi"][section].items()) {
+                int number = -1;
+                try {
+                    size_t length = 0;
+                    number = std::stoi(key, &length);
+                    if (length != key.size()) {
+                        number = -1;
+                    }
+                } catch (const std::exception&) {
+                }
+                if (number < 0 || number >= 128 || !value.is_string() || value.get<std::string>().empty()) {
+                    std::cerr << "Skipping MIDI " << section << " entry \"" << key << "\": " << value.dump() << std::endl;
+                    continue;
+                }
+                (*table)[number] = value.get<std::string>()[0];
             }
         }
     }
+
+    if (data.count("osc")) {
+        config.oscEnabled = data["osc"].value("enabled", true);
+        config.oscPort = data["osc"].value("port", 9000);
+    }
+
+    live.store(parseLive(data));
+}
+
+bool ConfigManager::reloadLive() {
+    std::ifstream configFile(configFilePath);
+    if (!configFile.is_open()) {
+        std::cerr << "Keeping the current settings, could not open " << configFilePath << std::endl;
+        return false;
+    }
+
+    // A value of the wrong type throws from parseLive() too; nothing is published unless all of it parses
+    LiveConfig parsed;
+    try {
+        json data;
+        configFile >> data;
+        parsed = parseLive(data);
+    } catch (const std::exception& e) {
+        std::cerr << "Keeping the current settings, " << configFilePath << " cannot be used: " << e.what() << std::endl;
+        return false;
+    }
+    live.store(parsed);
+    std::cout << "Applied the display, latency and effects settings from " << configFilePath
+              << "; the others take effect on restart" << std::endl;
+    return true;
+}
+
+LiveConfig ConfigManager::parseLive(const json& data) {
+    const json empty = json::object();
+    const json& display = data.count("display") ? data["display"] : empty;
+    const json& latency = data.count("latency") ? data["latency"] : empty;
+    const json& effects = data.count("effects") ? data["effects"] : empty;
+
+    LiveConfig result;
+    result.renderHeight = std::max(display.value("render_height", 0), 0);
+    result.latencyCompensation = latency.value("compensate", true);
+    result.displayLatencyMs = latency.value("display_ms", 0.0);
+
+    std::string bounce = effects.value("bounce", "beat");
+    result.bounceSource = bounce == "kick" ? BounceSource::Kick : BounceSource::Beat;
+    if (bounce != "kick" && bounce != "beat") {
+        std::cerr << "Unknown effects bounce " << bounce << ", using beat" << std::endl;
+    }
+    result.bounceAmount = std::clamp(effects.value("bounce_amount", 0.1), 0.0, 1.0);
+    result.strobeRate = effects.value("strobe_rate", 10.0);
+    if (result.strobeRate <= 0.0) {
+        std::cerr << "effects strobe_rate must be above 0, using 10" << std::endl;
+        result.strobeRate = 10.0;
+    }
+    result.cuePhraseBars = effects.value("cue_phrase_bars", 8);
+    if (result.cuePhraseBars != 8 && result.cuePhraseBars != 16 && result.cuePhraseBars != 32) {
+        std::cerr << "Unsupported effects cue_phrase_bars " << result.cuePhraseBars << ", using 8" << std::endl;
+        result.cuePhraseBars = 8;
+    }
+    return result;
 }
 
 const AppConfig& ConfigManager::getConfig() const {
@@ -4,31 +4,101 @@
 #include <fstream>
 #include <map>
 #include <vector>
+#include <array>
 #include <opencv2/opencv.hpp>
 #include <nlohmann/json.hpp> // nlohmann/json library
+#include "ThreadPolicy.h"
+#include "SeqLock.h"
+
+// What the foreground bounce follows
+enum class BounceSource {
+    Beat, // Swings on every beat
+    Kick  // Follows the kick drum
+};
+
+// Settings the frame loop reads every frame, which can change while it runs.
+// Flat and trivially copyable, so a snapshot is published whole through a
+// SeqLock and read without locks or allocation.
+struct LiveConfig {
+    int renderHeight; // Internal render height, 0 renders at the display resolution
+    bool latencyCompensation; // Render each frame for the moment it will be on screen
+    double displayLatencyMs; // What the display or projector adds after the frame is presented
+    BounceSource bounceSource;
+    double bounceAmount; // How much larger the foreground gets at the top of a bounce
+    double strobeRate; // Strobe flips per beat
+    int cuePhraseBars; // Bars between CUE changes, on phrase starts: 8, 16 or 32
+};
 
 // Struct to hold all the application's configuration parameters
 struct AppConfig {
     std::string assetsDir;
     std::string keyMappingFile;
     std::string assetsConfigFile;
+    std::string assetCacheDirectory = "cache"; // Asset index and thumbnails, rebuilt from the assets when missing
+    bool watchAssets = true; // Reload assets when their files or the assets config change
+    bool watchConfig = true; // Apply live settings when the config file changes
     std::string windowName;
-    std::map<std::string, cv::Scalar> colorMappings;
-    std::map<std::string, double> foregroundScales;
-    int phraseLength;
-    double default_bpm;
+    int phraseLength = 4;
+    double default_bpm = 125.0;
+    bool adaptiveQuality = true; // Let the quality governor shed work when frames run late
+    bool cpuUpscale = false; // Upscale to the display on the CPU instead of in the Metal view
+    int pipelineDepth = 1; // Frames buffered between pipeline stages, 0 runs every stage on one thread
+    int workerThreads = 0; // Task scheduler workers, 0 uses one per hardware thread minus one for the frame thread
+    std::array<ThreadRolePolicy, static_cast<size_t>(ThreadRole::Count)> threadPolicies; // Indexed by ThreadRole
+    bool lockMemory = false; // mlockall() at startup
+    bool midiEnabled = false; // Open a MIDI input at startup
+    std::string midiPort; // Part of the input port name, empty opens the first port
+    bool midiVirtualPort = false; // Create a virtual "VisualHive" input instead, for other apps and tests
+    bool midiClock = true; // Follow incoming MIDI clock as the beat source
+    std::map<int, int> midiNoteActions; // MIDI note number to key code
+    std::map<int, int> midiControlActions; // MIDI controller number to key code
+    std::string beatSource = "auto"; // "auto", "link", "midi", "track" or "audio"; the audio estimate is always the fallback
+    std::string beatGridDirectory = "beatgrids"; // Beat grids written by visualhive-analyze, preloaded at startup
+    bool linkEnabled = false; // Join an Ableton Link session
+    bool linkStartStopSync = false; // Follow the session's transport, Link is only used while another peer plays it
+    double linkLatencyMs = 0.0; // Extra offset for Link beats only, on top of latency compensation
+    bool oscEnabled = false; // Listen for OSC control messages
+    int oscPort = 9000; // UDP port of the OSC server
+    double audioDelayMs = 0.0; // How late beats are detected after they sound, measured with --calibrate
+    std::string audioSource = "device"; // "device", "file" or "generator"
+    std::string audioDevice; // Input device number or part of its name, empty for the default input
+    double audioSampleRate = 0.0; // Rate the device is opened at, 0 for its own; resampled for detection
+    std::vector<int> audioChannels; // Channels mixed into the detection input, 0-based; all of them if empty
+    std::string audioFile; // Played by the "file" source
+    double audioSpeed = 1.0; // How much faster than realtime the file and generator sources run
+    bool audioLoop = true; // Play the file again from the start when it ends
+    double generatorBpm = 128.0; // Click tempo of the "generator" source
+    std::string detectionEngine = "aubio"; // "aubio" (tempogram), "aubio-median" for the original estimator, or "onset" for the in-tree onset engine
+    double preferredMinBpm = 88.0; // Tempo range the tempogram reports in, at least an octave wide
+    double preferredMaxBpm = 176.0;
+    int onsetHopSize = 256; // Samples per onset engine hop: 128, 256 or 512
+
+    const ThreadRolePolicy& getThreadPolicy(ThreadRole role) const {
+        return threadPolicies[static_cast<size_t>(role)];
+    }
 };
 
 class ConfigManager {
 private:
     AppConfig config;
+    std::string configFilePath;
+    SeqLock<LiveConfig> live;
 
 public:
     ConfigManager(const std::string& configFilePath);
     
     // Getter for the loaded configuration
     const AppConfig& getConfig() const;
-    
+    const std::string& getConfigFilePath() const { return configFilePath; }
+
+    // The latest live settings, from any thread
+    LiveConfig getLive() const { return live.load(); }
+    // Reads the config file again and publishes its live settings; the rest
+    // only applies on restart. One thread only. False, keeping the current
+    // settings, if the file cannot be read.
+    bool reloadLive();
+
 private:
-    void loadAssetsConfig(const std::string& assetsConfigFilePath);
+    // Every field, from its default where the config leaves it out
+    static LiveConfig parseLive(const nlohmann::json& data);
 };
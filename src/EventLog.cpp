@@ -0,0 +1,167 @@
+#include "EventLog.h"
+#include <iostream>
+#include <cstring>
+
+const char EVENT_LOG_MAGIC[4] = { 'V', 'H', 'E', 'V' };
+const uint32_t EVENT_LOG_VERSION = 1;
+const uint8_t EVENT_LOG_KEY_DOWN = 1 << 0;
+const uint8_t EVENT_LOG_REPEAT = 1 << 1;
+
+// Records buffered between the frame loop and the writer, several seconds of a key storm
+static const size_t RECORDER_RING_CAPACITY = 16384;
+
+// How often the writer wakes up, and how often it flushes the file so a crash keeps the log
+static const std::chrono::milliseconds RECORDER_POLL_INTERVAL(10);
+static const std::chrono::seconds RECORDER_FLUSH_INTERVAL(1);
+
+EventRecorder::EventRecorder(const std::string& path, std::function<void()> threadSetup) :
+    file(path, std::ios::binary | std::ios::trunc),
+    threadSetup(std::move(threadSetup)),
+    start(std::chrono::steady_clock::now()),
+    ring(RECORDER_RING_CAPACITY) {
+    if (!file) {
+        std::cerr << "Could not open event log for writing: " << path << std::endl;
+        running.store(false);
+        return;
+    }
+
+    file.write(EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC));
+    file.write(reinterpret_cast<const char*>(&EVENT_LOG_VERSION), sizeof(EVENT_LOG_VERSION));
+    isFileOpen = true;
+    std::cout << "Recording events to " << path << std::endl;
+
+    writerThread = std::thread(&EventRecorder::writerLoop, this);
+}
+
+EventRecorder::~EventRecorder() {
+    stop();
+}
+
+void EventRecorder::setPosition(long long frameIndex, double beat) {
+    this->frameIndex = frameIndex;
+    this->beat = beat;
+}
+
+void EventRecorder::record(const Event& event) {
+    if (!isFileOpen) {
+        return;
+    }
+
+    EventLogRecord record{};
+    std::chrono::steady_clock::time_point timestamp = event.timestamp.time_since_epoch().count() != 0 ? event.timestamp : std::chrono::steady_clock::now();
+    record.timestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp - start).count();
+    record.frameIndex = frameIndex;
+    record.beat = beat;
+    record.keyCode = event.keyCode;
+    record.midiCommand = event.midiCommand;
+    record.type = static_cast<uint8_t>(event.type);
+    record.flags = (event.isKeyDown ? EVENT_LOG_KEY_DOWN : 0) | (event.isRepeat ? EVENT_LOG_REPEAT : 0);
+    record.value = event.value;
+
+    if (!ring.tryPush(std::move(record))) {
+        ++dropped;
+    }
+}
+
+void EventRecorder::stop() {
+    running.store(false);
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+    if (isFileOpen) {
+        file.flush();
+        file.close();
+        isFileOpen = false;
+        std::cout << "Recorded " << recorded.load() << " events";
+        if (dropped > 0) {
+            std::cout << " (" << dropped << " dropped)";
+        }
+        std::cout << std::endl;
+    }
+}
+
+void EventRecorder::writerLoop() {
+    if (threadSetup) {
+        threadSetup();
+    }
+
+    auto lastFlush = std::chrono::steady_clock::now();
+    EventLogRecord record;
+    while (true) {
+        // Read the flag first so everything pushed before stop() is written
+        bool keepRunning = running.load();
+        size_t written = 0;
+        while (ring.tryPop(record)) {
+            file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+            ++written;
+        }
+        recorded.fetch_add(written, std::memory_order_relaxed);
+
+        if (!keepRunning) {
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastFlush >= RECORDER_FLUSH_INTERVAL) {
+            file.flush();
+            lastFlush = now;
+        }
+        if (written == 0) {
+            std::this_thread::sleep_for(RECORDER_POLL_INTERVAL);
+        }
+    }
+}
+
+EventReplayer::EventReplayer(const std::string& path, bool realtime) :
+    realtime(realtime) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Could not open event log: " << path << std::endl;
+        return;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!file || std::memcmp(magic, EVENT_LOG_MAGIC, sizeof(magic)) != 0 || version != EVENT_LOG_VERSION) {
+        std::cerr << "Not a VisualHive event log (or an unsupported version): " << path << std::endl;
+        return;
+    }
+
+    EventLogRecord record;
+    while (file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        records.push_back(record);
+    }
+    isFileOpen = true;
+
+    std::cout << "Replaying " << records.size() << " events from " << path
+              << (realtime ? " in real time" : " as fast as possible") << std::endl;
+}
+
+size_t EventReplayer::feed(EventQueue& queue, long long frameIndex) {
+    if (!started) {
+        start = std::chrono::steady_clock::now();
+        started = true;
+    }
+    long long elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    size_t pushed = 0;
+    while (next < records.size()) {
+        const EventLogRecord& record = records[next];
+        bool isDue = realtime ? record.timestampNs <= elapsedNs : record.frameIndex <= frameIndex;
+        if (!isDue) {
+            break;
+        }
+
+        Event event = { static_cast<AppEventType>(record.type), record.keyCode, record.midiCommand, (record.flags & EVENT_LOG_KEY_DOWN) != 0 };
+        event.isRepeat = (record.flags & EVENT_LOG_REPEAT) != 0;
+        event.value = record.value;
+        if (!queue.push(event)) {
+            break;
+        }
+        ++next;
+        ++pushed;
+    }
+    return pushed;
+}
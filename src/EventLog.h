@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EventQueue.h"
+#include "SpscQueue.h"
+
+// One event in a recorded log. Fixed size and layout so a log can be read
+// back with a single read and memory-mapped by other tools.
+struct EventLogRecord {
+    int64_t timestampNs;   // Monotonic time since the recording started
+    int64_t frameIndex;    // Frame the frame loop was on when it consumed the event
+    double beat;           // Beat position at that frame
+    int32_t keyCode;
+    int32_t midiCommand;
+    uint8_t type;          // AppEventType
+    uint8_t flags;         // EVENT_LOG_KEY_DOWN | EVENT_LOG_REPEAT
+    uint8_t reserved[2];
+    float value;
+};
+static_assert(sizeof(EventLogRecord) == 40, "EventLogRecord layout is part of the file format");
+
+extern const char EVENT_LOG_MAGIC[4];
+extern const uint32_t EVENT_LOG_VERSION;
+extern const uint8_t EVENT_LOG_KEY_DOWN;
+extern const uint8_t EVENT_LOG_REPEAT;
+
+// Writes every event the frame loop takes off the EventQueue to a binary log.
+// record() only copies the event into a ring; a writer thread does the file
+// I/O, so recording never stalls a frame.
+class EventRecorder {
+public:
+    // `threadSetup` runs first on the writer thread, e.g. to apply its thread role
+    EventRecorder(const std::string& path, std::function<void()> threadSetup = nullptr);
+    ~EventRecorder();
+
+    bool isOpen() const { return isFileOpen; }
+
+    // Frame loop only. Position stamped on the events recorded after it.
+    void setPosition(long long frameIndex, double beat);
+
+    // Frame loop only
+    void record(const Event& event);
+
+    // Flushes what is left in the ring and closes the file
+    void stop();
+
+    size_t getRecordedCount() const { return recorded.load(std::memory_order_relaxed); }
+    size_t getDroppedCount() const { return dropped; }
+
+private:
+    void writerLoop();
+
+    std::ofstream file;
+    bool isFileOpen = false;
+    std::function<void()> threadSetup;
+    std::chrono::steady_clock::time_point start;
+    long long frameIndex = 0;
+    double beat = 0.0;
+
+    SpscQueue<EventLogRecord> ring;
+    std::atomic<bool> running{true};
+    std::atomic<size_t> recorded{0};
+    size_t dropped = 0;
+    std::thread writerThread;
+};
+
+// Feeds a recorded log back into an EventQueue from the frame loop.
+// In real-time mode events are released at their original offsets from the
+// start of the run; in fast mode they are released on their original frame index,
+// so the run is the same however fast frames are produced.
+class EventReplayer {
+public:
+    EventReplayer(const std::string& path, bool realtime);
+
+    bool isOpen() const { return isFileOpen; }
+    bool isRealtime() const { return realtime; }
+    bool isFinished() const { return next >= records.size(); }
+    size_t size() const { return records.size(); }
+
+    // Frame loop only. Pushes every event that is due at `frameIndex` and
+    // returns how many were pushed. Events that do not fit stay for the next frame.
+    size_t feed(EventQueue& queue, long long frameIndex);
+
+private:
+    std::vector<EventLogRecord> records;
+    bool isFileOpen = false;
+    bool realtime;
+    bool started = false;
+    std::chrono::steady_clock::time_point start;
+    size_t next = 0;
+};
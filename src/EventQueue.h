@@ -2,55 +2,136 @@
 #ifndef EVENT_QUEUE_H
 #define EVENT_QUEUE_H
 
-#include <queue>
-#include <mutex>
-#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 
 // Enum to distinguish between event types
 enum class AppEventType {
     Keyboard,
-    MIDI
+    MIDI,
+    OSC
 };
 
+// Key codes for actions that have no key of their own, above any character code
+constexpr int ACTION_TEMPO_SET = 0x110000; // value: tempo in BPM, 0 goes back to the beat source
+constexpr int ACTION_TEMPO_NUDGE = 0x110001; // value: change of tempo in BPM
+constexpr int ACTION_TRACK_PLAY = 0x110002; // midiCommand: track id (0 stops), value: position in the track in seconds
+
 // Struct to hold event data
 struct Event {
     AppEventType type;
     int keyCode; // Key code for keyboard events
-    int midiCommand; // MIDI command for MIDI events (e.g., note number)
+    int midiCommand; // MIDI command for MIDI events (e.g., note number), or the id an action refers to
     bool isKeyDown; // True for key/note press, false for release
+    bool isRepeat = false; // Auto-repeat of a key that is being held down
+    float value = 0.0f; // Argument of actions that take one, e.g. a tempo
+    std::chrono::steady_clock::time_point timestamp{}; // When the event happened, stamped on push if left empty
 };
 
-// Thread-safe event queue
+// Bounded lock-free multi-producer single-consumer queue of events.
+// Any thread may push (AppKit key monitor, MIDI, network); only the frame
+// loop pops. Each slot carries a sequence number that tells producers and the
+// consumer whose turn it is, so neither side ever takes a lock or waits.
 class EventQueue {
 public:
-    void push(const Event& event) {
-        std::lock_guard<std::mutex> lock(_mutex);
-        _queue.push(event);
-        _cond.notify_one();
+    // `capacity` is rounded up to a power of two
+    explicit EventQueue(size_t capacity = 1024) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _mask = size - 1;
+        _slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; ++i) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
     }
 
+    // Returns false, and drops the event, when the queue is full
+    bool push(const Event& event) {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &_slots[pos & _mask];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->event = event;
+        if (slot->event.timestamp.time_since_epoch().count() == 0) {
+            slot->event.timestamp = std::chrono::steady_clock::now();
+        }
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only
     bool pop(Event& event) {
-        std::unique_lock<std::mutex> lock(_mutex);
-        if (_queue.empty()) {
+        Slot& slot = _slots[_dequeuePos & _mask];
+        if (slot.sequence.load(std::memory_order_acquire) != _dequeuePos + 1) {
             return false;
         }
-        event = _queue.front();
-        _queue.pop();
+        event = slot.event;
+        slot.sequence.store(_dequeuePos + _mask + 1, std::memory_order_release);
+        ++_dequeuePos;
+        if (_tap) {
+            _tap(event);
+        }
         return true;
     }
 
-    // Blocking wait for an event
-    void waitAndPop(Event& event) {
-        std::unique_lock<std::mutex> lock(_mutex);
-        _cond.wait(lock, [this] { return !_queue.empty(); });
-        event = _queue.front();
-        _queue.pop();
+    // Consumer only. Called with every event as it leaves the queue, before
+    // repeats are coalesced, e.g. to record the session.
+    void setTap(std::function<void(const Event&)> tap) { _tap = std::move(tap); }
+
+    // Consumer only. Moves up to `maxEvents` queued events into `events` in
+    // order and returns how many were written. Key auto-repeats are dropped
+    // here: the key-down that started them is already in the stream, and
+    // acting on them would re-toggle effects while a key is held.
+    size_t drain(Event* events, size_t maxEvents) {
+        size_t count = 0;
+        Event event;
+        while (count < maxEvents && pop(event)) {
+            if (event.type == AppEventType::Keyboard && event.isRepeat) {
+                ++_coalesced;
+                continue;
+            }
+            events[count++] = event;
+        }
+        return count;
     }
 
+    size_t getDroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+    size_t getCoalescedCount() const { return _coalesced; }
+
 private:
-    std::queue<Event> _queue;
-    std::mutex _mutex;
-    std::condition_variable _cond;
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Event event;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    size_t _mask;
+
+    alignas(64) std::atomic<size_t> _enqueuePos{0};
+    alignas(64) size_t _dequeuePos = 0;
+    size_t _coalesced = 0;
+    std::function<void(const Event&)> _tap;
+    alignas(64) std::atomic<size_t> _dropped{0};
 };
 
 #endif // EVENT_QUEUE_H
@@ -0,0 +1,114 @@
+#include "FramePipeline.h"
+
+// Weight of the newest frame in the smoothed latency
+static const double LATENCY_SMOOTHING = 0.05;
+
+// Spin briefly, then yield, then sleep, so an idle stage does not burn a core
+static void backoff(int& spins) {
+    ++spins;
+    if (spins < 64) {
+        return;
+    }
+    if (spins < 128) {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+FramePipeline::FramePipeline(size_t depth, StageFunction composite, StageFunction effects, StageFunction sink,
+                             std::function<void()> threadSetup) :
+    depth(depth),
+    composite(std::move(composite)),
+    effects(std::move(effects)),
+    sink(std::move(sink)),
+    threadSetup(std::move(threadSetup)),
+    decodedQueue(depth > 0 ? depth : 1),
+    compositedQueue(depth > 0 ? depth : 1) {
+    if (depth > 0) {
+        compositeThread = std::thread(&FramePipeline::compositeLoop, this);
+        effectsThread = std::thread(&FramePipeline::effectsLoop, this);
+    }
+}
+
+FramePipeline::~FramePipeline() {
+    stop();
+}
+
+void FramePipeline::submit(FrameJob&& job) {
+    if (depth == 0) {
+        composite(job);
+        effects(job);
+        finish(job);
+        return;
+    }
+
+    int spins = 0;
+    while (!decodedQueue.tryPush(std::move(job))) {
+        if (!running.load()) {
+            return;
+        }
+        backoff(spins);
+    }
+}
+
+void FramePipeline::stop() {
+    running.store(false);
+    if (compositeThread.joinable()) {
+        compositeThread.join();
+    }
+    if (effectsThread.joinable()) {
+        effectsThread.join();
+    }
+}
+
+void FramePipeline::compositeLoop() {
+    if (threadSetup) {
+        threadSetup();
+    }
+    FrameJob job;
+    int spins = 0;
+    while (running.load()) {
+        if (!decodedQueue.tryPop(job)) {
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+
+        composite(job);
+
+        while (!compositedQueue.tryPush(std::move(job))) {
+            if (!running.load()) {
+                return;
+            }
+            backoff(spins);
+        }
+        spins = 0;
+    }
+}
+
+void FramePipeline::effectsLoop() {
+    if (threadSetup) {
+        threadSetup();
+    }
+    FrameJob job;
+    int spins = 0;
+    while (running.load()) {
+        if (!compositedQueue.tryPop(job)) {
+            backoff(spins);
+            continue;
+        }
+        spins = 0;
+
+        effects(job);
+        finish(job);
+    }
+}
+
+void FramePipeline::finish(FrameJob& job) {
+    sink(job);
+
+    double frameLatency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.decodeStart).count();
+    double smoothed = latencyMs.load(std::memory_order_relaxed);
+    latencyMs.store(smoothed + LATENCY_SMOOTHING * (frameLatency - smoothed), std::memory_order_relaxed);
+}
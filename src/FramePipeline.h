@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "SpscQueue.h"
+
+// Everything a frame needs once it leaves the decode stage. The decode stage
+// snapshots all shared state (assets, beat, effect flags) into the job so the
+// later stages never touch the player or the asset manager's active assets.
+struct FrameJob {
+    long long index = 0;
+    cv::Mat background;
+    cv::Mat foreground;
+    double foregroundScale = 100.0;
+    cv::Scalar foregroundColor;
+    cv::Size renderSize;
+    int interpolation = cv::INTER_LINEAR;
+    bool strobeWhite = false;
+    std::chrono::steady_clock::time_point decodeStart;
+
+    cv::Mat output;
+};
+
+// Runs the stages after decoding, scale/composite and effects, on their own
+// threads joined by bounded SPSC queues, and hands the result to the sink.
+// Frame N+1 is decoded while frame N is composited, at the cost of up to
+// `depth` frames of latency per queue. A depth of 0 runs every stage inline on
+// the caller, which is the original single-threaded behaviour.
+class FramePipeline {
+public:
+    using StageFunction = std::function<void(FrameJob&)>;
+
+    // `threadSetup` runs first on each stage thread, e.g. to apply its thread role
+    FramePipeline(size_t depth, StageFunction composite, StageFunction effects, StageFunction sink,
+                  std::function<void()> threadSetup = nullptr);
+    ~FramePipeline();
+
+    // Blocks while the pipeline is full, which paces the decode stage
+    void submit(FrameJob&& job);
+    void stop();
+
+    bool isPipelined() const { return depth > 0; }
+
+    // Smoothed time from the start of decoding to handing the frame to the sink
+    double getLatency() const { return latencyMs.load(std::memory_order_relaxed); }
+
+private:
+    void compositeLoop();
+    void effectsLoop();
+    void finish(FrameJob& job);
+
+    size_t depth;
+    StageFunction composite;
+    StageFunction effects;
+    StageFunction sink;
+    std::function<void()> threadSetup;
+
+    SpscQueue<FrameJob> decodedQueue;
+    SpscQueue<FrameJob> compositedQueue;
+
+    std::atomic<bool> running{true};
+    std::atomic<double> latencyMs{0.0};
+    std::thread compositeThread;
+    std::thread effectsThread;
+};
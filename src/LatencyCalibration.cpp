@@ -0,0 +1,206 @@
+#include "LatencyCalibration.h"
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "BpmDetector.h"
+#include "ThreadPolicy.h"
+
+// A tempo the estimator settles on quickly, with beats far enough apart that
+// any realistic delay is less than half a beat
+static const double CALIBRATION_BPM = 120.0;
+
+// Tracked beats thrown away while the tracker settles, then the beats measured
+static const size_t CALIBRATION_SETTLE_BEATS = 8;
+static const size_t CALIBRATION_BEATS = 32;
+
+// Give up if the tracker goes this long without a new locked beat
+static const std::chrono::seconds CALIBRATION_TIMEOUT(30);
+
+// Each click is a burst of noise decaying over a few milliseconds, a clear onset in every band
+static const double CLICK_LENGTH_SECONDS = 0.02;
+static const double CLICK_DECAY_SECONDS = 0.003;
+static const float CLICK_LEVEL = 0.8f;
+
+static int64_t toNanoseconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+// Plays clicks at a fixed tempo on the default output and remembers when
+// the latest one reached the DAC
+class ClickTrack {
+public:
+    explicit ClickTrack(double bpm) :
+        periodSamples(static_cast<uint64_t>(std::llround(SAMPLE_RATE * 60.0 / bpm))) {}
+
+    ~ClickTrack() {
+        stop();
+    }
+
+    bool start() {
+        PaError err = Pa_Initialize();
+        if (err != paNoError) {
+            std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
+            return false;
+        }
+        isInitialized = true;
+
+        PaDeviceIndex device = Pa_GetDefaultOutputDevice();
+        if (device == paNoDevice) {
+            std::cerr << "No audio output device for the click track." << std::endl;
+            return false;
+        }
+
+        PaStreamParameters outputParameters;
+        outputParameters.device = device;
+        outputParameters.channelCount = 1;
+        outputParameters.sampleFormat = paFloat32;
+        outputParameters.suggestedLatency = Pa_GetDeviceInfo(device)->defaultLowOutputLatency;
+        outputParameters.hostApiSpecificStreamInfo = NULL;
+
+        err = Pa_OpenStream(&stream, NULL, &outputParameters, SAMPLE_RATE, FRAMES_PER_BUFFER, paClipOff, &ClickTrack::callback, this);
+        if (err == paNoError) {
+            err = Pa_StartStream(stream);
+        }
+        if (err != paNoError) {
+            std::cerr << "PortAudio error: " << Pa_GetErrorText(err) << std::endl;
+            return false;
+        }
+
+        std::cout << "Playing clicks on: " << Pa_GetDeviceInfo(device)->name << std::endl;
+        return true;
+    }
+
+    void stop() {
+        if (stream) {
+            Pa_StopStream(stream);
+            Pa_CloseStream(stream);
+            stream = nullptr;
+        }
+        if (isInitialized) {
+            Pa_Terminate();
+            isInitialized = false;
+        }
+    }
+
+    double getPeriodSec() const { return static_cast<double>(periodSamples) / SAMPLE_RATE; }
+
+    // steady_clock time in ns the latest click left the output, 0 before the first one
+    int64_t getLastClickNs() const { return lastClickNs.load(std::memory_order_acquire); }
+
+private:
+    static int callback(const void* inputBuffer, void* outputBuffer,
+        unsigned long framesPerBuffer,
+        const PaStreamCallbackTimeInfo* timeInfo,
+        PaStreamCallbackFlags statusFlags,
+        void* userData) {
+        ClickTrack* track = static_cast<ClickTrack*>(userData);
+        float* output = static_cast<float*>(outputBuffer);
+
+        // The first sample of this buffer reaches the DAC this long from now
+        double outputLatency = timeInfo ? timeInfo->outputBufferDacTime - timeInfo->currentTime : 0.0;
+        if (outputLatency < 0.0 || outputLatency > 1.0) {
+            outputLatency = 0.0;
+        }
+        int64_t bufferStartNs = toNanoseconds(std::chrono::steady_clock::now()) + static_cast<int64_t>(outputLatency * 1e9);
+
+        const uint64_t clickLength = static_cast<uint64_t>(CLICK_LENGTH_SECONDS * SAMPLE_RATE);
+        for (unsigned long i = 0; i < framesPerBuffer; ++i) {
+            uint64_t position = (track->sample + i) % track->periodSamples;
+            if (position == 0) {
+                track->lastClickNs.store(bufferStartNs + static_cast<int64_t>(i * 1e9 / SAMPLE_RATE), std::memory_order_release);
+            }
+
+            float value = 0.0f;
+            if (position < clickLength) {
+                track->noise = track->noise * 1664525u + 1013904223u;
+                float white = static_cast<float>(track->noise >> 8) / 8388608.0f - 1.0f;
+                value = CLICK_LEVEL * white * static_cast<float>(std::exp(-static_cast<double>(position) / (CLICK_DECAY_SECONDS * SAMPLE_RATE)));
+            }
+            output[i] = value;
+        }
+        track->sample += framesPerBuffer;
+        return paContinue;
+    }
+
+    uint64_t periodSamples;
+    uint64_t sample = 0;
+    uint32_t noise = 1;
+    std::atomic<int64_t> lastClickNs{0};
+    PaStream* stream = nullptr;
+    bool isInitialized = false;
+};
+
+int runLatencyCalibration(const AppConfig& config, const DetectionSettings& settings) {
+    std::cout << "Latency calibration: playing clicks at " << CALIBRATION_BPM << " BPM." << std::endl;
+    // The clicks have to be heard, whatever source the show is configured with
+    if (!bpmDetectionInit(settings, std::make_unique<PortAudioSource>(config.audioDevice, config.audioSampleRate, config.audioChannels))) {
+        return 1;
+    }
+
+    std::thread analysisThread([&config]() {
+        applyThreadRole(ThreadRole::AudioAnalysis, config.getThreadPolicy(ThreadRole::AudioAnalysis));
+        bpmDetectionLoop();
+    });
+    auto stopAnalysis = [&analysisThread]() {
+        bpmDetectionStop();
+        analysisThread.join();
+    };
+
+    ClickTrack clicks(CALIBRATION_BPM);
+    if (!clicks.start()) {
+        stopAnalysis();
+        return 1;
+    }
+    double periodSec = clicks.getPeriodSec();
+
+    // One measurement per new tracked beat: its distance from the nearest click.
+    // The tracker may count beats differently, only the phase matters.
+    std::vector<double> delaysMs;
+    size_t lockedBeats = 0;
+    int64_t lastAnchorNs = 0;
+    auto deadline = std::chrono::steady_clock::now() + CALIBRATION_TIMEOUT;
+    while (delaysMs.size() < CALIBRATION_BEATS) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            std::cerr << std::endl << "The beat tracker did not lock onto the clicks. Turn the speakers up or move the microphone closer." << std::endl;
+            stopAnalysis();
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        BeatPhase phase = g_beatPhase.getPhase();
+        int64_t clickNs = clicks.getLastClickNs();
+        if (!phase.locked || clickNs == 0 || phase.anchorNs == lastAnchorNs) {
+            continue;
+        }
+        lastAnchorNs = phase.anchorNs;
+        deadline = std::chrono::steady_clock::now() + CALIBRATION_TIMEOUT;
+        if (++lockedBeats <= CALIBRATION_SETTLE_BEATS) {
+            continue;
+        }
+
+        double delaySec = std::fmod((phase.anchorNs - clickNs) / 1e9, periodSec);
+        if (delaySec > periodSec / 2.0) {
+            delaySec -= periodSec;
+        } else if (delaySec < -periodSec / 2.0) {
+            delaySec += periodSec;
+        }
+        delaysMs.push_back(delaySec * 1000.0);
+    }
+    clicks.stop();
+    stopAnalysis();
+
+    std::sort(delaysMs.begin(), delaysMs.end());
+    double medianMs = delaysMs[delaysMs.size() / 2];
+    double spreadMs = delaysMs[delaysMs.size() * 3 / 4] - delaysMs[delaysMs.size() / 4];
+
+    std::cout << std::endl << std::fixed << std::setprecision(1)
+              << "Beats are detected " << medianMs << " ms after they sound (interquartile spread "
+              << spreadMs << " ms over " << delaysMs.size() << " beats)." << std::endl;
+    std::cout << "Set \"latency\": { \"audio_delay_ms\": " << medianMs << " } in config/config.json"
+              << " (currently " << config.audioDelayMs << ")." << std::endl;
+    return 0;
+}
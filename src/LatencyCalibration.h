@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ConfigManager.h"
+
+struct DetectionSettings;
+
+// Measures how late the audio beat tracker hears a beat, run with
+// `VisualHive --calibrate`. A click track is played on the default output
+// while the configured input device listens to it, whatever the audio source;
+// the offset between the clicks leaving the output and the beats the tracker
+// locks onto is the value for
+// "latency": { "audio_delay_ms": ... } in the config. Place the microphone
+// where it hears the speakers the way it hears the music during a show.
+// Each engine detects with its own delay, so `settings` should be the ones
+// the show runs with. Returns the process exit code.
+int runLatencyCalibration(const AppConfig& config, const DetectionSettings& settings);
@@ -0,0 +1,209 @@
+#include "MidiInput.h"
+#include <iostream>
+#include <algorithm>
+#include <RtMidi.h>
+
+const int MIDI_CLOCK_PPQN = 24;
+
+// Pulses needed before a tempo is trusted, a quarter of a beat
+static const size_t CLOCK_MIN_FIT_TICKS = 6;
+
+// A gap this long means the clock stopped or jumped, start the fit again
+static const int64_t CLOCK_TIMEOUT_NS = 500000000;
+
+// Name of the port the input opens or creates
+static const char* MIDI_PORT_NAME = "VisualHive";
+
+static int64_t toNanoseconds(std::chrono::steady_clock::time_point timestamp) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp.time_since_epoch()).count();
+}
+
+bool MidiClock::isActive() const {
+    Snapshot snapshot = published.load();
+    return running.load(std::memory_order_relaxed) && snapshot.bpm > 0.0 &&
+           toNanoseconds(std::chrono::steady_clock::now()) - snapshot.lastTickNs < CLOCK_TIMEOUT_NS;
+}
+
+double MidiClock::getBpm() const {
+    return published.load().bpm;
+}
+
+double MidiClock::getBeat(std::chrono::steady_clock::time_point now) const {
+    Snapshot snapshot = published.load();
+    if (snapshot.bpm <= 0.0) {
+        return snapshot.anchorBeat;
+    }
+    double elapsedSeconds = (toNanoseconds(now) - snapshot.anchorNs) / 1e9;
+    return snapshot.anchorBeat + elapsedSeconds * snapshot.bpm / 60.0;
+}
+
+void MidiClock::onTick(std::chrono::steady_clock::time_point timestamp) {
+    int64_t tickNs = toNanoseconds(timestamp);
+    if (previousTickNs != 0 && tickNs - previousTickNs > CLOCK_TIMEOUT_NS) {
+        fitCount = 0;
+    }
+    previousTickNs = tickNs;
+
+    tickTimes[fitNext] = tickNs;
+    fitNext = (fitNext + 1) % FIT_WINDOW;
+    fitCount = std::min(fitCount + 1, FIT_WINDOW);
+
+    double position = static_cast<double>(ticksSinceStart) / MIDI_CLOCK_PPQN;
+    ++ticksSinceStart;
+
+    if (fitCount < CLOCK_MIN_FIT_TICKS) {
+        published.store({ published.load().bpm, position, tickNs, tickNs });
+        return;
+    }
+
+    // Least-squares line through (pulse, time), relative to the oldest pulse
+    size_t oldest = (fitNext + FIT_WINDOW - fitCount) % FIT_WINDOW;
+    int64_t originNs = tickTimes[oldest];
+    double n = static_cast<double>(fitCount);
+    double meanX = (n - 1.0) / 2.0;
+    double meanY = 0.0;
+    for (size_t i = 0; i < fitCount; ++i) {
+        meanY += static_cast<double>(tickTimes[(oldest + i) % FIT_WINDOW] - originNs);
+    }
+    meanY /= n;
+    double covariance = 0.0;
+    double variance = 0.0;
+    for (size_t i = 0; i < fitCount; ++i) {
+        double dx = static_cast<double>(i) - meanX;
+        covariance += dx * (static_cast<double>(tickTimes[(oldest + i) % FIT_WINDOW] - originNs) - meanY);
+        variance += dx * dx;
+    }
+    double nsPerTick = covariance / variance;
+    if (nsPerTick <= 0.0) {
+        return;
+    }
+
+    // Anchor on where the line puts the newest pulse, not on its jittered arrival
+    int64_t fittedNs = originNs + static_cast<int64_t>(meanY + nsPerTick * (n - 1.0 - meanX));
+    published.store({ 60e9 / (nsPerTick * MIDI_CLOCK_PPQN), position, fittedNs, tickNs });
+}
+
+void MidiClock::onStart() {
+    // The next pulse is the first of beat zero
+    ticksSinceStart = 0;
+    running.store(true);
+}
+
+void MidiClock::onContinue() {
+    running.store(true);
+}
+
+void MidiClock::onStop() {
+    running.store(false);
+}
+
+MidiInput::MidiInput(const AppConfig& config, EventQueue& queue) :
+    queue(queue),
+    useClock(config.midiClock) {
+    noteActions.fill(-1);
+    controlActions.fill(-1);
+    for (const auto& [number, action] : config.midiNoteActions) {
+        noteActions[number] = action;
+    }
+    for (const auto& [number, action] : config.midiControlActions) {
+        controlActions[number] = action;
+    }
+
+    try {
+        auto input = std::make_unique<RtMidiIn>(RtMidi::UNSPECIFIED, MIDI_PORT_NAME);
+        if (config.midiVirtualPort) {
+            input->openVirtualPort(MIDI_PORT_NAME);
+            std::cout << "MIDI input: virtual port " << MIDI_PORT_NAME << std::endl;
+        } else {
+            unsigned int portCount = input->getPortCount();
+            unsigned int selected = portCount;
+            for (unsigned int i = 0; i < portCount; ++i) {
+                if (config.midiPort.empty() || input->getPortName(i).find(config.midiPort) != std::string::npos) {
+                    selected = i;
+                    break;
+                }
+            }
+            if (selected == portCount) {
+                std::cerr << "No MIDI input port" << (config.midiPort.empty() ? "" : " matching \"" + config.midiPort + "\"") << " found." << std::endl;
+                return;
+            }
+            input->openPort(selected, MIDI_PORT_NAME);
+            std::cout << "MIDI input: " << input->getPortName(selected) << std::endl;
+        }
+
+        // Keep clock messages only when following the clock, drop sysex and active sensing
+        input->ignoreTypes(true, !useClock, true);
+        input->setCallback(&MidiInput::onMidiMessage, this);
+        midiIn = std::move(input);
+    } catch (const RtMidiError& error) {
+        std::cerr << "MIDI error: " << error.getMessage() << std::endl;
+    }
+}
+
+MidiInput::~MidiInput() {
+    if (midiIn) {
+        midiIn->cancelCallback();
+        midiIn->closePort();
+    }
+}
+
+void MidiInput::onMidiMessage(double deltaTime, std::vector<unsigned char>* message, void* userData) {
+    // Stamp first, before any decoding
+    auto timestamp = std::chrono::steady_clock::now();
+    if (message && !message->empty()) {
+        static_cast<MidiInput*>(userData)->handleMessage(message->data(), message->size(), timestamp);
+    }
+}
+
+void MidiInput::handleMessage(const unsigned char* bytes, size_t size, std::chrono::steady_clock::time_point timestamp) {
+    unsigned char status = bytes[0];
+    switch (status) {
+        case 0xF8: // Timing clock
+            if (useClock) {
+                clock.onTick(timestamp);
+            }
+            return;
+        case 0xFA: // Start
+            clock.onStart();
+            return;
+        case 0xFB: // Continue
+            clock.onContinue();
+            return;
+        case 0xFC: // Stop
+            clock.onStop();
+            return;
+    }
+
+    if (size < 3) {
+        return;
+    }
+    int number = bytes[1] & 0x7F;
+    int value = bytes[2] & 0x7F;
+
+    // Any channel
+    switch (status & 0xF0) {
+        case 0x90: // Note on, velocity 0 is a note off
+            pushAction(noteActions[number], number, value > 0, timestamp);
+            break;
+        case 0x80: // Note off
+            pushAction(noteActions[number], number, false, timestamp);
+            break;
+        case 0xB0: { // Control change, only crossing the midpoint counts
+            bool isDown = value >= 64;
+            if (isDown != controlDown[number]) {
+                controlDown[number] = isDown;
+                pushAction(controlActions[number], number, isDown, timestamp);
+            }
+            break;
+        }
+    }
+}
+
+void MidiInput::pushAction(int action, int number, bool isDown, std::chrono::steady_clock::time_point timestamp) {
+    if (action < 0) {
+        return;
+    }
+    Event event = { AppEventType::MIDI, action, number, isDown };
+    event.timestamp = timestamp;
+    queue.push(event);
+}
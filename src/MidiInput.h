@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BeatSource.h"
+#include "ConfigManager.h"
+#include "EventQueue.h"
+#include "SeqLock.h"
+
+class RtMidiIn;
+
+// MIDI clock runs at 24 pulses per quarter note
+extern const int MIDI_CLOCK_PPQN;
+
+// Tempo and beat position from incoming MIDI clock (0xF8) with Start (0xFA),
+// Continue (0xFB) and Stop (0xFC). Tempo comes from a least-squares line through
+// the last two beats of pulses, so the jitter of single pulses averages out.
+// Only the MIDI thread updates the clock; the frame loop reads it lock-free.
+class MidiClock : public BeatSource {
+public:
+    std::string getName() const override { return "midi clock"; }
+    bool isActive() const override;
+    double getBpm() const override;
+    double getBeat(std::chrono::steady_clock::time_point now) const override;
+
+    // MIDI thread only
+    void onTick(std::chrono::steady_clock::time_point timestamp);
+    void onStart();
+    void onContinue();
+    void onStop();
+
+private:
+    struct Snapshot {
+        double bpm;
+        double anchorBeat;
+        int64_t anchorNs;
+        int64_t lastTickNs;
+    };
+
+    static const size_t FIT_WINDOW = 48;
+
+    // MIDI thread state
+    std::array<int64_t, FIT_WINDOW> tickTimes{};
+    size_t fitCount = 0;
+    size_t fitNext = 0;
+    long long ticksSinceStart = 0;
+    int64_t previousTickNs = 0;
+
+    // Published state
+    SeqLock<Snapshot> published;
+    std::atomic<bool> running{true};
+};
+
+// Reads a MIDI input port, timestamps every message in the driver callback and
+// turns mapped notes and controllers into events on the EventQueue. Actions are
+// the same keys the keyboard uses, looked up in tables built once at startup.
+class MidiInput {
+public:
+    MidiInput(const AppConfig& config, EventQueue& queue);
+    ~MidiInput();
+
+    bool isOpen() const { return midiIn != nullptr; }
+    MidiClock& getClock() { return clock; }
+
+    // Decodes one message; called from the driver callback
+    void handleMessage(const unsigned char* bytes, size_t size, std::chrono::steady_clock::time_point timestamp);
+
+private:
+    static void onMidiMessage(double deltaTime, std::vector<unsigned char>* message, void* userData);
+    void pushAction(int action, int number, bool isDown, std::chrono::steady_clock::time_point timestamp);
+
+    std::unique_ptr<RtMidiIn> midiIn;
+    EventQueue& queue;
+    MidiClock clock;
+    bool useClock;
+
+    // Key code per note and controller number, -1 when unmapped
+    std::array<int, 128> noteActions;
+    std::array<int, 128> controlActions;
+    // Controllers act like keys: down above the midpoint, up below it
+    std::array<bool, 128> controlDown{};
+};
@@ -0,0 +1,426 @@
+#include "OnsetTempoEngine.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+// Onset windows span four hops, within these sizes
+static const size_t MIN_WINDOW_SIZE = 512;
+static const size_t MAX_WINDOW_SIZE = 1024;
+
+// Onset strength the tempo is estimated from, how much of it must be heard
+// before the first estimate, and how often the estimate is refreshed
+static const double HISTORY_SECONDS = 6.0;
+static const double MIN_HISTORY_SECONDS = 2.5;
+static const std::chrono::milliseconds ENGINE_TEMPO_INTERVAL(100);
+
+// Tempo range, and the log-normal prior that settles the octave when the comb
+// filter can't: centred on PRIOR_BPM, PRIOR_OCTAVES wide
+static const double MIN_BPM = 60.0;
+static const double MAX_BPM = 200.0;
+static const double PRIOR_BPM = 125.0;
+static const double PRIOR_OCTAVES = 0.6;
+static const size_t COMB_MULTIPLES = 4;
+static const double BPM_RESOLUTION = 0.1;
+
+// Beats of onset strength the phase is matched against, each worth less than the one after it
+static const int PHASE_BEATS = 8;
+static const double PHASE_DECAY = 0.8;
+
+// Onset peaks must stand this far above the recent average onset strength
+static const double ONSET_AVERAGE_SECONDS = 0.25;
+static const float ONSET_THRESHOLD_FACTOR = 1.5f;
+
+// Independent partial sums for the spectral flux, so the sum vectorises
+static const size_t FLUX_LANES = 8;
+
+// Level meter: analysis window, band edges in Hz (in AudioBand order), how fast
+// envelopes fall, how long the loudest level is remembered for scaling, and
+// the quietest level that is scaled up to 1
+static const size_t LEVEL_WINDOW_SIZE = 1024;
+static const double BAND_EDGES_HZ[] = { 30.0, 150.0, 800.0, 5000.0, 16000.0 };
+static const double LEVEL_RELEASE_SECONDS = 0.15;
+static const double LEVEL_REFERENCE_SECONDS = 8.0;
+static const float LEVEL_FLOOR = 1e-4f;
+
+static size_t nextPowerOfTwo(size_t value) {
+    size_t power = 1;
+    while (power < value) {
+        power <<= 1;
+    }
+    return power;
+}
+
+RealFft::RealFft(size_t size) :
+    n(size),
+    half(size / 2),
+    bitReverse(half),
+    twiddleReal(half - 1),
+    twiddleImag(half - 1),
+    unpackCos(half),
+    unpackSin(half),
+    workReal(half),
+    workImag(half) {
+    int bits = 0;
+    while ((size_t(1) << bits) < half) {
+        ++bits;
+    }
+    for (size_t i = 0; i < half; ++i) {
+        uint32_t reversed = 0;
+        for (int bit = 0; bit < bits; ++bit) {
+            reversed |= ((i >> bit) & 1u) << (bits - 1 - bit);
+        }
+        bitReverse[i] = reversed;
+    }
+
+    for (size_t span = 1; span < half; span <<= 1) {
+        for (size_t j = 0; j < span; ++j) {
+            double angle = -M_PI * static_cast<double>(j) / static_cast<double>(span);
+            twiddleReal[span - 1 + j] = static_cast<float>(std::cos(angle));
+            twiddleImag[span - 1 + j] = static_cast<float>(std::sin(angle));
+        }
+    }
+    for (size_t k = 0; k < half; ++k) {
+        double angle = 2.0 * M_PI * static_cast<double>(k) / static_cast<double>(n);
+        unpackCos[k] = static_cast<float>(std::cos(angle));
+        unpackSin[k] = static_cast<float>(std::sin(angle));
+    }
+}
+
+void RealFft::forward(const float* input, float* real, float* imag) {
+    // Even samples as the real part and odd ones as the imaginary part, in bit-reversed order
+    for (size_t i = 0; i < half; ++i) {
+        workReal[bitReverse[i]] = input[2 * i];
+        workImag[bitReverse[i]] = input[2 * i + 1];
+    }
+
+    for (size_t span = 1; span < half; span <<= 1) {
+        const float* wr = twiddleReal.data() + span - 1;
+        const float* wi = twiddleImag.data() + span - 1;
+        for (size_t start = 0; start < half; start += 2 * span) {
+            float* ar = workReal.data() + start;
+            float* ai = workImag.data() + start;
+            float* br = ar + span;
+            float* bi = ai + span;
+            for (size_t j = 0; j < span; ++j) {
+                float tr = wr[j] * br[j] - wi[j] * bi[j];
+                float ti = wr[j] * bi[j] + wi[j] * br[j];
+                br[j] = ar[j] - tr;
+                bi[j] = ai[j] - ti;
+                ar[j] += tr;
+                ai[j] += ti;
+            }
+        }
+    }
+
+    // Split into the spectra of the even and odd samples and recombine them
+    real[0] = workReal[0] + workImag[0];
+    imag[0] = 0.0f;
+    real[half] = workReal[0] - workImag[0];
+    imag[half] = 0.0f;
+    for (size_t k = 1; k < half; ++k) {
+        float evenReal = 0.5f * (workReal[k] + workReal[half - k]);
+        float evenImag = 0.5f * (workImag[k] - workImag[half - k]);
+        float oddReal = 0.5f * (workImag[k] + workImag[half - k]);
+        float oddImag = -0.5f * (workReal[k] - workReal[half - k]);
+        real[k] = evenReal + unpackCos[k] * oddReal + unpackSin[k] * oddImag;
+        imag[k] = evenImag + unpackCos[k] * oddImag - unpackSin[k] * oddReal;
+    }
+}
+
+OnsetTempoEngine::OnsetTempoEngine(double sampleRate, size_t hopSize) :
+    sampleRate(sampleRate),
+    hopSize(hopSize),
+    windowSize(std::clamp(4 * hopSize, MIN_WINDOW_SIZE, MAX_WINDOW_SIZE)),
+    frameRate(sampleRate / hopSize),
+    spectrumFft(windowSize),
+    input(windowSize, 0.0f),
+    window(windowSize),
+    frame(windowSize),
+    spectrumReal(windowSize / 2 + 1),
+    spectrumImag(windowSize / 2 + 1),
+    magnitude(windowSize / 2 + 1, 0.0f),
+    previousMagnitude(windowSize / 2 + 1, 0.0f),
+    historyFrames(static_cast<size_t>(std::ceil(HISTORY_SECONDS * frameRate))),
+    // Twice the history, so the autocorrelation doesn't wrap around
+    autocorrelationFft(nextPowerOfTwo(2 * historyFrames)),
+    padded(autocorrelationFft.size()),
+    powerReal(autocorrelationFft.size() / 2 + 1),
+    powerImag(autocorrelationFft.size() / 2 + 1),
+    autocorrelation(historyFrames),
+    minLag(static_cast<size_t>(std::floor(60.0 * frameRate / MAX_BPM))),
+    maxLag(static_cast<size_t>(std::ceil(60.0 * frameRate / MIN_BPM))),
+    tempoIntervalFrames(std::max<uint64_t>(1, static_cast<uint64_t>(frameRate * ENGINE_TEMPO_INTERVAL.count() / 1000.0))),
+    nextTempoFrame(static_cast<uint64_t>(MIN_HISTORY_SECONDS * frameRate)),
+    lastBeatFrame(-std::numeric_limits<double>::max()) {
+    history.assign(historyFrames, 0.0f);
+
+    for (size_t i = 0; i < windowSize; ++i) {
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * i / windowSize));
+    }
+    for (size_t lag = minLag; lag <= maxLag; ++lag) {
+        double octaves = std::log2(60.0 * frameRate / lag / PRIOR_BPM) / PRIOR_OCTAVES;
+        lagPrior.push_back(std::exp(-0.5 * octaves * octaves));
+    }
+}
+
+bool OnsetTempoEngine::process(const float* samples) {
+    std::copy(input.begin() + hopSize, input.end(), input.begin());
+    std::copy(samples, samples + hopSize, input.end() - hopSize);
+    for (size_t i = 0; i < windowSize; ++i) {
+        frame[i] = input[i] * window[i];
+    }
+    spectrumFft.forward(frame.data(), spectrumReal.data(), spectrumImag.data());
+
+    // Magnitudes and their rise, in straight loops over the split spectrum that vectorise
+    const size_t bins = magnitude.size();
+    const float* real = spectrumReal.data();
+    const float* imag = spectrumImag.data();
+    float* current = magnitude.data();
+    const float* previous = previousMagnitude.data();
+    for (size_t bin = 0; bin < bins; ++bin) {
+        current[bin] = std::sqrt(real[bin] * real[bin] + imag[bin] * imag[bin]);
+    }
+
+    float lanes[FLUX_LANES] = {};
+    size_t bin = 0;
+    for (; bin + FLUX_LANES <= bins; bin += FLUX_LANES) {
+        for (size_t lane = 0; lane < FLUX_LANES; ++lane) {
+            lanes[lane] += std::max(current[bin + lane] - previous[bin + lane], 0.0f);
+        }
+    }
+    float flux = 0.0f;
+    for (; bin < bins; ++bin) {
+        flux += std::max(current[bin] - previous[bin], 0.0f);
+    }
+    for (float lane : lanes) {
+        flux += lane;
+    }
+    magnitude.swap(previousMagnitude);
+
+    // The first frame rises from nothing
+    if (frameCount == 0) {
+        flux = 0.0f;
+    }
+    history[frameCount % historyFrames] = flux;
+
+    // A peak in the previous frame that stands out from the recent average
+    onsetDetected = isRising && flux <= onsetStrength && onsetStrength > ONSET_THRESHOLD_FACTOR * onsetAverage;
+    if (onsetDetected) {
+        onsetTime = getFrameTime(static_cast<double>(frameCount) - 1.0);
+    }
+    isRising = flux > onsetStrength;
+    onsetStrength = flux;
+    onsetAverage += static_cast<float>((flux - onsetAverage) / (ONSET_AVERAGE_SECONDS * frameRate));
+
+    bool isUpdated = false;
+    if (frameCount >= nextTempoFrame) {
+        isUpdated = estimateTempo();
+        nextTempoFrame += tempoIntervalFrames;
+    }
+
+    beatDetected = periodFrames > 0.0 && static_cast<double>(frameCount) >= nextBeatFrame;
+    if (beatDetected) {
+        beatTime = getFrameTime(nextBeatFrame);
+        lastBeatFrame = nextBeatFrame;
+        nextBeatFrame += periodFrames;
+    }
+
+    ++frameCount;
+    return isUpdated;
+}
+
+bool OnsetTempoEngine::estimateTempo() {
+    size_t available = static_cast<size_t>(std::min<uint64_t>(frameCount + 1, historyFrames));
+
+    // Onset strength oldest first less its mean, zero padded so the autocorrelation is linear
+    double mean = 0.0;
+    for (size_t age = 0; age < available; ++age) {
+        mean += getHistory(age);
+    }
+    mean /= available;
+    std::fill(padded.begin(), padded.end(), 0.0f);
+    for (size_t age = 0; age < available; ++age) {
+        padded[available - 1 - age] = static_cast<float>(getHistory(age) - mean);
+    }
+    autocorrelationFft.forward(padded.data(), powerReal.data(), powerImag.data());
+
+    // The power spectrum is real and even, so transforming it forward gives the autocorrelation
+    const size_t size = autocorrelationFft.size();
+    for (size_t k = 0; k <= size / 2; ++k) {
+        padded[k] = powerReal[k] * powerReal[k] + powerImag[k] * powerImag[k];
+    }
+    for (size_t k = size / 2 + 1; k < size; ++k) {
+        padded[k] = padded[size - k];
+    }
+    autocorrelationFft.forward(padded.data(), powerReal.data(), powerImag.data());
+    for (size_t lag = 0; lag < available; ++lag) {
+        // Per overlapping pair, so long lags aren't penalised for overlapping less
+        autocorrelation[lag] = powerReal[lag] / static_cast<float>(available - lag);
+    }
+
+    // Comb filter: the autocorrelation around each multiple of the lag, wider
+    // for the higher multiples, as many multiples as the history supports
+    const size_t usable = available * 3 / 4;
+    size_t multiples = std::min(COMB_MULTIPLES, (usable - COMB_MULTIPLES) / maxLag);
+    if (multiples == 0) {
+        return false;
+    }
+    auto peakNear = [this](size_t centre, size_t spread) {
+        size_t peak = centre - spread;
+        for (size_t lag = centre - spread + 1; lag <= centre + spread; ++lag) {
+            if (autocorrelation[lag] > autocorrelation[peak]) {
+                peak = lag;
+            }
+        }
+        return peak;
+    };
+
+    double bestScore = 0.0;
+    size_t bestLag = 0;
+    for (size_t lag = minLag; lag <= maxLag; ++lag) {
+        double score = 0.0;
+        for (size_t multiple = 1; multiple <= multiples; ++multiple) {
+            score += autocorrelation[peakNear(multiple * lag, multiple - 1)];
+        }
+        score *= lagPrior[lag - minLag];
+        if (score > bestScore) {
+            bestScore = score;
+            bestLag = lag;
+        }
+    }
+    // Silence, or nothing periodic
+    if (bestLag == 0) {
+        return false;
+    }
+
+    // The peak at the highest multiple pins the period down the most finely
+    size_t peak = peakNear(multiples * bestLag, multiples);
+    double offset = 0.0;
+    if (peak > 0 && peak + 1 < available) {
+        double before = autocorrelation[peak - 1];
+        double at = autocorrelation[peak];
+        double after = autocorrelation[peak + 1];
+        double curvature = before - 2.0 * at + after;
+        if (curvature < 0.0) {
+            offset = std::clamp(0.5 * (before - after) / curvature, -0.5, 0.5);
+        }
+    }
+    periodFrames = (peak + offset) / multiples;
+    bpm = std::round(60.0 * frameRate / periodFrames / BPM_RESOLUTION) * BPM_RESOLUTION;
+
+    estimatePhase();
+    return true;
+}
+
+void OnsetTempoEngine::estimatePhase() {
+    size_t available = static_cast<size_t>(std::min<uint64_t>(frameCount + 1, historyFrames));
+    size_t offsets = static_cast<size_t>(std::ceil(periodFrames));
+
+    // How far back from the newest frame the last beat was
+    auto scoreAt = [&](size_t offset) {
+        double score = 0.0;
+        double weight = 1.0;
+        for (int beat = 0; beat < PHASE_BEATS; ++beat) {
+            size_t age = static_cast<size_t>(std::lround(offset + beat * periodFrames));
+            if (age >= available) {
+                break;
+            }
+            score += weight * getHistory(age);
+            weight *= PHASE_DECAY;
+        }
+        return score;
+    };
+    size_t bestOffset = 0;
+    double bestScore = -1.0;
+    for (size_t offset = 0; offset < offsets; ++offset) {
+        double score = scoreAt(offset);
+        if (score > bestScore) {
+            bestScore = score;
+            bestOffset = offset;
+        }
+    }
+
+    double lastBeat = static_cast<double>(frameCount) - static_cast<double>(bestOffset);
+    // Don't give out a beat twice
+    if (lastBeat - lastBeatFrame < periodFrames / 2.0) {
+        lastBeat += periodFrames;
+    }
+    nextBeatFrame = lastBeat;
+}
+
+double OnsetTempoEngine::getFrameTime(double frame) const {
+    // The flux of a sharp onset peaks as it passes a quarter of the window in from the newest sample
+    return ((frame + 1.0) * hopSize - windowSize / 4.0 - hopSize / 2.0) / sampleRate;
+}
+
+float OnsetTempoEngine::getHistory(size_t age) const {
+    return history[(frameCount + historyFrames - age) % historyFrames];
+}
+
+AudioLevelMeter::AudioLevelMeter(double sampleRate, size_t hopSize) :
+    hopSize(hopSize),
+    fft(LEVEL_WINDOW_SIZE),
+    input(LEVEL_WINDOW_SIZE, 0.0f),
+    window(LEVEL_WINDOW_SIZE),
+    frame(LEVEL_WINDOW_SIZE),
+    spectrumReal(LEVEL_WINDOW_SIZE / 2 + 1),
+    spectrumImag(LEVEL_WINDOW_SIZE / 2 + 1),
+    power(LEVEL_WINDOW_SIZE / 2 + 1),
+    release(static_cast<float>(std::exp(-(hopSize / sampleRate) / LEVEL_RELEASE_SECONDS))),
+    referenceRelease(static_cast<float>(std::exp(-(hopSize / sampleRate) / LEVEL_REFERENCE_SECONDS))) {
+    double windowPower = 0.0;
+    for (size_t i = 0; i < LEVEL_WINDOW_SIZE; ++i) {
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * i / LEVEL_WINDOW_SIZE));
+        windowPower += window[i] * window[i];
+    }
+    // Parseval, counting each bin for its negative-frequency twin
+    powerScale = static_cast<float>(2.0 / (LEVEL_WINDOW_SIZE * windowPower));
+
+    const double binHz = sampleRate / LEVEL_WINDOW_SIZE;
+    for (size_t band = 0; band < bandBins.size(); ++band) {
+        size_t first = static_cast<size_t>(std::ceil(BAND_EDGES_HZ[band] / binHz));
+        size_t last = static_cast<size_t>(std::ceil(BAND_EDGES_HZ[band + 1] / binHz));
+        bandBins[band] = { std::min(first, power.size()), std::min(last, power.size()) };
+    }
+}
+
+const AudioLevels& AudioLevelMeter::process(const float* samples, int64_t captureNs) {
+    float sumSquares = 0.0f;
+    float peak = 0.0f;
+    for (size_t i = 0; i < hopSize; ++i) {
+        sumSquares += samples[i] * samples[i];
+        peak = std::max(peak, std::abs(samples[i]));
+    }
+
+    std::copy(input.begin() + hopSize, input.end(), input.begin());
+    std::copy(samples, samples + hopSize, input.end() - hopSize);
+    for (size_t i = 0; i < LEVEL_WINDOW_SIZE; ++i) {
+        frame[i] = input[i] * window[i];
+    }
+    fft.forward(frame.data(), spectrumReal.data(), spectrumImag.data());
+    for (size_t bin = 0; bin < power.size(); ++bin) {
+        power[bin] = spectrumReal[bin] * spectrumReal[bin] + spectrumImag[bin] * spectrumImag[bin];
+    }
+
+    levels.captureNs = captureNs;
+    levels.rms = std::sqrt(sumSquares / hopSize);
+    levels.peak = peak;
+    levels.rmsEnvelope = follow(levels.rms, rmsFollower, rmsReference);
+    levels.peakEnvelope = follow(levels.peak, peakFollower, peakReference);
+    for (size_t band = 0; band < bandBins.size(); ++band) {
+        float bandPower = 0.0f;
+        for (size_t bin = bandBins[band].first; bin < bandBins[band].second; ++bin) {
+            bandPower += power[bin];
+        }
+        levels.bands[band] = std::sqrt(bandPower * powerScale);
+        levels.envelopes[band] = follow(levels.bands[band], bandFollowers[band], bandReferences[band]);
+    }
+    return levels;
+}
+
+float AudioLevelMeter::follow(float level, float& follower, float& reference) const {
+    follower = std::max(level, follower * release);
+    reference = std::max({ follower, reference * referenceRelease, LEVEL_FLOOR });
+    return follower / reference;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// FFT of real input, radix-2 on split real and imaginary arrays. A size-n
+// transform runs as an n/2-point complex FFT of the even and odd samples.
+class RealFft {
+public:
+    // `size` must be a power of two, at least 4
+    explicit RealFft(size_t size);
+
+    size_t size() const { return n; }
+
+    // size() samples in, size()/2 + 1 bins out
+    void forward(const float* input, float* real, float* imag);
+
+private:
+    size_t n;
+    size_t half;
+    std::vector<uint32_t> bitReverse;
+    std::vector<float> twiddleReal; // Per stage, contiguous: stage with span h starts at h - 1
+    std::vector<float> twiddleImag;
+    std::vector<float> unpackCos; // cos and sin of 2*pi*k/n, to split the half-size result
+    std::vector<float> unpackSin;
+    std::vector<float> workReal;
+    std::vector<float> workImag;
+};
+
+// Onset detection and tempo estimation without aubio, with hops short enough
+// to keep detected beats close to the music. Every hop, the spectrum of a Hann
+// window over the most recent samples is compared with the previous one; the
+// rise in magnitude summed over all bins (spectral flux) is the onset strength.
+// Every ENGINE_TEMPO_INTERVAL, the autocorrelation of the last few seconds of
+// onset strength goes through a comb filter to find the beat period, and the
+// beats are placed where the onset strength lines up best with that period.
+// Times are seconds of audio since the engine was created. One engine per
+// thread; nothing is allocated after construction.
+class OnsetTempoEngine {
+public:
+    // `hopSize` of 128, 256 or 512 samples
+    OnsetTempoEngine(double sampleRate, size_t hopSize);
+
+    size_t getHopSize() const { return hopSize; }
+    size_t getWindowSize() const { return windowSize; }
+
+    // One hop of getHopSize() mono samples. Returns true if the tempo estimate was updated.
+    bool process(const float* samples);
+
+    double getTime() const { return static_cast<double>(frameCount * hopSize) / sampleRate; }
+    // 0 until enough audio has been heard
+    double getBpm() const { return bpm; }
+
+    float getOnsetStrength() const { return onsetStrength; }
+    // Whether the hop before the last one held an onset peak, dated by getOnsetTime()
+    bool isOnset() const { return onsetDetected; }
+    double getOnsetTime() const { return onsetTime; }
+
+    // Whether a beat fell in the last hop, dated by getBeatTime()
+    bool isBeat() const { return beatDetected; }
+    double getBeatTime() const { return beatTime; }
+
+private:
+    // False if there was nothing periodic to go on
+    bool estimateTempo();
+    void estimatePhase();
+    // When the onset measured by onset frame `frame` happened
+    double getFrameTime(double frame) const;
+    // Onset strength `age` frames before the newest
+    float getHistory(size_t age) const;
+
+    double sampleRate;
+    size_t hopSize;
+    size_t windowSize;
+    double frameRate;
+
+    // Spectral flux
+    RealFft spectrumFft;
+    std::vector<float> input; // The last windowSize samples, oldest first
+    std::vector<float> window;
+    std::vector<float> frame;
+    std::vector<float> spectrumReal;
+    std::vector<float> spectrumImag;
+    std::vector<float> magnitude;
+    std::vector<float> previousMagnitude;
+
+    // Onset strength of the last historyFrames hops, circular
+    std::vector<float> history;
+    size_t historyFrames;
+    uint64_t frameCount = 0;
+
+    // Autocorrelation and comb filter
+    RealFft autocorrelationFft;
+    std::vector<float> padded;
+    std::vector<float> powerReal;
+    std::vector<float> powerImag;
+    std::vector<float> autocorrelation;
+    std::vector<double> lagPrior; // Indexed from minLag
+    size_t minLag;
+    size_t maxLag;
+    uint64_t tempoIntervalFrames;
+    uint64_t nextTempoFrame;
+
+    // Estimates
+    double bpm = 0.0;
+    double periodFrames = 0.0;
+    double nextBeatFrame = 0.0;
+    double lastBeatFrame;
+    bool beatDetected = false;
+    double beatTime = 0.0;
+
+    // Onset peak picking
+    float onsetStrength = 0.0f;
+    float onsetAverage = 0.0f;
+    bool isRising = false;
+    bool onsetDetected = false;
+    double onsetTime = 0.0;
+};
+
+// Frequency bands the level meter splits the input into
+enum class AudioBand {
+    Kick,   // 30-150 Hz
+    LowMid, // 150-800 Hz
+    Snare,  // 800 Hz-5 kHz
+    Hats,   // 5-16 kHz
+    Count
+};
+
+// Levels of the latest hop, for audio-reactive visuals. Raw levels are RMS
+// amplitudes; envelopes rise at once, fall over LEVEL_RELEASE_SECONDS and are
+// scaled so the loudest of the last several seconds is 1.
+struct AudioLevels {
+    int64_t captureNs; // steady_clock time the hop's last sample was captured
+    float rms;
+    float peak; // Largest absolute sample
+    float rmsEnvelope;
+    float peakEnvelope;
+    std::array<float, static_cast<size_t>(AudioBand::Count)> bands; // Indexed by AudioBand
+    std::array<float, static_cast<size_t>(AudioBand::Count)> envelopes;
+
+    float getEnvelope(AudioBand band) const { return envelopes[static_cast<size_t>(band)]; }
+};
+
+// Band energies from the power spectrum of the last LEVEL_WINDOW_SIZE samples,
+// binned into AudioBand ranges, plus the hop's RMS and peak. One meter per thread.
+class AudioLevelMeter {
+public:
+    AudioLevelMeter(double sampleRate, size_t hopSize);
+
+    size_t getHopSize() const { return hopSize; }
+
+    // One hop of getHopSize() mono samples, the last captured at `captureNs`
+    const AudioLevels& process(const float* samples, int64_t captureNs);
+
+private:
+    // Moves `follower` and `reference` on by one hop at `level`; returns the scaled envelope
+    float follow(float level, float& follower, float& reference) const;
+
+    size_t hopSize;
+    RealFft fft;
+    std::vector<float> input; // The last LEVEL_WINDOW_SIZE samples, oldest first
+    std::vector<float> window;
+    std::vector<float> frame;
+    std::vector<float> spectrumReal;
+    std::vector<float> spectrumImag;
+    std::vector<float> power;
+    std::array<std::pair<size_t, size_t>, static_cast<size_t>(AudioBand::Count)> bandBins; // First and one past the last bin
+    float powerScale; // From summed bin power to mean square
+    float release; // Envelope fall per hop
+    float referenceRelease;
+
+    AudioLevels levels{};
+    // Unscaled envelopes, and the references they are scaled by
+    float rmsFollower = 0.0f;
+    float peakFollower = 0.0f;
+    float rmsReference = 0.0f;
+    float peakReference = 0.0f;
+    std::array<float, static_cast<size_t>(AudioBand::Count)> bandFollowers{};
+    std::array<float, static_cast<size_t>(AudioBand::Count)> bandReferences{};
+};
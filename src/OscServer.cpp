@@ -0,0 +1,364 @@
+#include "OscServer.h"
+#include "BeatGrid.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Nested bundles deeper than this are rejected
+static const int OSC_MAX_BUNDLE_DEPTH = 8;
+
+// Timetags further ahead than this are treated as "now"
+static const double OSC_MAX_SCHEDULE_AHEAD_SECONDS = 60.0;
+
+// Seconds between the NTP epoch (1900) used by timetags and the Unix epoch
+static const uint64_t NTP_UNIX_OFFSET_SECONDS = 2208988800ULL;
+
+// How often the receive thread wakes up to check for stop()
+static const int OSC_RECEIVE_TIMEOUT_MS = 100;
+
+// Kernel receive buffer, so a burst from a desk survives a descheduled thread
+static const int OSC_SOCKET_BUFFER_BYTES = 4 * 1024 * 1024;
+
+static uint32_t readUint32(const char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return ntohl(value);
+}
+
+static uint64_t readUint64(const char* data) {
+    return (static_cast<uint64_t>(readUint32(data)) << 32) | readUint32(data + 4);
+}
+
+// Reads a null-terminated string padded to 4 bytes and moves `position` past it
+static bool readString(const char*& position, const char* end, std::string_view& value) {
+    const void* terminator = std::memchr(position, '\0', end - position);
+    if (!terminator) {
+        return false;
+    }
+    size_t length = static_cast<const char*>(terminator) - position;
+    value = std::string_view(position, length);
+    position += (length + 4) & ~static_cast<size_t>(3);
+    return position <= end;
+}
+
+const char* OscMessage::findArgument(size_t index) const {
+    if (index >= typeTags.size()) {
+        return nullptr;
+    }
+    const char* position = arguments;
+    for (size_t i = 0; i < index && position; ++i) {
+        switch (typeTags[i]) {
+            case 'i': case 'f': case 'c': case 'r': case 'm':
+                position += 4;
+                break;
+            case 'h': case 'd': case 't':
+                position += 8;
+                break;
+            case 's': case 'S': {
+                std::string_view skipped;
+                if (!readString(position, end, skipped)) {
+                    return nullptr;
+                }
+                break;
+            }
+            case 'b':
+                if (end - position < 4) {
+                    return nullptr;
+                }
+                position += 4 + ((readUint32(position) + 3) & ~3u);
+                break;
+            case 'T': case 'F': case 'N': case 'I':
+                break;
+            default:
+                return nullptr;
+        }
+        if (position > end) {
+            return nullptr;
+        }
+    }
+    return position;
+}
+
+bool OscMessage::getInt(size_t index, int32_t& value) const {
+    float asFloat;
+    const char* position = findArgument(index);
+    if (!position || end - position < 4) {
+        return false;
+    }
+    if (typeTags[index] == 'i') {
+        value = static_cast<int32_t>(readUint32(position));
+        return true;
+    }
+    if (typeTags[index] == 'f' && getFloat(index, asFloat)) {
+        value = static_cast<int32_t>(asFloat);
+        return true;
+    }
+    return false;
+}
+
+bool OscMessage::getFloat(size_t index, float& value) const {
+    const char* position = findArgument(index);
+    if (!position || end - position < 4) {
+        return false;
+    }
+    uint32_t bits = readUint32(position);
+    if (typeTags[index] == 'f') {
+        std::memcpy(&value, &bits, sizeof(value));
+        return true;
+    }
+    if (typeTags[index] == 'i') {
+        value = static_cast<float>(static_cast<int32_t>(bits));
+        return true;
+    }
+    return false;
+}
+
+bool OscMessage::getString(size_t index, std::string_view& value) const {
+    const char* position = findArgument(index);
+    if (!position || (typeTags[index] != 's' && typeTags[index] != 'S')) {
+        return false;
+    }
+    return readString(position, end, value);
+}
+
+bool OscMessage::getBool(size_t index, bool& value) const {
+    if (index >= typeTags.size()) {
+        return false;
+    }
+    switch (typeTags[index]) {
+        case 'T':
+            value = true;
+            return true;
+        case 'F':
+            value = false;
+            return true;
+        default: {
+            float number;
+            if (!getFloat(index, number)) {
+                return false;
+            }
+            value = number != 0.0f;
+            return true;
+        }
+    }
+}
+
+OscServer::OscServer(int port, EventQueue& queue, std::function<void()> threadSetup) :
+    port(port),
+    queue(queue),
+    threadSetup(std::move(threadSetup)) {
+    if (port < 0) {
+        return;
+    }
+
+    socketFd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socketFd < 0) {
+        std::cerr << "OSC: could not create socket (" << std::strerror(errno) << ")" << std::endl;
+        return;
+    }
+
+    int reuse = 1;
+    setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    int bufferBytes = OSC_SOCKET_BUFFER_BYTES;
+    setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+    timeval timeout{};
+    timeout.tv_usec = OSC_RECEIVE_TIMEOUT_MS * 1000;
+    setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(socketFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "OSC: could not listen on UDP port " << port << " (" << std::strerror(errno) << ")" << std::endl;
+        close(socketFd);
+        socketFd = -1;
+        return;
+    }
+
+    // Port 0 picks a free port, report the one we got
+    socklen_t addressLength = sizeof(address);
+    if (getsockname(socketFd, reinterpret_cast<sockaddr*>(&address), &addressLength) == 0) {
+        this->port = ntohs(address.sin_port);
+    }
+    std::cout << "OSC: listening on UDP port " << this->port << std::endl;
+
+    receiveThread = std::thread(&OscServer::receiveLoop, this);
+}
+
+OscServer::~OscServer() {
+    stop();
+}
+
+void OscServer::stop() {
+    running.store(false);
+    if (receiveThread.joinable()) {
+        receiveThread.join();
+    }
+    if (socketFd >= 0) {
+        close(socketFd);
+        socketFd = -1;
+    }
+}
+
+void OscServer::receiveLoop() {
+    if (threadSetup) {
+        threadSetup();
+    }
+
+    while (running.load(std::memory_order_relaxed)) {
+        ssize_t received = recv(socketFd, buffer.data(), buffer.size(), 0);
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                continue;
+            }
+            std::cerr << "OSC: receive failed (" << std::strerror(errno) << ")" << std::endl;
+            break;
+        }
+        handlePacket(buffer.data(), static_cast<size_t>(received), std::chrono::steady_clock::now());
+    }
+}
+
+bool OscServer::handlePacket(const char* data, size_t size, std::chrono::steady_clock::time_point received) {
+    packets.fetch_add(1, std::memory_order_relaxed);
+    if (size < 4 || size % 4 != 0 || !handleElement(data, size, received, 0)) {
+        malformed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+bool OscServer::handleElement(const char* data, size_t size, std::chrono::steady_clock::time_point timestamp, int depth) {
+    if (size >= 8 && std::memcmp(data, "#bundle", 8) == 0) {
+        return handleBundle(data, size, timestamp, depth);
+    }
+    if (data[0] != '/') {
+        return false;
+    }
+
+    OscMessage message;
+    const char* position = data;
+    message.end = data + size;
+    if (!readString(position, message.end, message.address)) {
+        return false;
+    }
+    // Very old senders leave out the type tags
+    if (position < message.end && *position == ',') {
+        if (!readString(position, message.end, message.typeTags)) {
+            return false;
+        }
+        message.typeTags.remove_prefix(1);
+    }
+    message.arguments = position;
+
+    handleMessage(message, timestamp);
+    return true;
+}
+
+bool OscServer::handleBundle(const char* data, size_t size, std::chrono::steady_clock::time_point received, int depth) {
+    if (size < 16 || depth >= OSC_MAX_BUNDLE_DEPTH) {
+        return false;
+    }
+
+    // Timetag 1 means "immediately"; anything else is an NTP time on the sender's clock
+    uint64_t timetag = readUint64(data + 8);
+    std::chrono::steady_clock::time_point timestamp = received;
+    if (timetag != 1) {
+        double unixSeconds = static_cast<double>((timetag >> 32) - NTP_UNIX_OFFSET_SECONDS) + static_cast<double>(timetag & 0xFFFFFFFFULL) / 4294967296.0;
+        double nowSeconds = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+        double ahead = unixSeconds - nowSeconds;
+        if (ahead > 0.0 && ahead < OSC_MAX_SCHEDULE_AHEAD_SECONDS) {
+            timestamp += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(ahead));
+        }
+    }
+
+    const char* position = data + 16;
+    const char* end = data + size;
+    while (position < end) {
+        if (end - position < 4) {
+            return false;
+        }
+        uint32_t elementSize = readUint32(position);
+        position += 4;
+        if (elementSize == 0 || elementSize % 4 != 0 || elementSize > static_cast<size_t>(end - position)) {
+            return false;
+        }
+        if (!handleElement(position, elementSize, timestamp, depth + 1)) {
+            return false;
+        }
+        position += elementSize;
+    }
+    return true;
+}
+
+void OscServer::handleMessage(const OscMessage& message, std::chrono::steady_clock::time_point timestamp) {
+    messages.fetch_add(1, std::memory_order_relaxed);
+
+    const std::string_view& address = message.address;
+    bool isValid = true;
+    if (address == "/vh/key") {
+        std::string_view key;
+        int32_t keyCode = 0;
+        bool isDown = true;
+        if (message.getString(0, key) && !key.empty()) {
+            keyCode = key[0];
+        } else if (!message.getInt(0, keyCode)) {
+            isValid = false;
+        }
+        message.getBool(1, isDown);
+        if (isValid) {
+            pushAction(keyCode, isDown, 0.0f, timestamp);
+        }
+    } else if (address == "/vh/background" || address == "/vh/foreground") {
+        std::string_view key;
+        isValid = message.getString(0, key) && !key.empty();
+        if (isValid) {
+            pushAction(key[0], true, 0.0f, timestamp);
+        }
+    } else if (address == "/vh/strobe") {
+        bool isOn = false;
+        isValid = message.getBool(0, isOn);
+        if (isValid) {
+            pushAction(' ', isOn, 0.0f, timestamp);
+        }
+    } else if (address == "/vh/bounce") {
+        pushAction('b', true, 0.0f, timestamp);
+    } else if (address == "/vh/cue") {
+        pushAction('c', true, 0.0f, timestamp);
+    } else if (address == "/vh/sync") {
+        pushAction('r', true, 0.0f, timestamp);
+    } else if (address == "/vh/tempo" || address == "/vh/tempo/nudge") {
+        float bpm = 0.0f;
+        isValid = message.getFloat(0, bpm);
+        if (isValid) {
+            pushAction(address == "/vh/tempo" ? ACTION_TEMPO_SET : ACTION_TEMPO_NUDGE, true, bpm, timestamp);
+        }
+    } else if (address == "/vh/track") {
+        std::string_view name;
+        float position = 0.0f;
+        isValid = message.getString(0, name) && !name.empty();
+        message.getFloat(1, position);
+        if (isValid) {
+            pushAction(ACTION_TRACK_PLAY, true, position, timestamp, static_cast<int>(getTrackId(name)));
+        }
+    } else if (address == "/vh/track/stop") {
+        pushAction(ACTION_TRACK_PLAY, true, 0.0f, timestamp);
+    }
+
+    if (!isValid) {
+        malformed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void OscServer::pushAction(int keyCode, bool isDown, float value, std::chrono::steady_clock::time_point timestamp, int argument) {
+    Event event = { AppEventType::OSC, keyCode, argument, isDown };
+    event.value = value;
+    event.timestamp = timestamp;
+    if (!queue.push(event)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <thread>
+#include "EventQueue.h"
+
+// One OSC message inside a received packet. Everything points into the
+// packet buffer, nothing is copied.
+struct OscMessage {
+    std::string_view address;
+    std::string_view typeTags; // Without the leading ','
+    const char* arguments;
+    const char* end;
+
+    // Numbers are accepted as int or float; returns false if argument `index` is missing or of another type
+    bool getInt(size_t index, int32_t& value) const;
+    bool getFloat(size_t index, float& value) const;
+    bool getString(size_t index, std::string_view& value) const;
+    // True/False tags, or an int that is non-zero
+    bool getBool(size_t index, bool& value) const;
+
+private:
+    const char* findArgument(size_t index) const;
+};
+
+// Receives OSC over UDP on its own thread and turns the /vh/... address space
+// into events on the EventQueue:
+//
+//   /vh/key <s key | i code> [state]   press (or release, with state 0/F) a key action
+//   /vh/background <s key>             switch to the background bound to a key
+//   /vh/foreground <s key>             switch to the foreground bound to a key
+//   /vh/strobe <state>                 strobe on or off
+//   /vh/bounce, /vh/cue, /vh/sync      toggle bounce, toggle cue, resync the beat
+//   /vh/tempo <bpm>                    set the tempo, 0 hands it back to the beat source
+//   /vh/tempo/nudge <bpm>              change the tempo by a few BPM
+//   /vh/track <s name> [position]      a track with a beat grid started playing, position in seconds
+//   /vh/track/stop                     the track stopped, back to the other beat sources
+//
+// Messages in a bundle carry the bundle's timetag as their timestamp, so the
+// frame loop can hold them until their time comes. Packets are parsed in
+// place in one preallocated buffer; nothing on the receive path allocates.
+class OscServer {
+public:
+    // `threadSetup` runs first on the receive thread, e.g. to apply its thread role.
+    // Port 0 picks a free port; a negative port opens no socket and only parses.
+    OscServer(int port, EventQueue& queue, std::function<void()> threadSetup = nullptr);
+    ~OscServer();
+
+    bool isOpen() const { return socketFd >= 0; }
+    int getPort() const { return port; }
+    void stop();
+
+    // Parses one datagram; called from the receive thread. Returns false if it is malformed.
+    bool handlePacket(const char* data, size_t size, std::chrono::steady_clock::time_point received);
+
+    size_t getPacketCount() const { return packets.load(std::memory_order_relaxed); }
+    size_t getMessageCount() const { return messages.load(std::memory_order_relaxed); }
+    size_t getMalformedCount() const { return malformed.load(std::memory_order_relaxed); }
+    size_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    void receiveLoop();
+    bool handleElement(const char* data, size_t size, std::chrono::steady_clock::time_point timestamp, int depth);
+    bool handleBundle(const char* data, size_t size, std::chrono::steady_clock::time_point received, int depth);
+    void handleMessage(const OscMessage& message, std::chrono::steady_clock::time_point timestamp);
+    void pushAction(int keyCode, bool isDown, float value, std::chrono::steady_clock::time_point timestamp, int argument = 0);
+
+    int port;
+    int socketFd = -1;
+    EventQueue& queue;
+    std::function<void()> threadSetup;
+
+    // Largest UDP payload
+    std::array<char, 65536> buffer;
+
+    std::atomic<bool> running{true};
+    std::atomic<size_t> packets{0};
+    std::atomic<size_t> messages{0};
+    std::atomic<size_t> malformed{0};
+    std::atomic<size_t> dropped{0};
+    std::thread receiveThread;
+};
@@ -0,0 +1,116 @@
+#include "QualityGovernor.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+// --- Global Constant Definitions ---
+const double GOVERNOR_SMOOTHING = 0.1;            // Weight of the newest frame in the moving average
+const double GOVERNOR_DOWNGRADE_THRESHOLD = 0.95; // Fraction of the budget above which a frame counts as late
+const double GOVERNOR_UPGRADE_THRESHOLD = 0.6;    // Fraction of the budget below which there is headroom
+const int GOVERNOR_DOWNGRADE_FRAMES = 5;          // Consecutive late frames before stepping down
+const int GOVERNOR_UPGRADE_FRAMES = 120;          // Consecutive fast frames before stepping up
+const int GOVERNOR_COOLDOWN_FRAMES = 30;          // Frames to wait after any change before judging again
+
+static const char* STAGE_NAMES[] = { "events", "decode", "composite", "effects", "present" };
+// Thread each stage runs on when pipelined: decode, composite, effects
+static const int STAGE_LANES[] = { 0, 0, 1, 2, 2 };
+static const int LANE_COUNT = 3;
+static const char* LEVEL_NAMES[] = { "full", "nearest scaling", "reduced resolution", "half-rate decode", "minimum" };
+
+QualityGovernor::QualityGovernor(bool enabled) : enabled(enabled) {
+    stageStart.fill(std::chrono::steady_clock::now());
+}
+
+void QualityGovernor::beginStage(FrameStage stage) {
+    stageStart[static_cast<size_t>(stage)] = std::chrono::steady_clock::now();
+}
+
+void QualityGovernor::endStage(FrameStage stage) {
+    size_t i = static_cast<size_t>(stage);
+    auto elapsed = std::chrono::steady_clock::now() - stageStart[i];
+    stageMs[i].store(std::chrono::duration<double, std::milli>(elapsed).count(), std::memory_order_relaxed);
+}
+
+void QualityGovernor::endFrame(double budgetMs) {
+    std::array<double, LANE_COUNT> laneMs{};
+    for (size_t i = 0; i < stageMs.size(); ++i) {
+        double ms = stageMs[i].load(std::memory_order_relaxed);
+        laneMs[pipelined ? STAGE_LANES[i] : 0] += ms;
+        smoothedStageMs[i] += GOVERNOR_SMOOTHING * (ms - smoothedStageMs[i]);
+    }
+    double frameMs = *std::max_element(laneMs.begin(), laneMs.end());
+    smoothedFrameMs += GOVERNOR_SMOOTHING * (frameMs - smoothedFrameMs);
+
+    if (!enabled || budgetMs <= 0) {
+        return;
+    }
+
+    if (cooldown > 0) {
+        --cooldown;
+        return;
+    }
+
+    // A single slow frame (e.g. opening a new clip) must not cost quality,
+    // so the downgrade only looks at frames that are late on their own *and* on average.
+    if (frameMs > budgetMs * GOVERNOR_DOWNGRADE_THRESHOLD && smoothedFrameMs > budgetMs * GOVERNOR_DOWNGRADE_THRESHOLD) {
+        framesWithHeadroom = 0;
+        if (++framesOverBudget >= GOVERNOR_DOWNGRADE_FRAMES) {
+            changeLevel(+1, budgetMs);
+        }
+    } else if (smoothedFrameMs < budgetMs * GOVERNOR_UPGRADE_THRESHOLD) {
+        framesOverBudget = 0;
+        if (++framesWithHeadroom >= GOVERNOR_UPGRADE_FRAMES) {
+            changeLevel(-1, budgetMs);
+        }
+    } else {
+        framesOverBudget = 0;
+        framesWithHeadroom = 0;
+    }
+}
+
+void QualityGovernor::changeLevel(int delta, double budgetMs) {
+    int newLevel = std::clamp(static_cast<int>(level) + delta, static_cast<int>(QUALITY_FULL), static_cast<int>(QUALITY_LEVEL_COUNT) - 1);
+    framesOverBudget = 0;
+    framesWithHeadroom = 0;
+
+    if (newLevel == level) {
+        return;
+    }
+
+    level = static_cast<QualityLevel>(newLevel);
+    cooldown = GOVERNOR_COOLDOWN_FRAMES;
+
+    std::cout << "\nQuality " << (delta > 0 ? "lowered" : "raised") << " to '" << getLevelName() << "' ("
+              << std::fixed << std::setprecision(1) << smoothedFrameMs << " ms of " << budgetMs << " ms budget |";
+    for (size_t i = 0; i < smoothedStageMs.size(); ++i) {
+        std::cout << " " << STAGE_NAMES[i] << " " << smoothedStageMs[i];
+    }
+    std::cout << ")" << std::endl;
+}
+
+std::string QualityGovernor::getLevelName() const {
+    return LEVEL_NAMES[level];
+}
+
+int QualityGovernor::getInterpolation() const {
+    return level >= QUALITY_NEAREST_SCALING ? cv::INTER_NEAREST : cv::INTER_LINEAR;
+}
+
+double QualityGovernor::getRenderScale() const {
+    if (level >= QUALITY_MINIMUM) {
+        return 0.5;
+    }
+    if (level >= QUALITY_REDUCED_RESOLUTION) {
+        return 0.75;
+    }
+    return 1.0;
+}
+
+bool QualityGovernor::shouldDecodeFrame(long long frameIndex) const {
+    return level < QUALITY_HALF_RATE_DECODE || frameIndex % 2 == 0;
+}
+
+double QualityGovernor::getSmoothedStageTime(FrameStage stage) const {
+    return smoothedStageMs[static_cast<size_t>(stage)];
+}
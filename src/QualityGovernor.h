@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Stages of the frame path timed by the governor
+enum class FrameStage {
+    Events,
+    Decode,
+    Composite,
+    Effects,
+    Present,
+    Count
+};
+
+// Quality levels, ordered from the most expensive to the cheapest.
+// Every level keeps the savings of the levels above it.
+enum QualityLevel {
+    QUALITY_FULL,              // Linear scaling, full render resolution, every frame decoded
+    QUALITY_NEAREST_SCALING,   // Nearest-neighbour instead of linear scaling
+    QUALITY_REDUCED_RESOLUTION,// Render at 3/4 of the output resolution and let the display upscale
+    QUALITY_HALF_RATE_DECODE,  // Only convert every other background frame, repeat the previous one
+    QUALITY_MINIMUM,           // Render at 1/2 of the output resolution
+    QUALITY_LEVEL_COUNT
+};
+
+// --- Global Constants ---
+extern const double GOVERNOR_SMOOTHING;
+extern const double GOVERNOR_DOWNGRADE_THRESHOLD;
+extern const double GOVERNOR_UPGRADE_THRESHOLD;
+extern const int GOVERNOR_DOWNGRADE_FRAMES;
+extern const int GOVERNOR_UPGRADE_FRAMES;
+extern const int GOVERNOR_COOLDOWN_FRAMES;
+
+// Watches per-stage frame times and steps the render quality down when frames
+// miss their deadline, and back up once there is headroom again.
+// Two separate thresholds plus a cooldown after every change give it hysteresis,
+// so a frame time sitting right at the budget does not make it oscillate.
+// Each stage may be timed from its own thread; everything else belongs to the
+// thread that calls endFrame.
+class QualityGovernor {
+public:
+    QualityGovernor(bool enabled);
+
+    // Timing of a single stage, called once per frame by the thread running it
+    void beginStage(FrameStage stage);
+    void endStage(FrameStage stage);
+
+    // When the stages run on separate threads a frame only misses its deadline
+    // if one thread's share of the work exceeds the budget, not their sum
+    void setPipelined(bool value) { pipelined = value; }
+
+    // Close the current frame. `budgetMs` is the time available for one frame.
+    void endFrame(double budgetMs);
+
+    QualityLevel getLevel() const { return level; }
+    std::string getLevelName() const;
+
+    // Parameters derived from the current level
+    int getInterpolation() const;
+    double getRenderScale() const;
+    bool shouldDecodeFrame(long long frameIndex) const;
+
+    double getSmoothedFrameTime() const { return smoothedFrameMs; }
+    double getSmoothedStageTime(FrameStage stage) const;
+
+private:
+    void changeLevel(int delta, double budgetMs);
+
+    bool enabled;
+    bool pipelined = false;
+    QualityLevel level = QUALITY_FULL;
+
+    std::array<std::chrono::steady_clock::time_point, static_cast<size_t>(FrameStage::Count)> stageStart;
+    std::array<std::atomic<double>, static_cast<size_t>(FrameStage::Count)> stageMs{};
+    std::array<double, static_cast<size_t>(FrameStage::Count)> smoothedStageMs{};
+    double smoothedFrameMs = 0.0;
+
+    int framesOverBudget = 0;
+    int framesWithHeadroom = 0;
+    int cooldown = 0;
+};
@@ -0,0 +1,59 @@
+// SpscQueue.h
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Head and tail live on separate cache lines so the two sides never share one.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) : _slots(capacity + 1) {}
+
+    // Returns false (and leaves `item` untouched) when the queue is full
+    bool tryPush(T&& item) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        size_t next = increment(tail);
+        if (next == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        _slots[tail] = std::move(item);
+        _tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false when the queue is empty
+    bool tryPop(T& item) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(_slots[head]);
+        _slots[head] = T();
+        _head.store(increment(head), std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        size_t head = _head.load(std::memory_order_acquire);
+        size_t tail = _tail.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : tail + _slots.size() - head;
+    }
+
+    size_t capacity() const { return _slots.size() - 1; }
+
+private:
+    size_t increment(size_t index) const {
+        return index + 1 == _slots.size() ? 0 : index + 1;
+    }
+
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+    alignas(64) std::vector<T> _slots;
+};
+
+#endif // SPSC_QUEUE_H
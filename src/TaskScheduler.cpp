@@ -0,0 +1,189 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+// The worker (and its scheduler) the current thread belongs to, so tasks
+// submitted from inside a task go to that worker's own deque
+static thread_local TaskScheduler* currentScheduler = nullptr;
+static thread_local size_t currentWorker = 0;
+
+// Settings the shared scheduler is created with
+static size_t sharedWorkerCount = TaskScheduler::AUTO_WORKERS;
+static std::function<void()> sharedThreadSetup;
+
+TaskScheduler::TaskScheduler(size_t workerCount, std::function<void()> threadSetup) : threadSetup(std::move(threadSetup)) {
+    if (workerCount == AUTO_WORKERS) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+    }
+    maxBackgroundTasks = workerCount > 0 ? workerCount - 1 : 0;
+
+    for (size_t i = 0; i < workerCount; ++i) {
+        queues.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+TaskScheduler& TaskScheduler::instance() {
+    static TaskScheduler scheduler(sharedWorkerCount, sharedThreadSetup);
+    return scheduler;
+}
+
+void TaskScheduler::configure(size_t workerCount, std::function<void()> threadSetup) {
+    sharedWorkerCount = workerCount;
+    sharedThreadSetup = std::move(threadSetup);
+}
+
+void TaskScheduler::submit(TaskPriority priority, Task task) {
+    // No worker may take background work, so the caller does it
+    if (workers.empty() || (priority == TaskPriority::Background && maxBackgroundTasks == 0)) {
+        task();
+        return;
+    }
+
+    size_t index = currentScheduler == this ? currentWorker : nextQueue.fetch_add(1) % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->deques[static_cast<size_t>(priority)].push_back(std::move(task));
+    }
+    pendingTasks.fetch_add(1);
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+}
+
+void TaskScheduler::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (workers.empty() || count <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    struct Loop {
+        const std::function<void(size_t)>* body;
+        size_t count;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> remaining{0};
+    };
+    auto loop = std::make_shared<Loop>();
+    loop->body = &body;
+    loop->count = count;
+    loop->remaining.store(count);
+
+    // Helpers that start after the loop is finished find no items and return
+    // without touching `body`, which may be gone by then
+    auto run = [loop]() {
+        size_t i;
+        while ((i = loop->next.fetch_add(1)) < loop->count) {
+            (*loop->body)(i);
+            loop->remaining.fetch_sub(1, std::memory_order_release);
+        }
+    };
+
+    size_t helpers = std::min(count - 1, workers.size());
+    for (size_t i = 0; i < helpers; ++i) {
+        submit(TaskPriority::Realtime, run);
+    }
+
+    run();
+    while (loop->remaining.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+void TaskScheduler::workerLoop(size_t index) {
+    currentScheduler = this;
+    currentWorker = index;
+    if (threadSetup) {
+        threadSetup();
+    }
+
+    while (true) {
+        Task task;
+        TaskPriority priority;
+        if (findTask(index, task, priority)) {
+            task();
+            if (priority == TaskPriority::Background) {
+                runningBackgroundTasks.fetch_sub(1);
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if (stopping) {
+            return;
+        }
+        if (pendingTasks.load() == 0) {
+            wake.wait(lock, [this] { return stopping || pendingTasks.load() > 0; });
+        } else {
+            // Only background tasks are left and all their slots are taken
+            wake.wait_for(lock, std::chrono::milliseconds(1));
+        }
+    }
+}
+
+bool TaskScheduler::findTask(size_t index, Task& task, TaskPriority& priority) {
+    for (size_t p = 0; p < static_cast<size_t>(TaskPriority::Count); ++p) {
+        priority = static_cast<TaskPriority>(p);
+
+        if (priority == TaskPriority::Background) {
+            size_t running = runningBackgroundTasks.load();
+            do {
+                if (running >= maxBackgroundTasks) {
+                    return false;
+                }
+            } while (!runningBackgroundTasks.compare_exchange_weak(running, running + 1));
+        }
+
+        if (popOwn(index, priority, task) || steal(index, priority, task)) {
+            pendingTasks.fetch_sub(1);
+            return true;
+        }
+
+        if (priority == TaskPriority::Background) {
+            runningBackgroundTasks.fetch_sub(1);
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::popOwn(size_t index, TaskPriority priority, Task& task) {
+    Worker& worker = *queues[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    auto& deque = worker.deques[static_cast<size_t>(priority)];
+    if (deque.empty()) {
+        return false;
+    }
+    task = std::move(deque.back());
+    deque.pop_back();
+    return true;
+}
+
+bool TaskScheduler::steal(size_t thief, TaskPriority priority, Task& task) {
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Worker& victim = *queues[(thief + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        auto& deque = victim.deques[static_cast<size_t>(priority)];
+        if (!deque.empty()) {
+            task = std::move(deque.front());
+            deque.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
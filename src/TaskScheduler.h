@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Priorities, highest first. A worker always runs the highest priority task it
+// can find anywhere (its own deques first, then stealing) before anything lower.
+enum class TaskPriority {
+    Realtime,   // Work for the frame being rendered right now
+    Prefetch,   // Work a frame will need soon, e.g. opening a cued clip
+    Background, // Ingest, probing, cache building
+    Count
+};
+
+// Project-wide work-stealing scheduler. Every worker owns one deque per
+// priority; it pops its own newest task and steals the oldest task from the
+// other workers when it runs dry. Background tasks never occupy every worker,
+// so there is always a thread free for frame work; with a single worker they
+// run on the thread that submits them instead.
+class TaskScheduler {
+public:
+    using Task = std::function<void()>;
+
+    // Worker count picking one worker per hardware thread, minus one for the caller
+    static const size_t AUTO_WORKERS = SIZE_MAX;
+
+    // With no workers every task runs on the thread that submits it.
+    // `threadSetup` runs first on every worker, e.g. to apply its thread role.
+    explicit TaskScheduler(size_t workerCount = AUTO_WORKERS, std::function<void()> threadSetup = nullptr);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // The scheduler shared by the whole application, created on first use
+    static TaskScheduler& instance();
+
+    // Worker count and thread setup for the shared scheduler, only effective before its first use
+    static void configure(size_t workerCount, std::function<void()> threadSetup);
+
+    // Number of threads taking part in a parallelFor, including the caller
+    size_t size() const { return workers.size() + 1; }
+
+    void submit(TaskPriority priority, Task task);
+
+    // Runs `function` on a worker and returns a future for its result
+    template <typename Function>
+    auto async(TaskPriority priority, Function&& function) -> std::future<decltype(function())> {
+        using Result = decltype(function());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+        std::future<Result> result = task->get_future();
+        submit(priority, [task]() { (*task)(); });
+        return result;
+    }
+
+    // Calls body(i) for every i in [0, count) at realtime priority and returns
+    // once all calls are done. The caller works through the items too, so the
+    // loop finishes even when every worker is busy.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::array<std::deque<Task>, static_cast<size_t>(TaskPriority::Count)> deques;
+    };
+
+    void workerLoop(size_t index);
+    bool findTask(size_t index, Task& task, TaskPriority& priority);
+    bool popOwn(size_t index, TaskPriority priority, Task& task);
+    bool steal(size_t thief, TaskPriority priority, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> queues;
+    std::vector<std::thread> workers;
+    std::function<void()> threadSetup;
+
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> pendingTasks{0};
+    std::atomic<size_t> runningBackgroundTasks{0};
+    size_t maxBackgroundTasks;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
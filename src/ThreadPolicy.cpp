@@ -0,0 +1,124 @@
+#include "ThreadPolicy.h"
+#include <iostream>
+#include <sstream>
+#include <mutex>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static std::mutex reportMutex;
+
+std::string getThreadRoleName(ThreadRole role) {
+    switch (role) {
+        case ThreadRole::AudioAnalysis: return "audio analysis";
+        case ThreadRole::FrameProducer: return "frame producer";
+        case ThreadRole::Decoder: return "decoder";
+        case ThreadRole::IO: return "io";
+        default: return "unknown";
+    }
+}
+
+SchedulingPolicy parseSchedulingPolicy(const std::string& name) {
+    if (name == "fifo") {
+        return SchedulingPolicy::Fifo;
+    }
+    if (name == "rr") {
+        return SchedulingPolicy::RoundRobin;
+    }
+    return SchedulingPolicy::Default;
+}
+
+static bool applyAffinity(const std::vector<int>& cpus, std::ostream& report) {
+    if (cpus.empty()) {
+        return true;
+    }
+
+    report << " | cpus";
+    for (int cpu : cpus) {
+        report << " " << cpu;
+    }
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (err != 0) {
+        report << " failed (" << std::strerror(err) << ")";
+        return false;
+    }
+    return true;
+#else
+    // macOS only offers affinity tags as a hint, there is no hard pinning
+    report << " not supported on this platform";
+    return false;
+#endif
+}
+
+static bool applyScheduling(const ThreadRolePolicy& policy, std::ostream& report) {
+    if (policy.policy == SchedulingPolicy::Default) {
+        if (policy.nice == 0) {
+            return true;
+        }
+        report << " | nice " << policy.nice;
+#ifdef __linux__
+        // On Linux the nice level is per thread
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), policy.nice) != 0) {
+            report << " failed (" << std::strerror(errno) << ")";
+            return false;
+        }
+        return true;
+#else
+        report << " not supported per thread on this platform";
+        return false;
+#endif
+    }
+
+    int schedPolicy = policy.policy == SchedulingPolicy::Fifo ? SCHED_FIFO : SCHED_RR;
+    report << " | " << (schedPolicy == SCHED_FIFO ? "SCHED_FIFO " : "SCHED_RR ") << policy.priority;
+
+    sched_param param{};
+    param.sched_priority = policy.priority;
+    int err = pthread_setschedparam(pthread_self(), schedPolicy, &param);
+    if (err != 0) {
+        report << " failed (" << std::strerror(err) << ")";
+        return false;
+    }
+    return true;
+}
+
+bool applyThreadRole(ThreadRole role, const ThreadRolePolicy& policy) {
+    std::ostringstream report;
+    report << "[threads] " << getThreadRoleName(role);
+
+    bool ok = applyAffinity(policy.cpus, report);
+    ok = applyScheduling(policy, report) && ok;
+
+    if (policy.cpus.empty() && policy.policy == SchedulingPolicy::Default && policy.nice == 0) {
+        report << " | default";
+    }
+
+    std::lock_guard<std::mutex> lock(reportMutex);
+    std::cout << report.str() << std::endl;
+    return ok;
+}
+
+bool lockProcessMemory() {
+    std::lock_guard<std::mutex> lock(reportMutex);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        std::cout << "[threads] mlockall failed (" << std::strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    std::cout << "[threads] memory locked" << std::endl;
+    return true;
+}
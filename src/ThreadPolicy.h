@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Roles a thread can play, each with its own scheduling policy from the config
+enum class ThreadRole {
+    AudioAnalysis, // Audio capture and beat detection
+    FrameProducer, // Frame loop and the frame pipeline stages
+    Decoder,       // Task scheduler workers: decoding, compositing bands, asset loading
+    IO,            // Network, MIDI, file watching and recording
+    Count
+};
+
+enum class SchedulingPolicy {
+    Default,   // Leave the OS default (SCHED_OTHER), optionally with a nice level
+    Fifo,      // SCHED_FIFO realtime
+    RoundRobin // SCHED_RR realtime
+};
+
+struct ThreadRolePolicy {
+    std::vector<int> cpus;     // CPUs the thread may run on, empty for any
+    SchedulingPolicy policy = SchedulingPolicy::Default;
+    int priority = 0;          // Realtime priority for Fifo/RoundRobin
+    int nice = 0;              // Nice level for Default
+};
+
+std::string getThreadRoleName(ThreadRole role);
+SchedulingPolicy parseSchedulingPolicy(const std::string& name);
+
+// Applies the policy to the calling thread and reports what did and did not
+// take effect. Failures (e.g. missing CAP_SYS_NICE) are reported, not fatal.
+bool applyThreadRole(ThreadRole role, const ThreadRolePolicy& policy);
+
+// Locks all current and future pages of the process into RAM so the frame and
+// audio threads never stall on a page fault
+bool lockProcessMemory();
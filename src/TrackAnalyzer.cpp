@@ -0,0 +1,99 @@
+#include "TrackAnalyzer.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <sndfile.h>
+#include "BpmDetector.h"
+
+// Adds the beats between the last one on the grid and the tracker's anchor
+static void extendGrid(std::vector<double>& beats, double& lastBeatNumber, const BeatPhase& phase) {
+    double anchorSec = phase.anchorNs / 1e9;
+    if (beats.empty()) {
+        beats.push_back(anchorSec);
+        lastBeatNumber = phase.anchorBeat;
+        return;
+    }
+    for (double beatNumber = lastBeatNumber + 1.0; beatNumber <= phase.anchorBeat; beatNumber += 1.0) {
+        double beatSec = anchorSec - (phase.anchorBeat - beatNumber) * phase.periodSec;
+        if (beatSec > beats.back()) {
+            beats.push_back(beatSec);
+        }
+    }
+    lastBeatNumber = std::max(lastBeatNumber, phase.anchorBeat);
+}
+
+bool analyzeTrack(const std::string& path, BeatGrid& grid) {
+    SF_INFO info{};
+    SNDFILE* file = sf_open(path.c_str(), SFM_READ, &info);
+    if (!file) {
+        std::cerr << "Could not open " << path << ": " << sf_strerror(nullptr) << std::endl;
+        return false;
+    }
+    const double sampleRate = static_cast<double>(info.samplerate);
+
+    OfflineBeatTracker beatTracker(info.samplerate);
+    if (!beatTracker.isValid()) {
+        sf_close(file);
+        return false;
+    }
+
+    std::map<int, int> bpmCounts;
+    double lastBeatNumber = 0.0;
+    grid.tempoCurve.clear();
+    grid.beats.clear();
+
+    std::vector<float> interleaved(HOP_SIZE * info.channels);
+    std::vector<float> mono(HOP_SIZE);
+    sf_count_t framesRead;
+    while ((framesRead = sf_readf_float(file, interleaved.data(), HOP_SIZE)) > 0) {
+        for (uint_t i = 0; i < HOP_SIZE; ++i) {
+            float sum = 0.0f;
+            if (static_cast<sf_count_t>(i) < framesRead) {
+                for (int channel = 0; channel < info.channels; ++channel) {
+                    sum += interleaved[i * info.channels + channel];
+                }
+            }
+            mono[i] = sum / info.channels;
+        }
+
+        if (beatTracker.process(mono.data())) {
+            grid.tempoCurve.push_back({ static_cast<float>(beatTracker.getTime()), static_cast<float>(beatTracker.getBpm()) });
+            ++bpmCounts[static_cast<int>(std::lround(beatTracker.getBpm()))];
+        }
+        if (beatTracker.isBeat()) {
+            BeatPhase phase = beatTracker.getPhase();
+            if (phase.locked) {
+                extendGrid(grid.beats, lastBeatNumber, phase);
+            }
+        }
+    }
+    sf_close(file);
+
+    grid.durationSec = info.frames / sampleRate;
+    grid.bpm = 0.0;
+    int mostCommon = 0;
+    for (const auto& [bpm, count] : bpmCounts) {
+        if (count > mostCommon) {
+            mostCommon = count;
+            grid.bpm = bpm;
+        }
+    }
+
+    // Carry the grid out to both ends of the track at the tempo it starts and ends with
+    if (grid.beats.size() >= 2) {
+        double firstSpacing = grid.beats[1] - grid.beats[0];
+        std::vector<double> lead;
+        for (double beatSec = grid.beats.front() - firstSpacing; beatSec >= 0.0; beatSec -= firstSpacing) {
+            lead.push_back(beatSec);
+        }
+        grid.beats.insert(grid.beats.begin(), lead.rbegin(), lead.rend());
+
+        double lastSpacing = grid.beats.back() - grid.beats[grid.beats.size() - 2];
+        for (double beatSec = grid.beats.back() + lastSpacing; beatSec < grid.durationSec; beatSec += lastSpacing) {
+            grid.beats.push_back(beatSec);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include "BeatGrid.h"
+
+// Offline tempo and beat analysis of an audio file (anything libsndfile
+// reads: WAV, FLAC, AIFF, Ogg). The live path's default detection, aubio
+// into the TempogramEstimator with its default preferred range, and the
+// BeatPhaseTracker run on the file's own time, so the
+// grid matches what the live input would settle on. Beats before the tracker
+// first locks, and after it last hears one, are extrapolated to the ends of
+// the track. Safe to call from several threads at once.
+bool analyzeTrack(const std::string& path, BeatGrid& grid);
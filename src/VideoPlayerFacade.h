@@ -3,6 +3,7 @@
 #define VIDEO_PLAYER_FACADE_H
 
 #include <atomic>
+#include <chrono>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
@@ -30,7 +31,8 @@ public:
     VideoPlayerFacade();
     ~VideoPlayerFacade();
 
-    void pushFrame(const cv::Mat& frame);
+    // `frameTime` is the moment the frame was rendered for, used to measure presentation latency
+    void pushFrame(const cv::Mat& frame, std::chrono::steady_clock::time_point frameTime = {});
     void stopVisualization();
     void runAppKitLoop(const DisplayInfo& displayInfo);
     bool isRunning();
@@ -38,6 +40,11 @@ public:
     // Getter for the event queue
     EventQueue* getEventQueue();
 
+    // Smoothed time from a frame's frameTime until it was on screen, 0 until the display reports one
+    double getPresentLatency() const { return _presentLatencyMs.load(std::memory_order_relaxed); }
+    // Called from the display callback when a new frame has been presented
+    void onFramePresented(std::chrono::steady_clock::time_point frameTime, std::chrono::steady_clock::time_point presentedTime);
+
     // Getters and setters for thread-safe access to assets
     std::shared_ptr<Background> getActiveBackground();
     void setActiveBackground(std::shared_ptr<Background> bg);
@@ -64,6 +71,7 @@ public:
 
 private:
     std::atomic<bool> _isRunning{true};
+    std::atomic<double> _presentLatencyMs{0.0};
     DisplayInfo _displayInfo;
 
     // Thread-safe event queue
@@ -18,30 +18,38 @@
 // Include OpenCV headers
 #include <opencv2/opencv.hpp>
 #include <dispatch/dispatch.h>
+#include <mach/mach_time.h>
+
+// Weight of the newest frame in the smoothed presentation latency
+static const double PRESENT_LATENCY_SMOOTHING = 0.1;
+
+// Presentation latencies above this are a stall, not the display's latency
+static const double MAX_PRESENT_LATENCY_MS = 1000.0;
 
 // --- C++ Class for the Visualization Black Box ---
 // The FrameQueue class is defined here, nested within the implementation,
 // to be visible to all parts of the file that need it.
 class VideoPlayerFacade::FrameQueue {
 public:
-    void push(const cv::Mat& frame) {
+    void push(const cv::Mat& frame, std::chrono::steady_clock::time_point frameTime) {
         std::unique_lock<std::mutex> lock(_mutex);
-        _queue.push(frame.clone());
+        _queue.push({ frame.clone(), frameTime });
         _cond.notify_one();
     }
 
-    bool pop(cv::Mat& frame) {
+    bool pop(cv::Mat& frame, std::chrono::steady_clock::time_point& frameTime) {
         std::unique_lock<std::mutex> lock(_mutex);
         if (_queue.empty()) {
             return false;
         }
-        frame = _queue.front();
+        frame = _queue.front().first;
+        frameTime = _queue.front().second;
         _queue.pop();
         return true;
     }
 
 private:
-    std::queue<cv::Mat> _queue;
+    std::queue<std::pair<cv::Mat, std::chrono::steady_clock::time_point>> _queue;
     std::mutex _mutex;
     std::condition_variable _cond;
 };
@@ -155,9 +163,10 @@ vertex TextureVertexOut vertex_shader(
 
 fragment half4 fragment_shader(
     TextureVertexOut in [[stage_in]],
-    texture2d<half> texture [[texture(0)]],
-    sampler sampler_2d [[sampler(0)]])
+    texture2d<half> texture [[texture(0)]])
 {
+    // Frames may be rendered below the display resolution, this is the final upscale
+    constexpr sampler sampler_2d(coord::normalized, address::clamp_to_edge, filter::linear);
     half4 color = texture.sample(sampler_2d, in.texCoords);
     return color;
 }
@@ -169,7 +178,8 @@ public:
     VideoRenderer(id<MTLDevice> device);
     ~VideoRenderer();
     void updateTextureWithFrame(const cv::Mat& frame);
-    void render(MTKView* view);
+    // A non-zero `frameTime` marks a new frame; `player` is told when it reaches the screen
+    void render(MTKView* view, std::chrono::steady_clock::time_point frameTime = {}, VideoPlayerFacade* player = nullptr);
 
 private:
     id<MTLDevice> _device;
@@ -261,7 +271,18 @@ void VideoRenderer::updateTextureWithFrame(const cv::Mat& frame) {
                       bytesPerRow:bytesPerRow];
 }
 
-void VideoRenderer::render(MTKView* view) {
+// Drawable presentation times are in seconds of the host clock (mach_absolute_time)
+static std::chrono::steady_clock::time_point hostTimeToSteadyClock(double hostSeconds) {
+    static mach_timebase_info_data_t timebase = []() {
+        mach_timebase_info_data_t info;
+        mach_timebase_info(&info);
+        return info;
+    }();
+    double hostNowSeconds = static_cast<double>(mach_absolute_time()) * timebase.numer / timebase.denom / 1e9;
+    return std::chrono::steady_clock::now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(hostNowSeconds - hostSeconds));
+}
+
+void VideoRenderer::render(MTKView* view, std::chrono::steady_clock::time_point frameTime, VideoPlayerFacade* player) {
     if (!_videoTexture) {
         return;
     }
@@ -285,7 +306,19 @@ void VideoRenderer::render(MTKView* view) {
 
     [renderEncoder endEncoding];
 
-    [commandBuffer presentDrawable:view.currentDrawable];
+    id<CAMetalDrawable> drawable = view.currentDrawable;
+    if (player && frameTime.time_since_epoch().count() != 0) {
+        if (@available(macOS 10.15.4, *)) {
+            [drawable addPresentedHandler:^(id<MTLDrawable> presented) {
+                // 0 means the drawable was dropped without being shown
+                if (presented.presentedTime > 0.0) {
+                    player->onFramePresented(frameTime, hostTimeToSteadyClock(presented.presentedTime));
+                }
+            }];
+        }
+    }
+
+    [commandBuffer presentDrawable:drawable];
     [commandBuffer commit];
 }
 
@@ -312,11 +345,13 @@ void VideoRenderer::render(MTKView* view) {
 
 - (void)drawInMTKView:(nonnull MTKView *)view {
     cv::Mat frame;
-    if (_frameQueue && _frameQueue->pop(frame)) {
+    std::chrono::steady_clock::time_point frameTime{};
+    if (_frameQueue && _frameQueue->pop(frame, frameTime)) {
         _renderer->updateTextureWithFrame(frame);
     }
-    
-    _renderer->render(view);
+
+    // Only the first time a frame is drawn counts towards its latency
+    _renderer->render(view, frameTime, _player);
 }
 @end
 
@@ -352,8 +387,18 @@ void VideoRenderer::render(MTKView* view) {
 @end
 
 // The rest of your C++ code
-void VideoPlayerFacade::pushFrame(const cv::Mat& frame) {
-    _frameQueue->push(frame);
+void VideoPlayerFacade::pushFrame(const cv::Mat& frame, std::chrono::steady_clock::time_point frameTime) {
+    _frameQueue->push(frame, frameTime);
+}
+
+void VideoPlayerFacade::onFramePresented(std::chrono::steady_clock::time_point frameTime, std::chrono::steady_clock::time_point presentedTime) {
+    double latencyMs = std::chrono::duration<double, std::milli>(presentedTime - frameTime).count();
+    if (latencyMs <= 0.0 || latencyMs > MAX_PRESENT_LATENCY_MS) {
+        return;
+    }
+    double smoothed = _presentLatencyMs.load(std::memory_order_relaxed);
+    smoothed = smoothed == 0.0 ? latencyMs : smoothed + PRESENT_LATENCY_SMOOTHING * (latencyMs - smoothed);
+    _presentLatencyMs.store(smoothed, std::memory_order_relaxed);
 }
 
 void VideoPlayerFacade::stopVisualization() {
@@ -422,6 +467,8 @@ void VideoPlayerFacade::runAppKitLoop(const DisplayInfo& displayInfo) {
                 if ([characters length] > 0) {
                     unichar keyChar = [characters characterAtIndex:0];
                     Event keyEvent = { AppEventType::Keyboard, (int)keyChar, 0, isKeyDown };
+                    keyEvent.isRepeat = event.isARepeat;
+                    keyEvent.timestamp = std::chrono::steady_clock::now();
                     this->getEventQueue()->push(keyEvent);
                 }
         }];
@@ -5,10 +5,12 @@
 #include <algorithm> // For std::min and std::max
 #include <filesystem>
 #include <thread>
+#include <future>
 #include <chrono>
 #include <deque> // For storing tap times
 #include <atomic> // For thread-safe BPM variable
 #include <iomanip> // For std::setprecision
+#include <array>
 
 // Platform-specific headers
 #ifdef _WIN32
@@ -27,17 +29,31 @@
 // Include the new libraries
 #include "ConfigManager.h"
 #include "AssetManager.h"
+#include "AssetWatcher.h"
+#include "AudioSource.h"
 #include "BpmDetector.h"
 #include "PlatformSpecificCode.h"
+#include "QualityGovernor.h"
+#include "FramePipeline.h"
+#include "TaskScheduler.h"
+#include "Compositor.h"
+#include "Benchmarks.h"
+#include "ThreadPolicy.h"
+#include "EventLog.h"
+#include "BeatSource.h"
+#include "MidiInput.h"
+#include "OscServer.h"
+#include "AbletonLinkManager.h"
+#include "LatencyCalibration.h"
+#include "BeatGrid.h"
 
 namespace fs = std::filesystem;
 
 // Thread-safe variables for synchronization
 std::atomic<bool> isSyncActive(false);
-std::chrono::steady_clock::time_point lastSyncTime;
 
 // Function to resize a frame to fit within a target resolution while maintaining aspect ratio
-cv::Mat scaleToFit(const cv::Mat& src, int targetWidth, int targetHeight, const cv::Scalar& bgColor = cv::Scalar(0, 0, 0)) {
+cv::Mat scaleToFit(const cv::Mat& src, int targetWidth, int targetHeight, const cv::Scalar& bgColor = cv::Scalar(0, 0, 0), int interpolation = cv::INTER_LINEAR) {
     if (src.empty()) {
         return cv::Mat(targetHeight, targetWidth, CV_8UC3, bgColor);
     }
@@ -62,7 +78,7 @@ cv::Mat scaleToFit(const cv::Mat& src, int targetWidth, int targetHeight, const
     }
 
     cv::Mat resizedFrame;
-    cv::resize(src, resizedFrame, cv::Size(newWidth, newHeight), 0, 0, cv::INTER_LINEAR);
+    cv::resize(src, resizedFrame, cv::Size(newWidth, newHeight), 0, 0, interpolation);
 
     cv::Mat canvas(targetHeight, targetWidth, src.type(), bgColor);
 
@@ -74,25 +90,75 @@ cv::Mat scaleToFit(const cv::Mat& src, int targetWidth, int targetHeight, const
     return canvas;
 }
 
-bool isNearMultiple(double value, const double divisor, double tolerance) {
-    double mod = std::fmod(value, divisor);
-    return std::abs(mod) < tolerance;
+// Size of the internal canvas that all compositing and effects run on.
+// It keeps the aspect ratio of the display and never exceeds it; the single
+// upscale to the display resolution happens when the frame is presented.
+cv::Size getRenderSize(const LiveConfig& live, const DisplayInfo& targetDisplay, double qualityScale) {
+    int renderHeight = targetDisplay.height;
+    if (live.renderHeight > 0 && live.renderHeight < targetDisplay.height) {
+        renderHeight = live.renderHeight;
+    }
+    renderHeight = static_cast<int>(renderHeight * qualityScale);
+    int renderWidth = static_cast<int>(static_cast<double>(targetDisplay.width) * renderHeight / targetDisplay.height);
+    return cv::Size(std::max(renderWidth, 1), std::max(renderHeight, 1));
+}
+
+// True once work submitted to the scheduler has finished
+template <typename T>
+bool isReady(const std::future<T>& future) {
+    return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
 }
 
 bool isAnimating = false;
 std::chrono::steady_clock::time_point animationStartTime;
 
-void videoProcessingThread(std::shared_ptr<VideoPlayerFacade> player, const DisplayInfo targetDisplay) {
+// Audio levels older than this mean the analysis thread has stopped; kick bounce rests
+const std::chrono::milliseconds AUDIO_LEVELS_TIMEOUT(250);
+
+// How late in a phrase a frame may be and still apply the CUE change due at its start
+const double CUE_LATE_BEATS = 0.5;
+
+// Events with a future timestamp (OSC bundles) waiting for their beat
+const size_t MAX_SCHEDULED_EVENTS = 256;
+
+// Options that only apply to this run, taken from the command line
+struct SessionOptions {
+    std::string recordPath;  // --record <file>: write every event to a log
+    std::string replayPath;  // --replay <file>: feed a log back in place of a performer
+    bool replayFast = false; // --fast: replay by frame index without pacing frames
+    bool calibrate = false;  // --calibrate: measure the audio detection delay with a click track
+};
+
+void videoProcessingThread(std::shared_ptr<VideoPlayerFacade> player, const DisplayInfo targetDisplay, const ConfigManager& configManager, const SessionOptions& options) {
+    const AppConfig& config = configManager.getConfig();
     if (!player) {
         std::cerr << "Player pointer is null. Exiting processing thread." << std::endl;
         return;
     }
 
-    ConfigManager configManager("config/config.json");
-    const AppConfig& config = configManager.getConfig();
+    applyThreadRole(ThreadRole::FrameProducer, config.getThreadPolicy(ThreadRole::FrameProducer));
+
+    // Asset probing, clip opening and per-pixel work share one scheduler
+    size_t workerCount = config.workerThreads > 0 ? static_cast<size_t>(config.workerThreads) : TaskScheduler::AUTO_WORKERS;
+    TaskScheduler::configure(workerCount, [&config]() {
+        applyThreadRole(ThreadRole::Decoder, config.getThreadPolicy(ThreadRole::Decoder));
+    });
+    TaskScheduler& scheduler = TaskScheduler::instance();
 
     AssetManager assetManager(config);
-    assetManager.initializeAssets();
+    assetManager.initializeAssets(scheduler);
+
+    // Clips and images copied in mid-show, and edits to the assets config, are
+    // picked up without stopping playback
+    std::unique_ptr<AssetWatcher> assetWatcher;
+    if (config.watchAssets) {
+        assetWatcher = std::make_unique<AssetWatcher>(
+            std::vector<std::string>{Background::backgroundsPath.string(), Foreground::foregroundsPath.string()},
+            std::vector<std::string>{config.assetsConfigFile},
+            [&assetManager, &scheduler]() { assetManager.reloadAssets(scheduler); },
+            [&config]() { applyThreadRole(ThreadRole::IO, config.getThreadPolicy(ThreadRole::IO)); });
+        std::cout << "Watching assets for changes" << (assetWatcher->isPolling() ? " by polling" : "") << std::endl;
+    }
 
     std::shared_ptr<Background> activeBackgroundAsset = assetManager.getDefaultBackground();
     std::shared_ptr<Foreground> activeForegroundAsset = assetManager.getDefaultForeground();
@@ -117,202 +183,538 @@ void videoProcessingThread(std::shared_ptr<VideoPlayerFacade> player, const Disp
     
     long long lastFrameTime = cv::getTickCount();
 
-    // Define the beat interval for CUE changes
-    const double cueBeatInterval = 32.0;
-    double lastCueBeat = 0.0;
+    // Events drained from the queue once per frame
+    std::array<Event, 256> eventBatch;
+
+    // Recording sees every event as the frame loop takes it off the queue,
+    // replayed ones included, and writes them from an IO thread
+    std::unique_ptr<EventRecorder> recorder;
+    if (!options.recordPath.empty()) {
+        recorder = std::make_unique<EventRecorder>(options.recordPath, [&config]() {
+            applyThreadRole(ThreadRole::IO, config.getThreadPolicy(ThreadRole::IO));
+        });
+        EventRecorder* recorderPtr = recorder.get();
+        player->getEventQueue()->setTap([recorderPtr](const Event& event) { recorderPtr->record(event); });
+    }
+    std::unique_ptr<EventReplayer> replayer;
+    if (!options.replayPath.empty()) {
+        replayer = std::make_unique<EventReplayer>(options.replayPath, !options.replayFast);
+        if (!replayer->isOpen()) {
+            replayer.reset();
+        }
+    }
+    bool isFastReplay = replayer && !replayer->isRealtime();
+
+    // Notes and controllers arrive as events with the key they are mapped to
+    std::unique_ptr<MidiInput> midiInput;
+    if (config.midiEnabled) {
+        midiInput = std::make_unique<MidiInput>(config, *player->getEventQueue());
+    }
+
+    // Lighting desks and tablets send the same actions over the network
+    std::unique_ptr<OscServer> oscServer;
+    if (config.oscEnabled) {
+        oscServer = std::make_unique<OscServer>(config.oscPort, *player->getEventQueue(), [&config]() {
+            applyThreadRole(ThreadRole::IO, config.getThreadPolicy(ThreadRole::IO));
+        });
+    }
+
+    // Shares tempo and phrase phase with other machines. When picked by name it
+    // is used on its own as well, otherwise only while another peer is connected.
+    std::unique_ptr<AbletonLinkManager> linkManager;
+    if (config.linkEnabled || config.beatSource == "link") {
+        linkManager = std::make_unique<AbletonLinkManager>(config, config.beatSource != "link");
+    }
 
-    // Initialize sync time to the start of the application
-    lastSyncTime = std::chrono::steady_clock::now();
+    // Grids of known tracks, followed while OSC says one of them is playing
+    BeatGridLibrary beatGrids(config.beatGridDirectory);
+    BeatGridSource trackBeatSource;
+
+    // Beat sources in order of preference, the audio estimate is the fallback
+    AudioBeatSource audioBeatSource(config.audioDelayMs);
+    std::vector<BeatSource*> beatSources;
+    bool isMidiClockAvailable = midiInput && midiInput->isOpen() && config.midiClock;
+    if (linkManager && (config.beatSource == "auto" || config.beatSource == "link")) {
+        beatSources.push_back(linkManager.get());
+    }
+    if (isMidiClockAvailable && (config.beatSource == "auto" || config.beatSource == "midi")) {
+        beatSources.push_back(&midiInput->getClock());
+    }
+    if (beatGrids.size() > 0 && (config.beatSource == "auto" || config.beatSource == "track")) {
+        beatSources.push_back(&trackBeatSource);
+    }
+    beatSources.push_back(&audioBeatSource);
+    BeatSource* activeBeatSource = &audioBeatSource;
+
+    // Steps quality down when frames miss their deadline
+    QualityGovernor governor(config.adaptiveQuality);
+    long long frameIndex = 0;
+    cv::Mat frame;
+
+    // Per-pixel work is split into row bands on the shared scheduler
+    Compositor compositor(scheduler);
+
+    // Assets being opened on the scheduler, swapped in once they are ready so
+    // opening a clip never stalls the frame loop
+    std::shared_ptr<Background> pendingBackground;
+    std::shared_ptr<Foreground> pendingForeground;
+    std::future<void> pendingBackgroundOpen;
+    std::future<void> pendingForegroundOpen;
+    std::future<void> queuedBackgroundOpen;
+    std::future<void> queuedForegroundOpen;
+
+    // Scale/composite and effects run on their own threads, this thread only
+    // handles events and decoding. Only the composite stage uses the asset manager's blending state.
+    FramePipeline pipeline(config.pipelineDepth,
+        [&assetManager, &compositor, &governor](FrameJob& job) {
+            governor.beginStage(FrameStage::Composite);
+            if (!compositor.composite(job.background, job.foreground, job.renderSize, job.foregroundScale, job.foregroundColor, job.interpolation, job.output)) {
+                // Unusual pixel formats take the generic OpenCV path
+                job.output = scaleToFit(job.background, job.renderSize.width, job.renderSize.height, cv::Scalar(0, 0, 0), job.interpolation);
+                job.output = assetManager.blend(job.output, job.foreground, job.renderSize.width, job.renderSize.height, job.foregroundScale, job.foregroundColor, job.interpolation);
+            }
+            governor.endStage(FrameStage::Composite);
+        },
+        [&config, &compositor, &governor, targetDisplay](FrameJob& job) {
+            governor.beginStage(FrameStage::Effects);
+            if (job.strobeWhite) {
+                job.output = cv::Mat(job.renderSize, CV_8UC3);
+                compositor.fill(job.output, cv::Scalar(255, 255, 255));
+            }
+
+            // The only pass that touches display-resolution pixels. By default the Metal
+            // view samples the smaller texture with linear filtering while drawing it.
+            if (config.cpuUpscale && job.renderSize != cv::Size(targetDisplay.width, targetDisplay.height)) {
+                cv::resize(job.output, job.output, cv::Size(targetDisplay.width, targetDisplay.height), 0, 0, cv::INTER_LINEAR);
+            }
+            governor.endStage(FrameStage::Effects);
+        },
+        [player, &governor](FrameJob& job) {
+            governor.beginStage(FrameStage::Present);
+            player->pushFrame(job.output, job.decodeStart);
+            governor.endStage(FrameStage::Present);
+        },
+        [&config]() {
+            applyThreadRole(ThreadRole::FrameProducer, config.getThreadPolicy(ThreadRole::FrameProducer));
+        });
+    governor.setPipelined(pipeline.isPipelined());
+
+    // CUE changes fall on phrase starts, found in the music when the beat source can
+    double lastCueBeat = -std::numeric_limits<double>::infinity();
 
     // Beat tracking variables
     double lastBeatValue = 0.0;
-    
+
+    // Scheduled events with the beat they are due on
+    std::vector<std::pair<double, Event>> scheduledEvents;
+    scheduledEvents.reserve(MAX_SCHEDULED_EVENTS);
+
+    // Actions bound to a key, from the keyboard, a mapped MIDI note or controller, or OSC
+    auto handleKeyAction = [&](int keyCode, bool isKeyDown) {
+        switch (keyCode) {
+            case 'b': // Bounce
+                if (isKeyDown) {
+                    player->isBounceActive.store(!player->isBounceActive.load());
+                    std::cout << "BOUNCE mode is now: " << (player->isBounceActive.load() ? "ON" : "OFF") << std::endl;
+                }
+                break;
+            case ' ': // Strobe
+                player->isStrobeActive.store(isKeyDown);
+                break;
+            case 'c': // CUE
+                if (isKeyDown) {
+                    player->isCueActive.store(!player->isCueActive.load());
+                    std::cout << "CUE mode is now: " << (player->isCueActive.load() ? "ON" : "OFF") << std::endl;
+                }
+                break;
+            case 'r': // Resync the beat counter
+                if (isKeyDown) {
+                   isSyncActive.store(true);
+                }
+                break;
+        }
+
+        // --- Background/Foreground Swapping Logic ---
+        std::shared_ptr<Background> newBg = assetManager.getBackroundByPressedKey(keyCode);
+        std::shared_ptr<Foreground> newFg = assetManager.getForegroundByPressedKey(keyCode);
+
+        if (newBg && isKeyDown) {
+            if (player->isCueActive.load()) {
+                player->setQueuedBackground(newBg);
+                queuedBackgroundOpen = scheduler.async(TaskPriority::Prefetch, [newBg]() { newBg->open(); });
+                std::cout << "Queued background change." << std::endl;
+            } else {
+                // Instant change, as soon as the clip is open
+                pendingBackground = newBg;
+                pendingBackgroundOpen = scheduler.async(TaskPriority::Prefetch, [newBg]() { newBg->open(); });
+            }
+        }
+
+        if (newFg) {
+            if (player->isCueActive.load()) {
+                player->setQueuedForeground(newFg);
+                queuedForegroundOpen = scheduler.async(TaskPriority::Prefetch, [newFg]() { newFg->open(); });
+                std::cout << "Queued foreground change." << std::endl;
+            } else {
+                // Instant change, as soon as the image is loaded
+                pendingForeground = newFg;
+                pendingForegroundOpen = scheduler.async(TaskPriority::Prefetch, [newFg]() { newFg->open(); });
+            }
+        }
+    };
+
+    auto handleEvent = [&](const Event& event) {
+        switch (event.keyCode) {
+            case ACTION_TEMPO_SET:
+                audioBeatSource.setTempo(std::chrono::steady_clock::now(), event.value);
+                std::cout << std::endl << "Tempo set to " << event.value << " BPM" << std::endl;
+                return;
+            case ACTION_TEMPO_NUDGE:
+                audioBeatSource.nudgeTempo(std::chrono::steady_clock::now(), event.value);
+                return;
+            case ACTION_TRACK_PLAY: {
+                const BeatGrid* grid = event.midiCommand != 0 ? beatGrids.find(static_cast<uint32_t>(event.midiCommand)) : nullptr;
+                auto startTime = event.timestamp.time_since_epoch().count() != 0 ? event.timestamp : std::chrono::steady_clock::now();
+                trackBeatSource.play(grid, startTime, event.value);
+                lastBeatValue = 0.0; // The new track counts its own beats
+                if (grid) {
+                    std::cout << std::endl << "Playing " << grid->name << " (" << grid->bpm << " BPM) from " << event.value << " s" << std::endl;
+                } else if (event.midiCommand != 0) {
+                    std::cout << std::endl << "No beat grid for that track." << std::endl;
+                }
+                return;
+            }
+        }
+        handleKeyAction(event.keyCode, event.isKeyDown);
+    };
+
     // The main loop to continuously monitor and process events.
     while (player->isRunning()) {
         auto now = std::chrono::steady_clock::now();
-        double currentBPM = *g_BPM;
-        
+        // One snapshot per frame, so a reload never lands halfway through one
+        const LiveConfig live = configManager.getLive();
+        const double cueBeatInterval = live.cuePhraseBars * METER_BEATS_PER_BAR;
+        for (BeatSource* source : beatSources) {
+            source->capture(now);
+        }
+
+        // Beat-driven state is evaluated for the moment this frame will be on screen.
+        // Presentation feedback covers the pipeline, the frame queue and the swap;
+        // until the display reports it, the pipeline latency stands in.
+        double presentLatencyMs = player->getPresentLatency();
+        double measuredLatencyMs = presentLatencyMs > 0.0 ? presentLatencyMs : pipeline.getLatency();
+        double renderAheadMs = live.latencyCompensation ? measuredLatencyMs + live.displayLatencyMs : 0.0;
+        auto renderTime = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(renderAheadMs));
+
+        double beatBefore = activeBeatSource->getBeat(renderTime);
+        bool isBeatJump = false;
+
         // Check for sync event
         if (isSyncActive.load()) {
-            lastSyncTime = now;
+            audioBeatSource.sync(now);
+            isBeatJump = true;
             isSyncActive.store(false);
             lastBeatValue = 0.0; // Reset beat counter
             std::cout << "Manual sync triggered." << std::endl;
         }
 
-        // Calculate current beat from last sync time
+        // Take tempo and beat from the preferred source that is running
+        BeatSource* beatSource = beatSources.back();
+        for (BeatSource* source : beatSources) {
+            if (source->isActive()) {
+                beatSource = source;
+                break;
+            }
+        }
+        if (beatSource != activeBeatSource) {
+            activeBeatSource = beatSource;
+            isBeatJump = true;
+            lastBeatValue = 0.0; // Beat positions of different sources are unrelated
+            std::cout << std::endl << "Beat source: " << beatSource->getName() << std::endl;
+        }
+        double currentBPM = beatSource->getBpm();
         double beatDurationSec = 60.0 / currentBPM;
-        double elapsedSeconds = std::chrono::duration<double>(now - lastSyncTime).count();
-        double currentBeat = elapsedSeconds / beatDurationSec;
+        double currentBeat = beatSource->getBeat(renderTime);
+
+        // Scheduled events keep their distance in beats across a resync or source change
+        if (isBeatJump) {
+            for (auto& scheduled : scheduledEvents) {
+                scheduled.first += currentBeat - beatBefore;
+            }
+            lastCueBeat += currentBeat - beatBefore;
+        }
+        double phraseBeat = beatSource->getPhraseBeat(currentBeat, cueBeatInterval);
 
         // --- Process Events ---
-        Event event;
-        while (player->getEventQueue()->pop(event)) {
-            // Handle key down/up events
-            if (event.type == AppEventType::Keyboard) {
-                switch (event.keyCode) {
-                    case 'b': // Bounce
-                        if (event.isKeyDown) {
-                            player->isBounceActive.store(!player->isBounceActive.load());
-                            std::cout << "BOUNCE mode is now: " << (player->isBounceActive.load() ? "ON" : "OFF") << std::endl;
-                        }
-                        break;
-                    case ' ': // Strobe
-                        player->isStrobeActive.store(event.isKeyDown);
-                        break;
-                    case 'c': // CUE
-                        if (event.isKeyDown) {
-                            player->isCueActive.store(!player->isCueActive.load());
-                            std::cout << "CUE mode is now: " << (player->isCueActive.load() ? "ON" : "OFF") << std::endl;
-                        }
-                        break;
-                    case 'r': // Resync the beat counter
-                        if (event.isKeyDown) {
-                           isSyncActive.store(true);
-                        }
-                        break;
-                }
+        governor.beginStage(FrameStage::Events);
+        if (replayer) {
+            replayer->feed(*player->getEventQueue(), frameIndex);
+        }
+        if (recorder) {
+            recorder->setPosition(frameIndex, currentBeat);
+        }
+        size_t eventCount = player->getEventQueue()->drain(eventBatch.data(), eventBatch.size());
+        auto drainTime = std::chrono::steady_clock::now();
+        for (size_t eventIndex = 0; eventIndex < eventCount; ++eventIndex) {
+            const Event& event = eventBatch[eventIndex];
+            // A timestamp in the future is a bundle timetag, hold the event until the frame shown at that time
+            if (event.timestamp > drainTime && scheduledEvents.size() < MAX_SCHEDULED_EVENTS && currentBPM > 0.0) {
+                double beatsAhead = std::chrono::duration<double>(event.timestamp - renderTime).count() / beatDurationSec;
+                scheduledEvents.emplace_back(currentBeat + beatsAhead, event);
+                continue;
+            }
+            // Keyboard keys, mapped MIDI notes and OSC messages share the same actions
+            handleEvent(event);
+        }
+        for (auto scheduled = scheduledEvents.begin(); scheduled != scheduledEvents.end();) {
+            if (currentBeat >= scheduled->first) {
+                handleEvent(scheduled->second);
+                scheduled = scheduledEvents.erase(scheduled);
+            } else {
+                ++scheduled;
+            }
+        }
 
-                // --- Background/Foreground Swapping Logic ---
-                std::shared_ptr<Background> newBg = assetManager.getBackroundByPressedKey(event.keyCode);
-                std::shared_ptr<Foreground> newFg = assetManager.getForegroundByPressedKey(event.keyCode);
-
-                if (newBg && event.isKeyDown) {
-                    if (player->isCueActive.load()) {
-                        player->setQueuedBackground(newBg);
-                        std::cout << "Queued background change." << std::endl;
-                    } else {
-                        // Instant change
-                        activeBackgroundAsset->close();
-                        activeBackgroundAsset = newBg;
-                        activeBackgroundAsset->open();
-                        player->setActiveBackground(activeBackgroundAsset);
-                    }
-                }
+        if (pendingBackground && isReady(pendingBackgroundOpen)) {
+            activeBackgroundAsset->close();
+            activeBackgroundAsset = pendingBackground;
+            pendingBackground = nullptr;
+            player->setActiveBackground(activeBackgroundAsset);
+        }
 
-                if (newFg) {
-                    if (player->isCueActive.load()) {
-                        player->setQueuedForeground(newFg);
-                        std::cout << "Queued foreground change." << std::endl;
-                    } else {
-                        // Instant change
-                        activeForegroundAsset->close();
-                        activeForegroundAsset = newFg;
-                        activeForegroundAsset->open();
-                        player->setActiveForeground(activeForegroundAsset);
-                    }
-                }
-            }
+        if (pendingForeground && isReady(pendingForegroundOpen)) {
+            activeForegroundAsset->close();
+            activeForegroundAsset = pendingForeground;
+            pendingForeground = nullptr;
+            player->setActiveForeground(activeForegroundAsset);
         }
 
-        // Cue logic
+        // Cue logic: once per phrase, on the first frame of it. A phrase start
+        // that moves as the meter settles does not cue twice in one phrase.
+        double phraseStartBeat = currentBeat - phraseBeat;
         if (player->isCueActive.load()) {
-            if (isNearMultiple(currentBeat, cueBeatInterval, 0.1)) {
+            if (phraseBeat < CUE_LATE_BEATS && phraseStartBeat > lastCueBeat + cueBeatInterval / 2) {
+                lastCueBeat = phraseStartBeat;
                 // Time to apply ther cue change
                 std::shared_ptr<Background> bg = nullptr;
                 if (player->getQueuedBackground().has_value()) {
+                    // Opened on the scheduler when it was queued, normally long done
                     bg = player->getQueuedBackground().value();
+                    if (queuedBackgroundOpen.valid()) {
+                        queuedBackgroundOpen.wait();
+                    }
                 }
                 else {
                     bg = assetManager.getRandomBackground();
+                    if (bg) {
+                        bg->open();
+                    }
                 }
-                activeBackgroundAsset->close();
-                activeBackgroundAsset = bg;
-                activeBackgroundAsset->open();
+                // No background to pick from keeps the current one playing
+                if (bg) {
+                    activeBackgroundAsset->close();
+                    activeBackgroundAsset = bg;
 
-                player->setActiveBackground(activeBackgroundAsset);
+                    player->setActiveBackground(activeBackgroundAsset);
+                    std::cout << "Applying queued background change." << std::endl;
+                }
                 player->clearQueuedBackground();
-                std::cout << "Applying queued background change." << std::endl;
 
                 std::shared_ptr<Foreground> fg = nullptr;
                 if (player->getQueuedForeground().has_value()) {
                     fg = player->getQueuedForeground().value();
+                    if (queuedForegroundOpen.valid()) {
+                        queuedForegroundOpen.wait();
+                    }
                 }
                 else{
                     fg = assetManager.getRandomForeground();
+                    if (fg) {
+                        fg->open();
+                    }
+                }
+                if (fg) {
+                    activeForegroundAsset->close();
+                    activeForegroundAsset = fg;
+                    player->setActiveForeground(activeForegroundAsset);
+                    std::cout << "Applying queued foreground change." << std::endl;
                 }
-                activeForegroundAsset->close();
-                activeForegroundAsset = fg;
-                activeForegroundAsset->open();
-                player->setActiveForeground(activeForegroundAsset);
                 player->clearQueuedForeground();
-                std::cout << "Applying queued foreground change." << std::endl;
-            }
-            else {
-                // std::cout << "BEAT " << currentBeat << " OF " << cueBeatInterval << std::endl;
             }
         }
+        governor.endStage(FrameStage::Events);
 
         // --- Frame Generation and Effects ---
-        cv::Mat frame = activeBackgroundAsset->get_next_frame();
+        governor.beginStage(FrameStage::Decode);
+        // Decoded here rather than on the scheduler: a capture reads one frame at a
+        // time, and the composite and present stages already overlap with this one
+        if (governor.shouldDecodeFrame(frameIndex) || frame.empty()) {
+            frame = activeBackgroundAsset->get_next_frame();
+        } else {
+            // Keep the clip running at its own speed but repeat the previous picture
+            activeBackgroundAsset->skip_frame();
+        }
+
+        FrameJob job;
+        job.index = frameIndex;
+        job.decodeStart = now;
+        job.background = frame;
+        job.foreground = activeForegroundAsset->get_next_frame();
+        job.foregroundColor = activeBackgroundAsset->get_foreground_color();
+        job.renderSize = getRenderSize(live, targetDisplay, governor.getRenderScale());
+        job.interpolation = governor.getInterpolation();
+        governor.endStage(FrameStage::Decode);
 
         // Apply effects
-        
         double scale = 1.0;
-        if (player->isBounceActive.load()) {
+        if (player->isBounceActive.load() && live.bounceSource == BounceSource::Kick) {
+            AudioLevels levels = g_audioLevels.load();
+            auto capturedAgo = now.time_since_epoch() - std::chrono::nanoseconds(levels.captureNs);
+            if (capturedAgo < AUDIO_LEVELS_TIMEOUT) {
+                scale = 1.0 + live.bounceAmount * levels.getEnvelope(AudioBand::Kick);
+            }
+        } else if (player->isBounceActive.load()) {
             if (std::floor(currentBeat) > lastBeatValue) {
                 lastBeatValue = std::floor(currentBeat);
                 isAnimating = true;
-                animationStartTime = std::chrono::steady_clock::now();
+                // Start from when the beat fell, not from the first frame after it
+                double secondsSinceBeat = (currentBeat - std::floor(currentBeat)) * beatDurationSec;
+                animationStartTime = renderTime - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(secondsSinceBeat));
             }
 
             if (isAnimating) {
-                auto elapsed = std::chrono::steady_clock::now() - animationStartTime;
+                auto elapsed = renderTime - animationStartTime;
                 double progress = std::chrono::duration<double>(elapsed).count() / beatDurationSec;
                 if (progress < 1.0) {
-                    scale = 1.0 + 0.1 * std::sin((progress + 0.5) * (M_PI));
+                    scale = 1.0 + live.bounceAmount * std::sin((progress + 0.5) * (M_PI));
                 } else {
                     scale = 1.0;
                     isAnimating = false;
                 }
             }
         }
-
-        cv::Mat outputFrame = scaleToFit(frame, targetDisplay.width, targetDisplay.height);
-        outputFrame = assetManager.blend(outputFrame, activeForegroundAsset->get_next_frame(), targetDisplay.width, targetDisplay.height, activeForegroundAsset->get_scale() * scale, activeBackgroundAsset->get_foreground_color());
+        job.foregroundScale = activeForegroundAsset->get_scale() * scale;
 
         if (player->isStrobeActive.load()) {
             if (now >= nextStrobeTime) {
                 strobeFrameToggle = !strobeFrameToggle;
-                double beatDurationMs = 6000.0 / currentBPM;
-                nextStrobeTime = now + std::chrono::milliseconds(static_cast<long long>(beatDurationMs));
+                double flipMs = 60000.0 / (currentBPM * live.strobeRate);
+                nextStrobeTime = now + std::chrono::milliseconds(static_cast<long long>(flipMs));
             }
-            if (strobeFrameToggle) {
-                cv::Mat whiteFrame(targetDisplay.height, targetDisplay.width, CV_8UC3, cv::Scalar(255, 255, 255));
-                player->pushFrame(whiteFrame);
-            } else {
-                player->pushFrame(outputFrame);
-            }
-        } else {
-            player->pushFrame(outputFrame);
+            job.strobeWhite = strobeFrameToggle;
         }
 
+        pipeline.submit(std::move(job));
+
         double fps = activeBackgroundAsset->get_fps();
         if (fps <= 0) fps = 30.0;
         long long currentTick = cv::getTickCount();
         double elapsedTime_ms = (currentTick - lastFrameTime) * 1000.0 / cv::getTickFrequency();
+        governor.endFrame(1000.0 / fps);
+        frameIndex++;
         int delay_ms = static_cast<int>(1000.0 / fps - elapsedTime_ms);
-        if (delay_ms > 0) {
+        if (delay_ms > 0 && !isFastReplay) {
             std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
         }
         lastFrameTime = cv::getTickCount();
-        std::cout << "BPM: " << std::fixed << std::setprecision(2) << currentBPM << " | " << std::floor(fmod(currentBeat, cueBeatInterval)) << "/" << cueBeatInterval << std::flush << "\r";
+        std::cout << "BPM: " << std::fixed << std::setprecision(2) << currentBPM << " | " << std::floor(phraseBeat) << "/" << cueBeatInterval << " | latency " << std::setprecision(1) << measuredLatencyMs << " ms";
+        if (linkManager) {
+            std::cout << " | link peers " << linkManager->getPeerCount();
+        }
+        if (beatSource == &audioBeatSource && audioBeatSource.isPhaseLocked()) {
+            std::cout << " | phase locked";
+        }
+        if (beatSource == &audioBeatSource && g_tempoConfidence.load() > 0.0) {
+            std::cout << " | confidence " << std::setprecision(2) << g_tempoConfidence.load();
+        }
+        std::cout << std::flush << "\r";
+
+        if (replayer && replayer->isFinished()) {
+            std::cout << std::endl << "Replay finished after " << frameIndex << " frames." << std::endl;
+            replayer.reset();
+            // A fast replay is a bench run, it ends with the log
+            if (isFastReplay) {
+                player->stopVisualization();
+            }
+        }
+    }
+
+    pipeline.stop();
+    if (recorder) {
+        player->getEventQueue()->setTap(nullptr);
+        recorder->stop();
     }
 }
 
 int main(int argc, char *argv[]) {
+    if (argc > 2 && std::string(argv[1]) == "--benchmark") {
+        return runBenchmark(argv[2]);
+    }
+
+    SessionOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) {
+            options.recordPath = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            options.replayPath = argv[++i];
+        } else if (arg == "--fast") {
+            options.replayFast = true;
+        } else if (arg == "--calibrate") {
+            options.calibrate = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg << "\n";
+            std::cerr << "Usage: VisualHive [--record <file>] [--replay <file> [--fast]] | --calibrate | --benchmark <name>\n";
+            return 1;
+        }
+    }
+
+    // The config is loaded up front so every thread gets its role applied from the start
+    ConfigManager configManager("config/config.json");
+    const AppConfig& config = configManager.getConfig();
+
+    if (config.lockMemory) {
+        lockProcessMemory();
+    }
+
+    DetectionSettings detectionSettings;
+    if (config.detectionEngine == "onset") {
+        detectionSettings.engine = DetectionEngine::Onset;
+    } else if (config.detectionEngine == "aubio-median") {
+        detectionSettings.engine = DetectionEngine::AubioMedian;
+    }
+    detectionSettings.hopSize = static_cast<uint_t>(config.onsetHopSize);
+    detectionSettings.minBpm = config.preferredMinBpm;
+    detectionSettings.maxBpm = config.preferredMaxBpm;
+
+    if (options.calibrate) {
+        return runLatencyCalibration(config, detectionSettings);
+    }
+
+    // Display, latency and effects settings are applied while the show runs
+    std::unique_ptr<AssetWatcher> configWatcher;
+    if (config.watchConfig) {
+        configWatcher = std::make_unique<AssetWatcher>(
+            std::vector<std::string>{},
+            std::vector<std::string>{configManager.getConfigFilePath()},
+            [&configManager]() { configManager.reloadLive(); },
+            [&config]() { applyThreadRole(ThreadRole::IO, config.getThreadPolicy(ThreadRole::IO)); });
+    }
+
     // Start a thread to simulate BPM changes
-    std::thread bpmThread([]() {
-        bpmDetectionInit();
-        bpmDetectionLoop();
+    std::thread bpmThread([&config, detectionSettings]() {
+        applyThreadRole(ThreadRole::AudioAnalysis, config.getThreadPolicy(ThreadRole::AudioAnalysis));
+        if (bpmDetectionInit(detectionSettings, createAudioSource(config))) {
+            bpmDetectionLoop();
+        }
     });
 
     const DisplayInfo targetDisplay = selectTargetDisplay();
     auto player = std::make_shared<VideoPlayerFacade>();
 
     // Start a video processing thread
-    std::thread processingThread([player, targetDisplay]() {
-        videoProcessingThread(player, targetDisplay);
+    std::thread processingThread([player, targetDisplay, &configManager, &options]() {
+        videoProcessingThread(player, targetDisplay, configManager, options);
     });
 
     // Run the main app loop on the main thread.
@@ -320,6 +722,7 @@ int main(int argc, char *argv[]) {
 
     // Wait for the other threads to finish
     processingThread.join();
+    bpmDetectionStop();
     bpmThread.join();
 
     return 0;